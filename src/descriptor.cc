@@ -52,6 +52,10 @@ char* TaskDescriptor::get_event_buffer() {
 	return event_buffer;
 }
 
+int TaskDescriptor::get_event_buffer_len() {
+	return event_buffer_len;
+}
+
 void TaskDescriptor::to_ready(int system_response, Task::Scheduler* scheduler) {
 #ifdef OUR_DEBUG
 	if (state == ACTIVE || state == SEND_BLOCK || state == RECEIVE_BLOCK || state == REPLY_BLOCK || state == EVENT_BLOCK || state == INTERRUPTED) // ignoring event block for k2
@@ -97,11 +101,14 @@ void TaskDescriptor::to_reply_block(char* reply, int replylen) {
 }
 
 void TaskDescriptor::to_event_block() {
+	event_buffer = nullptr;
+	event_buffer_len = 0;
 	state = TaskDescriptor::TaskState::EVENT_BLOCK;
 }
 
-void TaskDescriptor::to_event_block_with_buffer(char* buffer) {
+void TaskDescriptor::to_event_block_with_buffer(char* buffer, int len) {
 	event_buffer = buffer;
+	event_buffer_len = len;
 	state = TaskDescriptor::TaskState::EVENT_BLOCK;
 }
 void TaskDescriptor::to_interrupted(Task::Scheduler* scheduler) {
@@ -37,6 +37,7 @@ public:
 	int fill_response(int from, char* msg, int msglen); // the reverse of last function, fill the response buffer
 	MessageStruct pop_inbox();
 	char* get_event_buffer();
+	int get_event_buffer_len();
 	// state modifying api
 	InterruptFrame* to_active();
 	void to_ready(int system_response, Task::Scheduler* scheduler);
@@ -48,7 +49,7 @@ public:
 	void to_reply_block(char* reply, int replylen);
 	// k3 will have to_event_block
 	void to_event_block();
-	void to_event_block_with_buffer(char* buffer);
+	void to_event_block_with_buffer(char* buffer, int len);
 
 	// state checking api
 	bool is_active();
@@ -76,6 +77,7 @@ private:
 	void (*pc)();								 // program counter, but typically only used as a reference value to see where the start of the program is
 	MessageReceiver response;					 // used to store response if task decided to call send, or receive
 	char* event_buffer;							 // used to store response if block on event that need reading (note that I could use response, but for good practice, no)
+	int event_buffer_len;						 // the kernel never writes past it
 	etl::queue<MessageStruct, INBOX_SIZE> inbox; // receiver of message
 	char* sp;									 // stack pointer
 	char* spsr;									 // saved program status register
@@ -32,6 +32,20 @@ void Clock::enable_clock_one_interrupts() {
 	Interrupt::enable_interrupt_for(TIMER_INTERRUPT_ID);
 }
 
+void Clock::enable_deadline_interrupts() {
+	Interrupt::enable_interrupt_for(DEADLINE_INTERRUPT_ID);
+}
+
+void Clock::set_deadline(uint64_t at) {
+	clear_deadline();
+	timer->C3 = (uint32_t)at;
+}
+
+void Clock::clear_deadline() {
+	// CS is write 1 to clear, or-ing it in would also clear a C1 match that hasn't been handled yet
+	timer->CS = 1 << 3;
+}
+
 Clock::TimeKeeper::TimeKeeper() {
 	if (last_ping == 0) {
 		last_ping = Clock::system_time();
@@ -7,6 +7,9 @@ namespace Clock
 {
 const int TIMER_INTERRUPT_ID = 97; // base timer interrupt is 96, +1 for C1
 const int MICROS_PER_TICK = 10000; // 10ms per tick
+// C3 wakes tasks at a system time (us) instead of a tick, C0 and C2 belong to the GPU
+const int DEADLINE_INTERRUPT_ID = 99;
+const int DEADLINE_WAITERS = 8;
 
 // Timer Functions
 uint32_t clo();
@@ -14,6 +17,10 @@ uint32_t chi();
 uint64_t system_time();
 
 void enable_clock_one_interrupts();
+void enable_deadline_interrupts();
+// only the low 32 bits are compared, deadlines have to be within ~71 minutes
+void set_deadline(uint64_t at);
+void clear_deadline();
 
 class TimeKeeper {
 public:
@@ -35,6 +35,7 @@ void Interrupt::init_interrupt() {
 	gicc->GICC_CTLR = 1; // GICC
 
 	Clock::enable_clock_one_interrupts();
+	Clock::enable_deadline_interrupts();
 	UART::enable_uart_interrupt();
 }
 
@@ -53,6 +54,6 @@ void Interrupt::end_interrupt(uint32_t id) {
 void Interrupt::enable_interrupt_for(uint32_t id) {
 
 	gicd->GICD_ISENABLERN[id / 32] = 1 << (id % 32);
-	// also setup GICD ITARGETSRn to route to cpu 0
-	gicd->GICD_ITARGETSRN[id / 4] = 1 << (8 * (id % 4));
+	// also setup GICD ITARGETSRn to route to cpu 0, one byte per interrupt so the others in the register are kept
+	gicd->GICD_ITARGETSRN[id / 4] |= 1 << (8 * (id % 4));
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include "../rpi.h"
+#include "../utils/spsc_ring.h"
 #include "interrupt.h"
 #include <stdint.h>
 
@@ -7,7 +8,36 @@ namespace UART
 {
 const int UART_INTERRUPT_ID = 145;
 enum InterruptType {UART_MODEM_INTERRUPT = 0, UART_CLEAR = 1, UART_TXR_INTERRUPT = 2, UART_RX_TIMEOUT = 12, UART_RX_INTERRUPT = 4};
-enum InterruptEvents {UART_0_TXR_INTERRUPT, UART_0_RX_TIMEOUT, UART_1_TXR_INTERRUPT, UART_1_RX_INTERRUPT, UART_1_RX_TIMEOUT, UART_1_MSR_INTERRUPT};
+enum InterruptEvents {UART_0_TXR_INTERRUPT, UART_0_RX_TIMEOUT, UART_1_TXR_INTERRUPT, UART_1_RX_INTERRUPT, UART_1_RX_TIMEOUT, UART_1_MSR_INTERRUPT, UART_1_SENSOR_FRAME};
+// output lanes of the terminal transmitter, a lower lane is always served first
+enum OutputLane {LANE_ECHO = 0, LANE_UI = 1, LANE_DEBUG = 2, NUM_OUTPUT_LANES = 3};
+
+// what uart 1 receive replies to a Getc, Getc itself only takes the byte
+struct TimedByte {
+	char c;
+	uint64_t at; // us, the interrupt that brought the byte in, or when the ring was registered if it was already there
+};
+
+// RegisterRxRing, the receive servers keep these and the kernel fills them from the rx interrupts
+const uint32_t UART_0_RX_RING_SIZE = 1024;
+const uint32_t UART_1_RX_RING_SIZE = 256;
+typedef SpscRing<char, UART_0_RX_RING_SIZE> Uart0RxRing;
+typedef SpscRing<TimedByte, UART_1_RX_RING_SIZE> Uart1RxRing;
+
+// uart 1 is written by the kernel, a task hands it a chunk at a time and sleeps until the last byte left the THR
+const int TRANSMIT_CHUNK_SIZE = 16;
+struct TransmitDone {
+	uint64_t first_at; // us, the first byte went into the THR
+	uint64_t done_at;  // us, the THR empty interrupt after the last byte
+};
+
+// UART_1_SENSOR_FRAME, the kernel collects the reply to a sensor poll and wakes the waiter once with all of it
+const char SENSOR_FRAME_REQUEST = (char)0x85;
+const int SENSOR_FRAME_LEN = 10;
+struct SensorFrame {
+	char bytes[SENSOR_FRAME_LEN];
+	uint64_t byte_at[SENSOR_FRAME_LEN]; // us, the rx interrupt that brought each byte in
+};
 
 const char TRANS_ENABLE_BIT = (char)0b10;
 const char RECEIVE_ENABLE_BIT = (char)0b01;
@@ -122,11 +122,11 @@ int Interrupt::AwaitEvent(int eventId) {
 	return to_kernel(Kernel::HandlerCode::AWAIT_EVENT, eventId);
 }
 
-int Interrupt::AwaitEventWithBuffer(int eventId, char* buffer) {
+int Interrupt::AwaitEventWithBuffer(int eventId, char* buffer, int len) {
 	// this is a specialized version of await event, where we also accept a buffer which will be used to copy
-	// information due to the natural size of event registers, it is assumed buffer holds at least 64 bytes note the
-	// return value is how much of the buffer is used
-	return to_kernel(Kernel::HandlerCode::AWAIT_EVENT_WITH_BUFFER, eventId, buffer);
+	// information, everything that came in since the last wait and fits in len is copied, the return value is how much
+	// of the buffer is used
+	return to_kernel(Kernel::HandlerCode::AWAIT_EVENT_WITH_BUFFER, eventId, buffer, len);
 }
 
 int UART::UartWriteRegister(int channel, char reg, char data) {
@@ -145,6 +145,18 @@ int UART::ReceiveInterrupt(int channel, bool enable) {
 	return to_kernel(Kernel::HandlerCode::RECEIVE_INTERRUPT, channel, enable);
 }
 
+int UART::Transmit(const char* s, int len, TransmitDone* done) {
+	return to_kernel(Kernel::HandlerCode::UART_TRANSMIT, s, len, done);
+}
+
+int UART::SensorFrameMode(bool enable) {
+	return to_kernel(Kernel::HandlerCode::SENSOR_FRAME_MODE, enable);
+}
+
+int UART::RegisterRxRing(int channel, void* ring) {
+	return to_kernel(Kernel::HandlerCode::RX_RING, channel, ring);
+}
+
 int UART::UartReadAll(int channel, char* buffer) { // designed for reading all the bytes out of UART_RHR
 	return to_kernel(Kernel::HandlerCode::READ_ALL, channel, buffer);
 }
@@ -159,7 +171,7 @@ int UART::Putc(int tid, int uart, char ch) {
 	return 0;
 }
 
-int UART::Puts(int tid, int uart, const char* s, uint64_t len) {
+int UART::Puts(int tid, int uart, const char* s, uint64_t len, OutputLane lane) {
 	// since we only have uart0, uart param is ignored
 	if ((uart == 0 && tid != UART::UART_0_TRANSMITTER_TID) || (uart == 1 && tid != UART::UART_1_TRANSMITTER_TID)) {
 		
@@ -170,6 +182,7 @@ int UART::Puts(int tid, int uart, const char* s, uint64_t len) {
 
 	UART::WorkerRequestBody body;
 	body.msg_len = len;
+	body.lane = lane;
 	for (uint64_t i = 0; i < len; i++) {
 		body.msg[i] = s[i];
 	}
@@ -179,12 +192,13 @@ int UART::Puts(int tid, int uart, const char* s, uint64_t len) {
 	return 0;
 }
 
-int UART::PutsNullTerm(int tid, int uart, const char* s, uint64_t len) {
+int UART::PutsNullTerm(int tid, int uart, const char* s, uint64_t len, OutputLane lane) {
 	// since we only have uart0, uart param is ignored
 	if ((uart == 0 && tid != UART::UART_0_TRANSMITTER_TID) || (uart == 1 && tid != UART::UART_1_TRANSMITTER_TID)) {
 		return -1;
 	}
 	UART::WorkerRequestBody body;
+	body.lane = lane;
 	for (body.msg_len = 0; body.msg_len < len && (s[body.msg_len] != '\0'); body.msg_len++) {
 		body.msg[body.msg_len] = s[body.msg_len];
 	}
@@ -205,6 +219,55 @@ int UART::Getc(int tid, int uart) {
 	return (int)c;
 }
 
+int UART::GetcTimed(int tid, int uart, uint64_t* at) {
+	if (uart != 1 || tid != UART::UART_1_RECEIVER_TID) {
+		return -1;
+	}
+	UART::UARTServerReq req = UART::UARTServerReq(RequestHeader::UART_GETC, '0'); // body is irrelevant
+	UART::TimedByte byte;
+	Message::Send::Send(tid, reinterpret_cast<const char*>(&req), sizeof(UART::UARTServerReq), reinterpret_cast<char*>(&byte), sizeof(byte));
+	*at = byte.at;
+	return (int)byte.c;
+}
+
+int UART::PutsTagged(int tid, int uart, const char* s, uint64_t len, uint32_t tag, uint64_t due) {
+	if (uart != 1 || tid != UART::UART_1_TRANSMITTER_TID) {
+		Task::_KernelCrash("%d: only uart 1 reports egress\r\n", Task::MyTid());
+	} else if (len >= UART::UART_MESSAGE_LIMIT) {
+		Task::_KernelCrash("%d: len is too big in PutsTagged\r\n", Task::MyTid());
+	} else if (due != 0 && len > UART::DEADLINE_MESSAGE_LIMIT) {
+		Task::_KernelCrash("%d: len is too big for a deadline in PutsTagged\r\n", Task::MyTid());
+	}
+
+	UART::WorkerRequestBody body;
+	body.msg_len = len;
+	body.tag = tag;
+	body.due = due;
+	for (uint64_t i = 0; i < len; i++) {
+		body.msg[i] = s[i];
+	}
+
+	UART::UARTServerReq req = UART::UARTServerReq(RequestHeader::UART_PUTS, body);
+	Message::Send::SendNoReply(tid, reinterpret_cast<const char*>(&req), sizeof(UART::UARTServerReq));
+	return 0;
+}
+
+int UART::GetDeadlineHistogram(int tid, DeadlineHistogram* out) {
+	if (tid != UART::UART_1_TRANSMITTER_TID) {
+		return -1;
+	}
+	UART::UARTServerReq req = UART::UARTServerReq(RequestHeader::UART_DEADLINE_STATS, '0');
+	return Message::Send::Send(tid, reinterpret_cast<const char*>(&req), sizeof(UART::UARTServerReq), reinterpret_cast<char*>(out), sizeof(DeadlineHistogram));
+}
+
+int UART::AwaitEgress(int tid, EgressReport* report) {
+	if (tid != UART::UART_1_TRANSMITTER_TID) {
+		return -1;
+	}
+	UART::UARTServerReq req = UART::UARTServerReq(RequestHeader::UART_AWAIT_EGRESS, '0');
+	return Message::Send::Send(tid, reinterpret_cast<const char*>(&req), sizeof(UART::UARTServerReq), reinterpret_cast<char*>(report), sizeof(EgressReport));
+}
+
 Kernel::Kernel() {
 	allocate_new_task(Task::MAIDENLESS, Priority::LAUNCH_PRIORITY, &UserTask::launch);
 }
@@ -304,7 +367,7 @@ void Kernel::handle_syscall() {
 		handle_await_event((int)active_request->x1);
 		break;
 	case HandlerCode::AWAIT_EVENT_WITH_BUFFER:
-		handle_await_event_with_buffer(active_request->x1, (char*)active_request->x2);
+		handle_await_event_with_buffer(active_request->x1, (char*)active_request->x2, active_request->x3);
 		break;
 	case HandlerCode::WRITE_REGISTER:
 		handle_write_register();
@@ -324,6 +387,15 @@ void Kernel::handle_syscall() {
 	case HandlerCode::IDLE_STATS:
 		handle_idle_stats();
 		break;
+	case HandlerCode::UART_TRANSMIT:
+		handle_uart_transmit();
+		break;
+	case HandlerCode::SENSOR_FRAME_MODE:
+		handle_sensor_frame_mode();
+		break;
+	case HandlerCode::RX_RING:
+		handle_register_rx_ring();
+		break;
 	case HandlerCode::CRASH: {
 		const char* msg = reinterpret_cast<const char*>(active_request->x1);
 		kcrash(msg);
@@ -352,12 +424,14 @@ void Kernel::handle_interrupt(InterruptCode icode) {
 	switch (icode) {
 	case InterruptCode::TIMER: {
 		time_keeper.tick();
-
-		if (clock_notifier_tid != Task::MAIDENLESS) {
-			tasks[clock_notifier_tid]->to_ready(0x0, &scheduler);
-		} else {
-			kcrash("Clock Too Slow \r\n");
-		}
+		// a busy clock notifier gets every tick it missed on its next wait
+		pending_ticks += 1;
+		deliver_ticks();
+		break;
+	}
+	case InterruptCode::DEADLINE: {
+		Clock::clear_deadline();
+		arm_deadline();
 		break;
 	}
 	case InterruptCode::UART: {
@@ -379,17 +453,15 @@ void Kernel::handle_interrupt(InterruptCode icode) {
 		 * happening.
 		 */
 
+		// taken before anything else, the train uart notifiers get it as the time their bytes moved
+		uint64_t event_time = Clock::system_time();
 		int exception_code = (int)(uart_get(DEFAULT_SPI_CHANNEL, TERMINAL_UART_CHANNEL, UART_IIR) & 0x3F);
 
 		do {
 			// this is a really shitty way to handle this, I think it would probably be better if we something similar
 			// to a dedicated class object but we will fix it soon once experiementa go through.
-			if (exception_code == UART::InterruptType::UART_RX_TIMEOUT && uart_0_receive_tid != Task::MAIDENLESS) {
-				int input_len = uart_get_all(DEFAULT_SPI_CHANNEL, TERMINAL_UART_CHANNEL, tasks[uart_0_receive_tid]->get_event_buffer());
-				tasks[uart_0_receive_tid]->to_ready(input_len, &scheduler);
-				uart_0_receive_tid = Task::MAIDENLESS;
-				enable_receive_interrupt[TERMINAL_UART_CHANNEL] = false;
-				interrupt_control(TERMINAL_UART_CHANNEL);
+			if (exception_code == UART::InterruptType::UART_RX_TIMEOUT || exception_code == UART::InterruptType::UART_RX_INTERRUPT) {
+				drain_rx(TERMINAL_UART_CHANNEL, event_time);
 			} else if (exception_code == UART::InterruptType::UART_TXR_INTERRUPT && uart_0_transmit_tid != Task::MAIDENLESS) {
 				tasks[uart_0_transmit_tid]->to_ready(0x0, &scheduler);
 				uart_0_transmit_tid = Task::MAIDENLESS;
@@ -411,35 +483,37 @@ void Kernel::handle_interrupt(InterruptCode icode) {
 
 			// this is a really shitty way to handle this, I think it would probably be better if we something similar
 			// to a dedicated class object but we will fix it soon once experiementa go through.
-			if (exception_code == UART::InterruptType::UART_RX_TIMEOUT && uart_1_receive_timeout_tid != Task::MAIDENLESS) {
-				tasks[uart_1_receive_timeout_tid]->to_ready(0x0, &scheduler);
-				uart_1_receive_timeout_tid = Task::MAIDENLESS;
-				enable_receive_interrupt[TRAIN_UART_CHANNEL] = false;
-				interrupt_control(TRAIN_UART_CHANNEL);
-			} else if (exception_code == UART::InterruptType::UART_RX_INTERRUPT && uart_1_receive_tid != Task::MAIDENLESS) {
-				tasks[uart_1_receive_tid]->to_ready(0x0, &scheduler);
-				uart_1_receive_tid = Task::MAIDENLESS;
-				enable_receive_interrupt[TRAIN_UART_CHANNEL] = false;
-				interrupt_control(TRAIN_UART_CHANNEL);
-			} else if (exception_code == UART::InterruptType::UART_MODEM_INTERRUPT && uart_1_msr_tid != Task::MAIDENLESS) {
+			if ((exception_code == UART::InterruptType::UART_RX_TIMEOUT || exception_code == UART::InterruptType::UART_RX_INTERRUPT)
+				&& uart_1_frame.expecting) {
+				uart_1_frame_receive(event_time);
+			} else if (exception_code == UART::InterruptType::UART_RX_TIMEOUT || exception_code == UART::InterruptType::UART_RX_INTERRUPT) {
+				drain_rx(TRAIN_UART_CHANNEL, event_time);
+			} else if (exception_code == UART::InterruptType::UART_MODEM_INTERRUPT) {
+				// reading the MSR clears it, only a rise of CTS lets the next byte out
 				char state = uart_get(DEFAULT_SPI_CHANNEL, TRAIN_UART_CHANNEL, UART_MSR);
 				if ((state & 0x1) == 0x1 && (state & 0b10000) == 0b10000) {
-					tasks[uart_1_msr_tid]->to_ready(0x0, &scheduler);
-					uart_1_msr_tid = Task::MAIDENLESS;
+					uart_1_transmit.cts = true;
+					uart_1_transmit_step(event_time);
 				}
-			} else if (exception_code == UART::InterruptType::UART_TXR_INTERRUPT && uart_1_transmit_tid != Task::MAIDENLESS) {
-				tasks[uart_1_transmit_tid]->to_ready(0x0, &scheduler);
-				uart_1_transmit_tid = Task::MAIDENLESS;
+			} else if (exception_code == UART::InterruptType::UART_TXR_INTERRUPT) {
 				enable_transmit_interrupt[TRAIN_UART_CHANNEL] = false;
 				interrupt_control(TRAIN_UART_CHANNEL);
+				Uart1Transmit& t = uart_1_transmit;
+				t.thr_empty = true;
+				if (t.waiter != Task::MAIDENLESS && t.pos == t.len) {
+					t.done->done_at = event_time;
+					tasks[t.waiter]->to_ready(t.len, &scheduler);
+					t.waiter = Task::MAIDENLESS;
+				} else {
+					uart_1_transmit_step(event_time);
+				}
 			} else if (exception_code == UART::InterruptType::UART_CLEAR) {
 				break;
 			} else {
-				kcrash("Uart 1 Too Slow \r\nexception code: %d receive_tid: %d transmit_tid %d msr_tid %d\r\n",
+				kcrash("Uart 1 unknown interrupt \r\nexception code: %d receive_tid: %d transmit_tid %d\r\n",
 					   exception_code,
 					   uart_1_receive_tid,
-					   uart_1_transmit_tid,
-					   uart_1_msr_tid);
+					   uart_1_transmit.waiter);
 			}
 			exception_code = (int)(uart_get(DEFAULT_SPI_CHANNEL, TRAIN_UART_CHANNEL, UART_IIR) & 0x3F);
 		} while (exception_code != UART::InterruptType::UART_CLEAR);
@@ -529,8 +603,10 @@ void Kernel::handle_reply() {
 void Kernel::handle_await_event(int eventId) {
 	switch (eventId) {
 	case Clock::TIMER_INTERRUPT_ID: {
+		// returns the ticks since the last wait
 		clock_notifier_tid = active_task;
 		tasks[active_task]->to_event_block();
+		deliver_ticks();
 		break;
 	}
 	case UART::InterruptEvents::UART_0_TXR_INTERRUPT: {
@@ -538,24 +614,19 @@ void Kernel::handle_await_event(int eventId) {
 		tasks[active_task]->to_event_block();
 		break;
 	}
-	case UART::InterruptEvents::UART_1_TXR_INTERRUPT: {
-		uart_1_transmit_tid = active_task;
-		tasks[active_task]->to_event_block();
-		break;
-	}
-	case UART::InterruptEvents::UART_1_MSR_INTERRUPT: {
-		uart_1_msr_tid = active_task;
-		tasks[active_task]->to_event_block();
-		break;
-	}
-	case UART::InterruptEvents::UART_1_RX_INTERRUPT: {
-		uart_1_receive_tid = active_task;
+	case UART::InterruptEvents::UART_0_RX_TIMEOUT: {
+		// woken when the rx ring stops being empty
+		uart_0_receive_tid = active_task;
 		tasks[active_task]->to_event_block();
+		wake_rx(TERMINAL_UART_CHANNEL);
 		break;
 	}
+	case UART::InterruptEvents::UART_1_RX_INTERRUPT:
 	case UART::InterruptEvents::UART_1_RX_TIMEOUT: {
-		uart_1_receive_timeout_tid = active_task;
+		// same, either rx interrupt fills the ring
+		uart_1_receive_tid = active_task;
 		tasks[active_task]->to_event_block();
+		wake_rx(TRAIN_UART_CHANNEL);
 		break;
 	}
 	default:
@@ -564,11 +635,155 @@ void Kernel::handle_await_event(int eventId) {
 	}
 }
 
-void Kernel::handle_await_event_with_buffer(int eventId, char* buffer) {
+/**
+ * Timer interrupts the clock notifier missed are counted, and it gets all of them on its next wait. A plain AwaitEvent
+ * returns the count, a buffer gets it as a uint32_t.
+ */
+void Kernel::deliver_ticks() {
+	if (clock_notifier_tid == Task::MAIDENLESS || pending_ticks == 0) {
+		return;
+	}
+	char* buffer = tasks[clock_notifier_tid]->get_event_buffer();
+	if (buffer == nullptr) {
+		tasks[clock_notifier_tid]->to_ready(pending_ticks, &scheduler);
+	} else {
+		memcpy(buffer, &pending_ticks, sizeof(pending_ticks));
+		tasks[clock_notifier_tid]->to_ready(sizeof(pending_ticks), &scheduler);
+	}
+	pending_ticks = 0;
+	clock_notifier_tid = Task::MAIDENLESS;
+}
+
+/**
+ * Reads the rx fifo of a channel empty into the ring its receive server registered, a full ring counts what it drops.
+ * The notifier is only woken when the ring was empty before, otherwise the server is still draining it anyway.
+ */
+void Kernel::drain_rx(int channel, uint64_t event_time) {
+	if ((channel == TERMINAL_UART_CHANNEL) ? uart_0_rx_ring == nullptr : uart_1_rx_ring == nullptr) {
+		// nowhere to put them, leave them in the fifo until a ring is registered
+		enable_receive_interrupt[channel] = false;
+		interrupt_control(channel);
+		return;
+	}
+	bool was_empty = (channel == TERMINAL_UART_CHANNEL) ? uart_0_rx_ring->empty() : uart_1_rx_ring->empty();
+	char c;
+	while (uart_getc_non_blocking(DEFAULT_SPI_CHANNEL, channel, &c)) {
+		if (channel == TERMINAL_UART_CHANNEL) {
+			uart_0_rx_ring->push(c);
+		} else {
+			uart_1_rx_ring->push(UART::TimedByte { c, event_time });
+		}
+	}
+	bool is_empty = (channel == TERMINAL_UART_CHANNEL) ? uart_0_rx_ring->empty() : uart_1_rx_ring->empty();
+	if (was_empty && !is_empty) {
+		rx_signal[channel] = true;
+		wake_rx(channel);
+	}
+}
+
+// a change the notifier missed while it was busy wakes it as soon as it waits again
+void Kernel::wake_rx(int channel) {
+	int& tid = (channel == TERMINAL_UART_CHANNEL) ? uart_0_receive_tid : uart_1_receive_tid;
+	if (tid == Task::MAIDENLESS || !rx_signal[channel]) {
+		return;
+	}
+	rx_signal[channel] = false;
+	tasks[tid]->to_ready(0x0, &scheduler);
+	tid = Task::MAIDENLESS;
+}
+
+void Kernel::handle_register_rx_ring() {
+	int channel = active_request->x1;
+	if (channel == TERMINAL_UART_CHANNEL) {
+		uart_0_rx_ring = (UART::Uart0RxRing*)active_request->x2;
+	} else {
+		uart_1_rx_ring = (UART::Uart1RxRing*)active_request->x2;
+	}
+	// rx stays on from here, whatever is in the fifo already goes in now
+	bool registered = active_request->x2 != 0;
+	enable_receive_interrupt[channel] = registered;
+	interrupt_control(channel);
+	if (registered) {
+		drain_rx(channel, Clock::system_time());
+	}
+	tasks[active_task]->to_ready(0x0, &scheduler);
+}
+
+/**
+ * A notifier that waited with a buffer gets the time of the interrupt (us, uint64_t) written into it,
+ * and the AwaitEventWithBuffer returns its size. A plain AwaitEvent still returns 0.
+ */
+void Kernel::wake_with_time(int tid, uint64_t event_time) {
+	char* buffer = tasks[tid]->get_event_buffer();
+	if (buffer == nullptr) {
+		tasks[tid]->to_ready(0x0, &scheduler);
+	} else {
+		memcpy(buffer, &event_time, sizeof(event_time));
+		tasks[tid]->to_ready(sizeof(event_time), &scheduler);
+	}
+}
+
+/**
+ * Wakes every deadline waiter that is due with the time it was woken at, and arms C3 for the earliest of the rest.
+ * A deadline that passes while C3 is being set is caught by reading the time again afterwards.
+ */
+void Kernel::arm_deadline() {
+	while (!deadline_waiters.empty()) {
+		uint64_t now = Clock::system_time();
+		for (auto it = deadline_waiters.begin(); it != deadline_waiters.end();) {
+			if (it->due <= now) {
+				wake_with_time(it->tid, now);
+				it = deadline_waiters.erase(it);
+			} else {
+				++it;
+			}
+		}
+		if (deadline_waiters.empty()) {
+			break;
+		}
+		uint64_t earliest = deadline_waiters.front().due;
+		for (const DeadlineWaiter& waiter : deadline_waiters) {
+			earliest = (waiter.due < earliest) ? waiter.due : earliest;
+		}
+		Clock::set_deadline(earliest);
+		if (Clock::system_time() < earliest) {
+			break;
+		}
+	}
+}
+
+void Kernel::handle_await_event_with_buffer(int eventId, char* buffer, int len) {
 	switch (eventId) {
-	case UART::InterruptEvents::UART_0_RX_TIMEOUT: {
-		uart_0_receive_tid = active_task;
-		tasks[active_task]->to_event_block_with_buffer(buffer);
+	case Clock::TIMER_INTERRUPT_ID: {
+		// the buffer gets the ticks (uint32_t) since the last wait
+		if (len < (int)sizeof(uint32_t)) {
+			kcrash("Timer buffer too short from %d\r\n", active_task);
+		}
+		clock_notifier_tid = active_task;
+		tasks[active_task]->to_event_block_with_buffer(buffer, len);
+		deliver_ticks();
+		break;
+	}
+	case Clock::DEADLINE_INTERRUPT_ID: {
+		// the buffer holds the system time (us) to wake up at, and gets the time it woke up at
+		if (deadline_waiters.full() || len < (int)sizeof(uint64_t)) {
+			kcrash("Too many deadline waiters, or buffer too short from %d\r\n", active_task);
+		}
+		uint64_t due;
+		memcpy(&due, buffer, sizeof(due));
+		deadline_waiters.push_back(DeadlineWaiter { active_task, due });
+		tasks[active_task]->to_event_block_with_buffer(buffer, len);
+		arm_deadline();
+		break;
+	}
+	case UART::InterruptEvents::UART_1_SENSOR_FRAME: {
+		// the buffer holds a SensorFrame, a frame that completed before we got here goes out right away
+		if (len < (int)sizeof(UART::SensorFrame)) {
+			kcrash("Sensor frame buffer too short from %d\r\n", active_task);
+		}
+		uart_1_frame.waiter = active_task;
+		tasks[active_task]->to_event_block_with_buffer(buffer, len);
+		deliver_sensor_frame();
 		break;
 	}
 	default:
@@ -628,6 +843,100 @@ void Kernel::handle_receive_interrupt() {
 	tasks[active_task]->to_ready(0x0, &scheduler);
 }
 
+/**
+ * The uart 1 transmit notifier hands over a chunk and stays blocked until it is out. Each byte needs both the CTS rise
+ * after the previous one and the THR to have taken it, the MSR and TX interrupts set those, and whichever comes last
+ * writes the next byte. The notifier wakes on the TX interrupt after the last byte, with the time the first byte went
+ * into the THR and that interrupt.
+ */
+void Kernel::handle_uart_transmit() {
+	Uart1Transmit& t = uart_1_transmit;
+	const char* s = (const char*)active_request->x1;
+	int len = active_request->x2;
+	if (t.waiter != Task::MAIDENLESS || len <= 0 || len > UART::TRANSMIT_CHUNK_SIZE) {
+		kcrash("Bad uart 1 transmit from %d, len %d, waiter %d\r\n", active_task, len, t.waiter);
+	}
+	memcpy(t.buffer, s, len);
+	t.len = len;
+	t.pos = 0;
+	t.waiter = active_task;
+	t.done = (UART::TransmitDone*)active_request->x3;
+	tasks[active_task]->to_event_block();
+	uart_1_transmit_step(Clock::system_time());
+}
+
+void Kernel::uart_1_transmit_step(uint64_t now) {
+	Uart1Transmit& t = uart_1_transmit;
+#ifdef SIMULATED_UART_1
+	t.cts = true;
+#endif
+	if (t.waiter == Task::MAIDENLESS || t.pos == t.len || !t.cts || !t.thr_empty) {
+		return;
+	}
+	// chunks never mix messages and the poll goes out by itself, a 0x85 inside a longer command is only its argument
+	if (t.len == 1 && t.buffer[0] == UART::SENSOR_FRAME_REQUEST && uart_1_frame.enabled) {
+		// a new poll, whatever is left in the fifo belongs to no frame
+		char stale;
+		while (uart_getc_non_blocking(DEFAULT_SPI_CHANNEL, TRAIN_UART_CHANNEL, &stale)) {
+		}
+		uart_1_frame.expecting = true;
+		uart_1_frame.len = 0;
+		enable_receive_interrupt[TRAIN_UART_CHANNEL] = true;
+	}
+	uart_put(DEFAULT_SPI_CHANNEL, TRAIN_UART_CHANNEL, UART_THR, t.buffer[t.pos]);
+	if (t.pos == 0) {
+		t.done->first_at = now;
+	}
+	t.pos += 1;
+	t.cts = false;
+	t.thr_empty = false;
+	enable_transmit_interrupt[TRAIN_UART_CHANNEL] = true;
+	interrupt_control(TRAIN_UART_CHANNEL);
+}
+
+/**
+ * Sensor frames: while the mode is on, every poll request the kernel writes on its own starts a frame, the rx
+ * interrupts fill it with their stamps, and the UART_1_SENSOR_FRAME waiter is woken once with the whole reply instead
+ * of once per byte.
+ */
+void Kernel::handle_sensor_frame_mode() {
+	uart_1_frame.enabled = active_request->x1;
+	if (!uart_1_frame.enabled && uart_1_frame.expecting) {
+		uart_1_frame.expecting = false;
+		enable_receive_interrupt[TRAIN_UART_CHANNEL] = uart_1_rx_ring != nullptr;
+		interrupt_control(TRAIN_UART_CHANNEL);
+	}
+	tasks[active_task]->to_ready(0x0, &scheduler);
+}
+
+void Kernel::uart_1_frame_receive(uint64_t event_time) {
+	Uart1Frame& f = uart_1_frame;
+	char c;
+	while (f.len < UART::SENSOR_FRAME_LEN && uart_getc_non_blocking(DEFAULT_SPI_CHANNEL, TRAIN_UART_CHANNEL, &c)) {
+		f.frame.bytes[f.len] = c;
+		f.frame.byte_at[f.len] = event_time;
+		f.len += 1;
+	}
+	if (f.len == UART::SENSOR_FRAME_LEN) {
+		// rx stays on if the receive server has a ring, anything after the frame is its
+		f.expecting = false;
+		enable_receive_interrupt[TRAIN_UART_CHANNEL] = uart_1_rx_ring != nullptr;
+		interrupt_control(TRAIN_UART_CHANNEL);
+		deliver_sensor_frame();
+	}
+}
+
+void Kernel::deliver_sensor_frame() {
+	Uart1Frame& f = uart_1_frame;
+	if (f.waiter == Task::MAIDENLESS || f.expecting || f.len != UART::SENSOR_FRAME_LEN) {
+		return;
+	}
+	memcpy(tasks[f.waiter]->get_event_buffer(), &f.frame, sizeof(UART::SensorFrame));
+	tasks[f.waiter]->to_ready(sizeof(UART::SensorFrame), &scheduler);
+	f.waiter = Task::MAIDENLESS;
+	f.len = 0;
+}
+
 void Kernel::handle_idle_stats() {
 	uint64_t* idle = reinterpret_cast<uint64_t*>(active_request->x1);
 	uint64_t* total = reinterpret_cast<uint64_t*>(active_request->x2);
@@ -8,6 +8,7 @@
 #include "context_switch.h"
 #include "descriptor.h"
 #include "etl/circular_buffer.h"
+#include "etl/vector.h"
 #include "interrupt_handler.h"
 #include "k1/user_tasks_k1.h"
 #include "k2/user_tasks_k2.h"
@@ -141,17 +142,31 @@ int IdleStats(uint64_t* idle_time, uint64_t* total_time);
 namespace Interrupt
 {
 int AwaitEvent(int eventid);
-int AwaitEventWithBuffer(int eventId, char* buffer);
+int AwaitEventWithBuffer(int eventId, char* buffer, int len);
 }
 
 namespace UART
 {
+struct EgressReport;
+struct DeadlineHistogram;
 int UartWriteRegister(int channel, char reg, char data);
 int UartReadRegister(int channel, char reg);
 int Putc(int tid, int uart, char ch);
-int Puts(int tid, int uart, const char* s, uint64_t len);
-int PutsNullTerm(int tid, int uart, const char* s, uint64_t len);
+int Puts(int tid, int uart, const char* s, uint64_t len, OutputLane lane = LANE_UI);
+int PutsNullTerm(int tid, int uart, const char* s, uint64_t len, OutputLane lane = LANE_UI);
 int Getc(int tid, int uart);
+int GetcTimed(int tid, int uart, uint64_t* at); // same as Getc, at is when the byte came in (us)
+// uart 1, a nonzero due holds the message until that system time (us), then it goes out in front of everything queued
+int PutsTagged(int tid, int uart, const char* s, uint64_t len, uint32_t tag, uint64_t due = 0);
+int AwaitEgress(int tid, EgressReport* report); // uart 1, blocks until a tagged Puts has left the THR
+int GetDeadlineHistogram(int tid, DeadlineHistogram* out);
+// uart 1 transmit notifier only, blocks until the kernel sent the len (at most TRANSMIT_CHUNK_SIZE) bytes
+int Transmit(const char* s, int len, TransmitDone* done);
+// uart 1, while on the reply to a poll request goes to UART_1_SENSOR_FRAME instead of the receive server
+int SensorFrameMode(bool enable);
+// ring is a Uart0RxRing or Uart1RxRing in the caller's memory, rx stays on and every byte goes into it, the rx event
+// (UART_0_RX_TIMEOUT, UART_1_RX_INTERRUPT) then only wakes up when the ring goes from empty to not empty
+int RegisterRxRing(int channel, void* ring);
 int TransInterrupt(int channel, bool enable);
 int ReceiveInterrupt(int channel, bool enable);
 int UartReadAll(int channel, char* buffer);
@@ -191,10 +206,19 @@ public:
 		RECEIVE_INTERRUPT = 21,
 		IDLE_STATS = 22,
 		MY_PRIORITY = 23,
+		UART_TRANSMIT = 24,
+		SENSOR_FRAME_MODE = 25,
+		RX_RING = 26,
 	};
 
 	enum KernelEntryCode { SYSCALL = 0, INTERRUPT = 1 };
-	enum InterruptCode { NA = 0, TIMER = Clock::TIMER_INTERRUPT_ID, UART = UART::UART_INTERRUPT_ID, CLEAR = 1023 };
+	enum InterruptCode {
+		NA = 0,
+		TIMER = Clock::TIMER_INTERRUPT_ID,
+		DEADLINE = Clock::DEADLINE_INTERRUPT_ID,
+		UART = UART::UART_INTERRUPT_ID,
+		CLEAR = 1023
+	};
 
 	Kernel();
 	~Kernel();
@@ -258,11 +282,44 @@ private:
 	int uart_0_receive_tid = Task::MAIDENLESS;	// always 1 agent for receiving
 	int uart_0_transmit_tid = Task::MAIDENLESS; // always 1 agent for transmitting
 
-	int uart_1_receive_tid = Task::MAIDENLESS;		   // always 1 agent for receiving
-	int uart_1_receive_timeout_tid = Task::MAIDENLESS; // always 1 agent for transmitting
+	int uart_1_receive_tid = Task::MAIDENLESS; // always 1 agent for receiving, woken by either rx interrupt
+
+	// timer interrupts the clock notifier missed, see deliver_ticks
+	uint32_t pending_ticks = 0;
+
+	// registered by the receive servers, rx_signal is an empty to not empty change the notifier hasn't woken up for
+	UART::Uart0RxRing* uart_0_rx_ring = nullptr;
+	UART::Uart1RxRing* uart_1_rx_ring = nullptr;
+	bool rx_signal[2] = { false, false };
+
+	// uart 1 transmit, a byte goes out once the Marklin raised CTS and the THR took the last one
+	struct Uart1Transmit {
+		char buffer[UART::TRANSMIT_CHUNK_SIZE];
+		int len = 0;
+		int pos = 0;
+		bool cts = true;
+		bool thr_empty = true;
+		int waiter = Task::MAIDENLESS; // always 1 agent for transmitting
+		UART::TransmitDone* done = nullptr;
+	};
+	Uart1Transmit uart_1_transmit;
+
+	// uart 1 sensor frame, collected from when the poll request goes out until it has all its bytes
+	struct Uart1Frame {
+		bool enabled = false; // SensorFrameMode, the receive server doesn't get the bytes of a poll
+		bool expecting = false;
+		int len = 0;
+		UART::SensorFrame frame;
+		int waiter = Task::MAIDENLESS;
+	};
+	Uart1Frame uart_1_frame;
 
-	int uart_1_transmit_tid = Task::MAIDENLESS;
-	int uart_1_msr_tid = Task::MAIDENLESS;
+	// tasks waiting on a system time, C3 is armed for the earliest
+	struct DeadlineWaiter {
+		int tid;
+		uint64_t due;
+	};
+	etl::vector<DeadlineWaiter, Clock::DEADLINE_WAITERS> deadline_waiters;
 
 	bool enable_transmit_interrupt[2] = { false, false };
 	bool enable_receive_interrupt[2] = { false, false };
@@ -275,12 +332,23 @@ private:
 	void handle_receive();
 	void handle_reply();
 	void handle_await_event(int eventId);
-	void handle_await_event_with_buffer(int eventId, char* buffer);
+	void handle_await_event_with_buffer(int eventId, char* buffer, int len);
+	void deliver_ticks();
+	void drain_rx(int channel, uint64_t event_time);
+	void wake_rx(int channel);
+	void handle_register_rx_ring();
+	void wake_with_time(int tid, uint64_t event_time);
+	void arm_deadline();
 	void handle_write_register();
 	void handle_read_register();
 	void handle_read_all();
 	void handle_transmit_interrupt();
 	void handle_receive_interrupt();
+	void handle_uart_transmit();
+	void handle_sensor_frame_mode();
+	void uart_1_transmit_step(uint64_t now);
+	void uart_1_frame_receive(uint64_t event_time);
+	void deliver_sensor_frame();
 	void handle_idle_stats();
 	void interrupt_control(int channel);
 };
@@ -312,7 +380,7 @@ template <typename... Args>
 void debug_print(int uart_tid, const char* msg, Args... args) {
 	char buf[300];
 	int len = snprintf(buf, 300, msg, args...);
-	UART::Puts(uart_tid, 0, buf, len);
+	UART::Puts(uart_tid, 0, buf, len, UART::LANE_DEBUG);
 }
 
 // template <typename... Args>
@@ -33,7 +33,18 @@ void Dijkstra::dijkstra(const int source, const bool enable_reverse, const bool
 	dijkstra(source, empty, enable_reverse, use_reservations);
 }
 
-void Dijkstra::dijkstra_update(const int curr,
+template <typename Q>
+void Dijkstra::push(Q& q, const int v, const int goal) {
+	int h = estimate(v, goal);
+	if (h != INT_MAX) {
+		q.emplace(cost[v] + h, v);
+	}
+}
+
+template <typename Q>
+void Dijkstra::dijkstra_update(Q& q,
+							   const int curr,
+							   const int goal,
 							   etl::unordered_set<int, TRACK_MAX>& banned_node,
 							   const bool enable_reverse,
 							   const bool use_reservations) {
@@ -57,7 +68,7 @@ void Dijkstra::dijkstra_update(const int curr,
 		cost[v] = cost[curr] + cw;
 		dist[v] = dist[curr] + w;
 		prev[v] = curr;
-		pq.emplace(cost[v], v);
+		push(q, v, goal);
 	}
 
 	if (track[curr].type == NODE_BRANCH) {
@@ -79,7 +90,7 @@ void Dijkstra::dijkstra_update(const int curr,
 			cost[v] = cost[curr] + cw;
 			dist[v] = dist[curr] + w;
 			prev[v] = curr;
-			pq.emplace(cost[v], v);
+			push(q, v, goal);
 		}
 	}
 
@@ -96,18 +107,21 @@ void Dijkstra::dijkstra_update(const int curr,
 			cost[v] = cost[curr] + w;
 			dist[v] = dist[curr] + 2 * rdist;
 			prev[v] = curr;
-			pq.emplace(cost[v], v);
+			push(q, v, goal);
 		}
 	}
 }
 
-Dijkstra::Dijkstra(track_node* track, bool weight_brms)
+Dijkstra::Dijkstra(track_node* track, bool weight_brms, SearchQueue queue, bool goal_directed)
 	: track(track)
-	, weight_brms(weight_brms) {
+	, weight_brms(weight_brms)
+	, queue(queue)
+	, goal_directed(goal_directed) {
 
 	for (int i = 0; i < NUM_BANNED_SENSORS; i++) {
 		banned_sensors.insert(BANNED_SENSORS[i]);
 	}
+	build_landmarks();
 }
 
 Dijkstra::~Dijkstra() { }
@@ -116,26 +130,260 @@ void Routing::Dijkstra::dijkstra(const int source,
 								 etl::unordered_set<int, TRACK_MAX>& banned_node,
 								 const bool enable_reverse,
 								 const bool use_reservations) {
+	astar(source, NO_GOAL, banned_node, enable_reverse, use_reservations);
+}
+
+void Dijkstra::astar(const int source,
+					 const int goal,
+					 etl::unordered_set<int, TRACK_MAX>& banned_node,
+					 const bool enable_reverse,
+					 const bool use_reservations) {
 	for (int i = 0; i < TRACK_MAX; i++) {
-		for (int j = 0; j < TRACK_MAX; j++) {
-			cost[j] = INT_MAX;
-			dist[j] = INT_MAX;
-			prev[j] = NO_PREV;
-		}
+		cost[i] = INT_MAX;
+		dist[i] = INT_MAX;
+		prev[i] = NO_PREV;
+		estimates[i] = NO_ESTIMATE;
 	}
 
 	cost[source] = 0;
 	dist[source] = 0;
-	pq.emplace(0, source);
-	while (!pq.empty()) {
-		etl::pair<int, int> p = pq.top();
-		pq.pop();
+	int target = goal_directed ? goal : NO_GOAL;
+	if (queue == SearchQueue::RADIX_HEAP) {
+		settle_all(radix, source, target, banned_node, enable_reverse, use_reservations);
+	} else {
+		settle_all(pq, source, target, banned_node, enable_reverse, use_reservations);
+	}
+}
+
+template <typename Q>
+void Dijkstra::settle_all(Q& q,
+						  const int source,
+						  const int goal,
+						  etl::unordered_set<int, TRACK_MAX>& banned_node,
+						  const bool enable_reverse,
+						  const bool use_reservations) {
+	push(q, source, goal);
+	while (!q.empty()) {
+		etl::pair<int, int> p = q.top();
+		q.pop();
 
 		int u = p.second;
+		if (p.first > cost[u] + estimates[u]) {
+			continue; // pushed again since at a lower cost, already expanded
+		}
+		if (u == goal) {
+			q.clear();
+			return;
+		}
 		if (banned_node.count(u) == 0) {
-			dijkstra_update(u, banned_node, enable_reverse, use_reservations);
+			expanded++;
+			dijkstra_update(q, u, goal, banned_node, enable_reverse, use_reservations);
+		}
+	}
+}
+
+// ALT bounds: by the triangle inequality d(v, goal) >= d(v, l) - d(goal, l) and d(v, goal) >= d(l, goal) - d(l, v).
+// Bans and reservations only make the real costs bigger, so the base costs stay lower bounds for every search. A
+// landmark that one end reaches and the other does not proves v cannot reach goal at all, and v is never queued.
+int Dijkstra::estimate(const int v, const int goal) {
+	if (estimates[v] != NO_ESTIMATE) {
+		return estimates[v];
+	}
+
+	int best = 0;
+	for (int l = 0; goal != NO_GOAL && l < NUM_LANDMARKS; l++) {
+		if (to_landmark[l][goal] != INT_MAX) {
+			if (to_landmark[l][v] == INT_MAX) {
+				best = INT_MAX;
+				break;
+			}
+			best = etl::max(best, to_landmark[l][v] - to_landmark[l][goal]);
+		}
+		if (from_landmark[l][v] != INT_MAX) {
+			if (from_landmark[l][goal] == INT_MAX) {
+				best = INT_MAX;
+				break;
+			}
+			best = etl::max(best, from_landmark[l][goal] - from_landmark[l][v]);
 		}
 	}
+	estimates[v] = best;
+	return best;
+}
+
+// Same edges and weights as dijkstra_update with reversing allowed and no reservations
+int Dijkstra::base_edges(const int u, int* to, int* cw) const {
+	if (track[u].type == NODE_NONE || track[u].type == NODE_EXIT) {
+		return 0;
+	}
+
+	int n = 0;
+	for (int dir = DIR_AHEAD; dir <= DIR_CURVED; dir++) {
+		if (dir == DIR_CURVED && track[u].type != NODE_BRANCH) {
+			break;
+		}
+		const track_edge& edge = track[u].edge[dir];
+		if (edge.broken) {
+			continue;
+		}
+		int v = edge.dest - track;
+		int c = edge.dist;
+		if (weight_brms && (track[v].type == NODE_BRANCH || track[v].type == NODE_MERGE)) {
+			c = (dir == DIR_AHEAD) ? c * BRANCH_MULTIPLIER : c * 15 / 10;
+		}
+		to[n] = v;
+		cw[n] = c;
+		n++;
+	}
+
+	if (track[u].type == NODE_MERGE) {
+		to[n] = track[u].reverse - track;
+		cw[n] = track[u].rev_cost;
+		n++;
+	}
+	return n;
+}
+
+/**
+ * Landmarks are picked farthest first: each next one is the node whose round trip to the closest landmark so far is
+ * longest, so they end up spread around the edges of the track where the bounds they give are tightest.
+ */
+void Dijkstra::build_landmarks() {
+	const int MAX_DEGREE = 4;
+	int out_n[TRACK_MAX], out_to[TRACK_MAX][MAX_DEGREE], out_cw[TRACK_MAX][MAX_DEGREE];
+	int in_n[TRACK_MAX], in_from[TRACK_MAX][MAX_DEGREE], in_cw[TRACK_MAX][MAX_DEGREE];
+	for (int i = 0; i < TRACK_MAX; i++) {
+		in_n[i] = 0;
+	}
+	for (int u = 0; u < TRACK_MAX; u++) {
+		out_n[u] = base_edges(u, out_to[u], out_cw[u]);
+		for (int e = 0; e < out_n[u]; e++) {
+			int v = out_to[u][e];
+			in_from[v][in_n[v]] = u;
+			in_cw[v][in_n[v]] = out_cw[u][e];
+			in_n[v]++;
+		}
+	}
+
+	auto spread = [&](int landmark, int* out, int* n, int (*next)[MAX_DEGREE], int (*cw)[MAX_DEGREE]) {
+		for (int i = 0; i < TRACK_MAX; i++) {
+			out[i] = INT_MAX;
+		}
+		out[landmark] = 0;
+		radix.emplace(0, landmark);
+		while (!radix.empty()) {
+			etl::pair<int, int> p = radix.top();
+			radix.pop();
+			int u = p.second;
+			if (p.first > out[u]) {
+				continue;
+			}
+			for (int e = 0; e < n[u]; e++) {
+				int v = next[u][e];
+				if (out[v] > out[u] + cw[u][e]) {
+					out[v] = out[u] + cw[u][e];
+					radix.emplace(out[v], v);
+				}
+			}
+		}
+	};
+
+	auto candidate = [&](int v) {
+		return track[v].type == NODE_SENSOR || track[v].type == NODE_BRANCH || track[v].type == NODE_MERGE;
+	};
+
+	// seed from the node farthest from an arbitrary start
+	int landmark = 0;
+	spread(0, from_landmark[0], out_n, out_to, out_cw);
+	for (int v = 0; v < TRACK_MAX; v++) {
+		if (candidate(v) && from_landmark[0][v] != INT_MAX && from_landmark[0][v] > from_landmark[0][landmark]) {
+			landmark = v;
+		}
+	}
+
+	for (int l = 0; l < NUM_LANDMARKS; l++) {
+		spread(landmark, from_landmark[l], out_n, out_to, out_cw);
+		spread(landmark, to_landmark[l], in_n, in_from, in_cw);
+
+		long long farthest = -1;
+		for (int v = 0; v < TRACK_MAX; v++) {
+			if (!candidate(v)) {
+				continue;
+			}
+			long long closest = LLONG_MAX;
+			for (int j = 0; j <= l; j++) {
+				long long round_trip = (long long)from_landmark[j][v] + to_landmark[j][v];
+				closest = etl::min(closest, round_trip);
+			}
+			if (closest > farthest) {
+				farthest = closest;
+				landmark = v;
+			}
+		}
+	}
+}
+
+void Dijkstra::build_table(PathTable* t) {
+	table = nullptr;
+	for (int rev = 0; rev < 2; rev++) {
+		for (int source = 0; source < TRACK_MAX; source++) {
+			if (track[source].type == NODE_NONE) {
+				// track b leaves the tail of the array unused, nothing can reach these and they reach nothing
+				for (int i = 0; i < TRACK_MAX; i++) {
+					t->dist[rev][source][i] = INT_MAX;
+					t->cost[rev][source][i] = INT_MAX;
+					t->prev[rev][source][i] = NO_PREV;
+				}
+				continue;
+			}
+			dijkstra(source, rev == 1);
+			for (int i = 0; i < TRACK_MAX; i++) {
+				t->dist[rev][source][i] = dist[i];
+				t->cost[rev][source][i] = cost[i];
+				t->prev[rev][source][i] = prev[i];
+			}
+		}
+	}
+	table = t;
+}
+
+bool Dijkstra::load_row(const int source, const bool enable_reverse) {
+	if (table == nullptr) {
+		return false;
+	}
+
+	int rev = enable_reverse ? 1 : 0;
+	for (int i = 0; i < TRACK_MAX; i++) {
+		dist[i] = table->dist[rev][source][i];
+		cost[i] = table->cost[rev][source][i];
+		prev[i] = table->prev[rev][source][i];
+	}
+	return true;
+}
+
+// Bans only take nodes away and reservations only make nodes dearer, so a tree path that touches neither is still the
+// cheapest one. Anything else has to be searched again.
+bool Dijkstra::path_clear(const int source, const int dest, etl::unordered_set<int, TRACK_MAX>& banned_node, const bool use_reservations) const {
+	for (int curr = dest; curr != NO_PREV; curr = prev[curr]) {
+		if (banned_node.count(curr) != 0) {
+			return false;
+		}
+		if (use_reservations && curr != source && track[curr].reserved_by != RESERVED_BY_NO_ONE) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void Dijkstra::search(const int source,
+					  const int dest,
+					  etl::unordered_set<int, TRACK_MAX>& banned_node,
+					  const bool enable_reverse,
+					  const bool use_reservations) {
+	if (load_row(source, enable_reverse) && path_clear(source, dest, banned_node, use_reservations)) {
+		return;
+	}
+	astar(source, dest, banned_node, enable_reverse, use_reservations);
 }
 
 int Dijkstra::get_prev(const int dest) const {
@@ -150,13 +398,23 @@ int Dijkstra::get_cost(const int dest) const {
 	return cost[dest];
 }
 
+int Dijkstra::get_expanded() const {
+	return expanded;
+}
+
+void Dijkstra::reset_expanded() {
+	expanded = 0;
+}
+
 bool Dijkstra::is_path_possible(const int source, const int dest) {
-	dijkstra(source);
+	etl::unordered_set<int, TRACK_MAX> empty;
+	search(source, dest, empty);
 	return prev[dest] != NO_PREV;
 }
 
 bool Dijkstra::path(etl::list<int, PATH_LIMIT>* q, const int source, const int dest, const bool enable_reverse) {
-	dijkstra(source, enable_reverse);
+	etl::unordered_set<int, TRACK_MAX> empty;
+	search(source, dest, empty, enable_reverse);
 	int curr = dest;
 	if (prev[curr] == NO_PREV) {
 		return false; // nothing you can do, dead end
@@ -182,7 +440,7 @@ bool Dijkstra::path_with_ban(etl::list<int, PATH_LIMIT>* q,
 							 const int dest,
 							 const bool enable_reverse,
 							 const bool using_weight) {
-	dijkstra(source, banned_node, enable_reverse, using_weight);
+	search(source, dest, banned_node, enable_reverse, using_weight);
 	int curr = dest;
 	if (prev[curr] == NO_PREV) {
 		return false; // nothing you can do, dead end
@@ -204,7 +462,8 @@ bool Dijkstra::path_with_ban(etl::list<int, PATH_LIMIT>* q,
 
 bool Dijkstra::path(int* q, const int source, const int dest) {
 	/* q is an int array with size at least PATH_LIMIT */
-	dijkstra(source);
+	etl::unordered_set<int, TRACK_MAX> empty;
+	search(source, dest, empty);
 	int curr = dest;
 	while (curr != NO_PREV) {
 		stack.push(curr);
@@ -226,26 +485,44 @@ bool Dijkstra::weighted_path(WeightedPath* q, const int source, const int dest)
 }
 
 bool Dijkstra::weighted_path_with_ban(WeightedPath* q, etl::unordered_set<int, TRACK_MAX>& banned_node, const int source, const int dest) {
+	if (load_row(source, true) && weighted_walk(q, banned_node, source, dest, true)) {
+		return true;
+	}
+	astar(source, dest, banned_node, true, true);
+	if (goal_directed && reverse_end(dest) != NO_REVERSE) {
+		// a reverse parks at the sensor past the merge, which the search toward dest had no reason to settle
+		dijkstra(source, banned_node, true, true);
+	}
+	return weighted_walk(q, banned_node, source, dest, false);
+}
+
+// The merge the path to dest first turns around at, or NO_REVERSE
+int Dijkstra::reverse_end(const int dest) const {
+	int end = NO_REVERSE;
+	for (int curr = dest; curr != NO_PREV; curr = prev[curr]) {
+		if (prev[curr] == track[curr].reverse - track) {
+			end = track[curr].reverse - track;
+		}
+	}
+	return end;
+}
+
+bool Dijkstra::weighted_walk(WeightedPath* q, etl::unordered_set<int, TRACK_MAX>& banned_node, const int source, const int dest, const bool from_table) {
 	q->has_reverse = false;
 	q->rev_offset = 0;
-	dijkstra(source, banned_node, true, true);
 	int curr = dest;
 	if (prev[curr] == NO_PREV) {
 		return false; // nothing you can do, dead end
 	}
 
-	// First, check if there are any reverses in the path
-	int end = dest;
-	while (curr != NO_PREV) {
-		if (prev[curr] == track[curr].reverse - track) {
-			// Reverse detected
-			q->has_reverse = true;
-			end = track[curr].reverse - track;
-		}
-
-		curr = prev[curr];
+	if (from_table && !path_clear(source, dest, banned_node, true)) {
+		return false;
 	}
 
+	// First, check if there are any reverses in the path
+	int end = reverse_end(dest);
+	q->has_reverse = end != NO_REVERSE;
+
 	// So now we build the path
 	if (!q->has_reverse) {
 		// No reverse detected
@@ -259,6 +536,10 @@ bool Dijkstra::weighted_path_with_ban(WeightedPath* q, etl::unordered_set<int, T
 			return false;
 		}
 
+		if (from_table && !path_clear(source, actual_end, banned_node, true)) {
+			return false;
+		}
+
 		// Also modify the offset
 		q->rev_offset = track[end].rev_offset;
 
@@ -301,7 +582,9 @@ bool Dijkstra::weighted_path_with_ban(int wpath[],
 }
 
 void Dijkstra::determine_range_sensors(const int source) {
-	dijkstra(source, true);
+	if (!load_row(source, true)) {
+		dijkstra(source, true);
+	}
 	sensors_within_range.clear();
 	for (int i = 0; i < TRACK_NUM_SENSORS; i++) {
 		if (dist[i] >= MIN_RANDOM_DEST_DIST && dist[i] <= MAX_RANDOM_DEST_DIST) {
@@ -310,7 +593,9 @@ void Dijkstra::determine_range_sensors(const int source) {
 	}
 
 	int rev = track[source].reverse - track;
-	dijkstra(rev, true);
+	if (!load_row(rev, true)) {
+		dijkstra(rev, true);
+	}
 	for (int i = 0; i < TRACK_NUM_SENSORS; i++) {
 		if (dist[i] >= MIN_RANDOM_DEST_DIST && dist[i] <= MAX_RANDOM_DEST_DIST) {
 			sensors_within_range.push(i);
@@ -1,13 +1,17 @@
 
 #pragma once
 #include "../etl/circular_buffer.h"
+#include "../etl/functional.h"
 #include "../etl/list.h"
 #include "../etl/priority_queue.h"
 #include "../etl/queue.h"
 #include "../etl/random.h"
 #include "../etl/stack.h"
 #include "../etl/unordered_set.h"
+#include "../etl/vector.h"
+#include "radix_heap.h"
 #include "track_data_new.h"
+#include <stdint.h>
 
 namespace Routing
 {
@@ -23,7 +27,22 @@ const int SHORT_PATH_LIMIT = 128;
 const int NUM_BRANCHES = 22;
 const int MAX_MULTI_PATH = 8;
 const int RESERVED_FLAT_COST = 200;
-typedef etl::priority_queue<etl::pair<int, int>, TRACK_MAX> pq_t;
+// Every node is expanded at most once per cost it is reached at, so a search never pushes more than one entry per edge
+const int SEARCH_QUEUE_SIZE = 4 * TRACK_MAX;
+typedef etl::pair<int, int> queued_t;
+typedef etl::priority_queue<queued_t, SEARCH_QUEUE_SIZE, etl::vector<queued_t, SEARCH_QUEUE_SIZE>, etl::greater<queued_t>> pq_t;
+typedef RadixHeap<SEARCH_QUEUE_SIZE> radix_t;
+
+// Point to point searches are steered by lower bounds to and from a few far apart nodes (ALT), picked per track
+const int NUM_LANDMARKS = 6;
+const int NO_GOAL = -1;
+const int NO_ESTIMATE = -1;
+
+// The radix heap measured no faster than the binary heap on either track (see radixheaptest), it stays selectable
+enum class SearchQueue {
+	BINARY_HEAP,
+	RADIX_HEAP,
+};
 
 const int MIN_RANDOM_DEST_DIST = 750;
 const int MAX_RANDOM_DEST_DIST = 200000;
@@ -32,6 +51,18 @@ const int RNG_SEED = 314159;
 const int BANNED_SENSORS[] = { 38, 40, 55, 37 };
 const int NUM_BANNED_SENSORS = sizeof(BANNED_SENSORS) / sizeof(int);
 
+/**
+ * Shortest path trees from every source, for the graph with no bans and no reservations. Row [reverse][source] holds
+ * exactly what a dijkstra from that source would leave in dist, cost and prev, so a query can load the row and walk prev
+ * without searching. It is too big for the Dijkstra object to carry around by value, the owner keeps it and hands it over
+ * through build_table.
+ */
+struct PathTable {
+	int dist[2][TRACK_MAX][TRACK_MAX];
+	int cost[2][TRACK_MAX][TRACK_MAX];
+	int16_t prev[2][TRACK_MAX][TRACK_MAX];
+};
+
 struct WeightedPath {
 	etl::list<int, PATH_LIMIT> wpath;
 	bool has_reverse = false;
@@ -40,12 +71,15 @@ struct WeightedPath {
 
 class Dijkstra {
 public:
-	Dijkstra(track_node* track, bool weight_brms = false);
+	Dijkstra(track_node* track, bool weight_brms = false, SearchQueue queue = SearchQueue::BINARY_HEAP, bool goal_directed = true);
 	~Dijkstra();
 
 	int get_prev(const int dest) const;
 	int get_dist(const int dest) const;
 	int get_cost(const int dest) const;
+	// Nodes expanded by the searches since the last reset, table lookups expand none
+	int get_expanded() const;
+	void reset_expanded();
 	etl::list<int, SHORT_PATH_LIMIT> path_to_next_sensor(const int src) const;
 	bool path(etl::list<int, PATH_LIMIT>* q, const int source, const int dest, const bool enable_reverse = false);
 	bool path_with_ban(etl::list<int, PATH_LIMIT>* q, etl::unordered_set<int, TRACK_MAX>& banned_node, const int source, const int dest, const bool enable_revers, const bool enable_weight);
@@ -53,6 +87,8 @@ public:
 	bool path(int* q, const int source, const int dest);
 	bool path_with_ban(int* q, etl::unordered_set<int, TRACK_MAX>& banned_node, const int source, const int dest);
 
+	// Point to point queries may stop as soon as dest is settled, after them only the nodes on the returned path are final.
+
 	// Weighted-path: used to calculate a full shortest path to a destination, which keeps track of reversing.
 	// This has a complicated type because I need to have two pieces of extra information:
 	// 1. Whether the path requires reversing
@@ -71,6 +107,10 @@ public:
 								const int dest);
 	bool is_path_possible(const int source, const int dest);
 
+	// Fills table from the current track and answers later queries out of it where the answer is unchanged by bans and
+	// reservations. Must be called again whenever the track data is reinitialized.
+	void build_table(PathTable* table);
+
 	// How many sensors are within a certain distance of a source?
 	int num_sensors_within_dist_range(const int source);
 
@@ -80,10 +120,20 @@ public:
 private:
 	track_node* track;
 	bool weight_brms;
+	SearchQueue queue;
+	bool goal_directed;
+	int expanded = 0;
 	int dist[TRACK_MAX]; // distances from source to each node, indexed by source
 	int cost[TRACK_MAX]; // cost of each node. What is actually used to calculate path lengths
 	int prev[TRACK_MAX]; // previous node in shortest path from source, indexed by source
-	pq_t pq = etl::priority_queue<etl::pair<int, int>, TRACK_MAX>();
+	int estimates[TRACK_MAX]; // lower bound on the cost left to the goal, filled in as nodes are reached
+
+	// Base costs (no bans, no reservations, reversing allowed) from and to each landmark
+	int from_landmark[NUM_LANDMARKS][TRACK_MAX];
+	int to_landmark[NUM_LANDMARKS][TRACK_MAX];
+	PathTable* table = nullptr;
+	pq_t pq = pq_t();
+	radix_t radix = radix_t();
 	etl::stack<int, TRACK_MAX> stack = etl::stack<int, TRACK_MAX>();
 	void dijkstra(const int source, const bool enable_reverse = false, const bool use_reservations = false);
 
@@ -91,7 +141,44 @@ private:
 				  etl::unordered_set<int, TRACK_MAX>& banned_node,
 				  const bool enable_reverse = false,
 				  const bool use_reservations = false);
-	void dijkstra_update(const int curr, etl::unordered_set<int, TRACK_MAX>& banned_node, const bool enable_reverse, const bool use_reservations);
+	// Stops once goal is settled, or runs to completion when goal is NO_GOAL
+	void astar(const int source,
+			   const int goal,
+			   etl::unordered_set<int, TRACK_MAX>& banned_node,
+			   const bool enable_reverse = false,
+			   const bool use_reservations = false);
+	template <typename Q>
+	void settle_all(Q& q,
+					const int source,
+					const int goal,
+					etl::unordered_set<int, TRACK_MAX>& banned_node,
+					const bool enable_reverse,
+					const bool use_reservations);
+	template <typename Q>
+	void dijkstra_update(Q& q,
+						 const int curr,
+						 const int goal,
+						 etl::unordered_set<int, TRACK_MAX>& banned_node,
+						 const bool enable_reverse,
+						 const bool use_reservations);
+	template <typename Q>
+	void push(Q& q, const int v, const int goal);
+	int estimate(const int v, const int goal);
+	int reverse_end(const int dest) const;
+
+	// Landmarks
+	int base_edges(const int u, int* to, int* cw) const;
+	void build_landmarks();
+
+	// Table lookups. A row loaded with load_row is only trusted along the walks that path_clear has checked.
+	bool load_row(const int source, const bool enable_reverse);
+	bool path_clear(const int source, const int dest, etl::unordered_set<int, TRACK_MAX>& banned_node, const bool use_reservations) const;
+	void search(const int source,
+				const int dest,
+				etl::unordered_set<int, TRACK_MAX>& banned_node,
+				const bool enable_reverse = false,
+				const bool use_reservations = false);
+	bool weighted_walk(WeightedPath* q, etl::unordered_set<int, TRACK_MAX>& banned_node, const int source, const int dest, const bool from_table);
 
 	etl::unordered_set<int, TRACK_MAX> banned_sensors = etl::unordered_set<int, TRACK_MAX>();
 
@@ -0,0 +1,144 @@
+#pragma once
+#include "../etl/utility.h"
+#include <stdint.h>
+
+namespace Routing
+{
+
+/**
+ * Monotone min queue for non-negative integer keys, in the shape of the etl priority_queue that dijkstra used to push
+ * (cost, node) pairs into. Keys live in bucket i when their highest bit differing from the last key taken out is bit
+ * i - 1, so a push is O(1) and every entry only ever moves to lower buckets. Keys pushed must not be smaller than the
+ * last key taken out, which holds for a search with non-negative edge costs.
+ */
+template <uint32_t N>
+class RadixHeap {
+	static_assert(N < 32768, "RadixHeap slots are indexed by int16_t");
+
+public:
+	RadixHeap();
+	bool empty() const;
+	uint32_t size() const;
+	// traps if every slot is taken, a search that sized its heap right never gets there
+	void emplace(const int key, const int value);
+	etl::pair<int, int> top();
+	void pop();
+	void clear();
+
+private:
+	static const int BUCKETS = 33;
+	static const int16_t NIL = -1;
+
+	uint32_t keys[N];
+	int values[N];
+	int16_t next[N];
+	int16_t bucket[BUCKETS];
+	int16_t free_slot;
+	uint32_t last;
+	uint32_t count;
+
+	int bucket_of(const uint32_t key) const;
+	void settle();
+};
+
+template <uint32_t N>
+RadixHeap<N>::RadixHeap() {
+	clear();
+}
+
+template <uint32_t N>
+void RadixHeap<N>::clear() {
+	for (int i = 0; i < BUCKETS; i++) {
+		bucket[i] = NIL;
+	}
+	for (uint32_t i = 0; i < N; i++) {
+		next[i] = (i + 1 < N) ? i + 1 : NIL;
+	}
+	free_slot = 0;
+	last = 0;
+	count = 0;
+}
+
+template <uint32_t N>
+bool RadixHeap<N>::empty() const {
+	return count == 0;
+}
+
+template <uint32_t N>
+uint32_t RadixHeap<N>::size() const {
+	return count;
+}
+
+template <uint32_t N>
+int RadixHeap<N>::bucket_of(const uint32_t key) const {
+	return key == last ? 0 : 32 - __builtin_clz(key ^ last);
+}
+
+template <uint32_t N>
+void RadixHeap<N>::emplace(const int key, const int value) {
+	if (free_slot == NIL) {
+		// routing code runs on the host too, so no kernel crash here, the exception handler reports the trap
+		__builtin_trap();
+	}
+	int16_t slot = free_slot;
+	free_slot = next[slot];
+	keys[slot] = key;
+	values[slot] = value;
+	int b = bucket_of(key);
+	next[slot] = bucket[b];
+	bucket[b] = slot;
+	count++;
+}
+
+// Brings the smallest keys down into bucket 0 by redistributing the lowest non-empty bucket around its minimum
+template <uint32_t N>
+void RadixHeap<N>::settle() {
+	if (bucket[0] != NIL) {
+		return;
+	}
+
+	int b = 1;
+	while (bucket[b] == NIL) {
+		b++;
+	}
+
+	uint32_t smallest = keys[bucket[b]];
+	for (int16_t slot = bucket[b]; slot != NIL; slot = next[slot]) {
+		if (keys[slot] < smallest) {
+			smallest = keys[slot];
+		}
+	}
+
+	last = smallest;
+	int16_t slot = bucket[b];
+	bucket[b] = NIL;
+	while (slot != NIL) {
+		int16_t following = next[slot];
+		int nb = bucket_of(keys[slot]);
+		next[slot] = bucket[nb];
+		bucket[nb] = slot;
+		slot = following;
+	}
+}
+
+template <uint32_t N>
+etl::pair<int, int> RadixHeap<N>::top() {
+	settle();
+	return etl::pair<int, int>(keys[bucket[0]], values[bucket[0]]);
+}
+
+template <uint32_t N>
+void RadixHeap<N>::pop() {
+	settle();
+	int16_t slot = bucket[0];
+	bucket[0] = next[slot];
+	next[slot] = free_slot;
+	free_slot = slot;
+	count--;
+	if (count == 0) {
+		// nothing left to stay monotone against, the next search can start from 0 again
+		last = 0;
+	}
+}
+
+}
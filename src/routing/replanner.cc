@@ -0,0 +1,291 @@
+#include "replanner.h"
+#include <climits>
+using namespace Routing;
+
+void Replanner::reset(track_node* t, const int target, etl::unordered_set<int, TRACK_MAX>& banned_node) {
+	// the predecessors only depend on the track, starting over toward another goal keeps them
+	if (track != t) {
+		track = t;
+		build_preds();
+	}
+	goal = target;
+	heap_size = 0;
+	for (int i = 0; i < TRACK_MAX; i++) {
+		g[i] = INT_MAX;
+		rhs[i] = INT_MAX;
+		blocked[i] = false;
+		reserved[i] = track[i].type != NODE_NONE && track[i].reserved_by != RESERVED_BY_NO_ONE;
+		heap_pos[i] = -1;
+	}
+	num_blocked = 0;
+	for (int v : banned_node) {
+		if (track[v].type != NODE_NONE) {
+			blocked[v] = true;
+			num_blocked++;
+		}
+	}
+
+	// already in step with the bans and reservations, the first query searches the whole way from the goal
+	if (!blocked[goal]) {
+		rhs[goal] = 0;
+		heap_push(goal, 0);
+	}
+}
+
+void Replanner::build_preds() {
+	for (int i = 0; i < TRACK_MAX; i++) {
+		num_preds[i] = 0;
+	}
+	for (int u = 0; u < TRACK_MAX; u++) {
+		for (int dir = DIR_AHEAD; dir <= REVERSE_STEP; dir++) {
+			int v = step_to(u, dir);
+			if (v == NO_PREV) {
+				continue;
+			}
+			if (num_preds[v] == MAX_PREDS) {
+				// no track has a node this many steps lead into, losing one would leave costs that never get repaired
+				__builtin_trap();
+			}
+			preds[v][num_preds[v]++] = u;
+		}
+	}
+}
+
+void Replanner::invalidate() {
+	goal = NO_GOAL;
+	track = nullptr;
+}
+
+int Replanner::get_goal() const {
+	return goal;
+}
+
+int Replanner::get_expanded() const {
+	return expanded;
+}
+
+void Replanner::reset_expanded() {
+	expanded = 0;
+}
+
+// Where the step in dir leads from u, or NO_PREV if u has no such step
+int Replanner::step_to(const int u, const int dir) const {
+	node_type type = track[u].type;
+	if (type == NODE_NONE || type == NODE_EXIT) {
+		return NO_PREV;
+	}
+	if (dir == REVERSE_STEP) {
+		return type == NODE_MERGE ? track[u].reverse - track : NO_PREV;
+	}
+	if (dir == DIR_CURVED && type != NODE_BRANCH) {
+		return NO_PREV;
+	}
+	return track[u].edge[dir].dest - track;
+}
+
+// Same weights as dijkstra_update with reversing and reservations on, INT_MAX where the search could not step
+int Replanner::step_cost(const int u, const int dir) const {
+	int v = step_to(u, dir);
+	if (v == NO_PREV || blocked[u] || blocked[v]) {
+		return INT_MAX;
+	}
+	if (dir == REVERSE_STEP) {
+		return track[u].rev_cost;
+	}
+
+	const track_edge& edge = track[u].edge[dir];
+	if (edge.broken) {
+		return INT_MAX;
+	}
+	int cw = edge.dist;
+	if (reserved[v]) {
+		cw = (dir == DIR_AHEAD ? RESERVATION_MULTIPLIER : 2) * cw + RESERVED_FLAT_COST;
+	}
+	return cw;
+}
+
+// Cheapest way from u to the goal through one of its successors, and which step it takes
+int Replanner::best_step(const int u, int* dir) const {
+	int best = INT_MAX;
+	for (int d = DIR_AHEAD; d <= REVERSE_STEP; d++) {
+		int c = step_cost(u, d);
+		if (c == INT_MAX) {
+			continue;
+		}
+		int v = step_to(u, d);
+		if (g[v] != INT_MAX && c + g[v] < best) {
+			best = c + g[v];
+			*dir = d;
+		}
+	}
+	return best;
+}
+
+void Replanner::update_vertex(const int u) {
+	if (u == goal) {
+		rhs[u] = blocked[u] ? INT_MAX : 0;
+	} else {
+		int dir;
+		rhs[u] = best_step(u, &dir);
+	}
+
+	if (heap_pos[u] != -1) {
+		heap_remove(u);
+	}
+	if (g[u] != rhs[u]) {
+		heap_push(u, etl::min(g[u], rhs[u]));
+	}
+}
+
+// Ties with the start's key are settled too: some switches sit 0mm apart, so a node whose cost just went up can share
+// the start's key while the start still leans on it.
+void Replanner::compute(const int start) {
+	while (heap_size > 0 && (heap_key[heap[0]] <= etl::min(g[start], rhs[start]) || g[start] != rhs[start])) {
+		int u = heap_pop();
+		expanded++;
+		if (g[u] > rhs[u]) {
+			g[u] = rhs[u];
+		} else {
+			g[u] = INT_MAX;
+			update_vertex(u);
+		}
+		for (int i = 0; i < num_preds[u]; i++) {
+			update_vertex(preds[u][i]);
+		}
+	}
+}
+
+int Replanner::changes(etl::unordered_set<int, TRACK_MAX>& banned_node) const {
+	int changed = 0;
+	for (int v = 0; v < TRACK_MAX; v++) {
+		if (track[v].type == NODE_NONE) {
+			continue;
+		}
+		bool now_reserved = track[v].reserved_by != RESERVED_BY_NO_ONE;
+		changed += (now_reserved != reserved[v]) ? 1 : 0;
+	}
+
+	// bans are few, so count them from the set rather than looking every node up in it
+	int still_blocked = 0;
+	for (int v : banned_node) {
+		if (track[v].type == NODE_NONE) {
+			continue;
+		}
+		if (blocked[v]) {
+			still_blocked++;
+		} else {
+			changed++;
+		}
+	}
+	return changed + num_blocked - still_blocked;
+}
+
+void Replanner::update(etl::unordered_set<int, TRACK_MAX>& banned_node) {
+	for (int v = 0; v < TRACK_MAX; v++) {
+		if (track[v].type == NODE_NONE) {
+			continue;
+		}
+		bool now_blocked = banned_node.count(v) != 0;
+		bool now_reserved = track[v].reserved_by != RESERVED_BY_NO_ONE;
+		if (now_blocked == blocked[v] && now_reserved == reserved[v]) {
+			continue;
+		}
+
+		// a change at v moves the cost of stepping into v, and of stepping out of it if it is banned
+		num_blocked += (now_blocked ? 1 : 0) - (blocked[v] ? 1 : 0);
+		blocked[v] = now_blocked;
+		reserved[v] = now_reserved;
+		update_vertex(v);
+		for (int i = 0; i < num_preds[v]; i++) {
+			update_vertex(preds[v][i]);
+		}
+	}
+}
+
+int Replanner::cost_from(const int source) {
+	compute(source);
+	return g[source];
+}
+
+bool Replanner::walk(const int source, int* path, int* path_len, int* dist) {
+	if (cost_from(source) == INT_MAX) {
+		return false;
+	}
+
+	int u = source;
+	int n = 0;
+	int d = 0;
+	path[n++] = u;
+	while (u != goal) {
+		int dir = DIR_AHEAD;
+		if (best_step(u, &dir) == INT_MAX || dir == REVERSE_STEP || n == PATH_LIMIT) {
+			return false;
+		}
+		d += track[u].edge[dir].dist;
+		u = step_to(u, dir);
+		path[n++] = u;
+	}
+
+	*path_len = n;
+	*dist = d;
+	return true;
+}
+
+void Replanner::heap_swap(const int i, const int j) {
+	int16_t a = heap[i];
+	heap[i] = heap[j];
+	heap[j] = a;
+	heap_pos[heap[i]] = i;
+	heap_pos[heap[j]] = j;
+}
+
+void Replanner::sift_up(int i) {
+	while (i > 0 && heap_key[heap[(i - 1) / 2]] > heap_key[heap[i]]) {
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+void Replanner::sift_down(int i) {
+	while (true) {
+		int smallest = i;
+		int l = 2 * i + 1;
+		int r = 2 * i + 2;
+		if (l < heap_size && heap_key[heap[l]] < heap_key[heap[smallest]]) {
+			smallest = l;
+		}
+		if (r < heap_size && heap_key[heap[r]] < heap_key[heap[smallest]]) {
+			smallest = r;
+		}
+		if (smallest == i) {
+			return;
+		}
+		heap_swap(i, smallest);
+		i = smallest;
+	}
+}
+
+void Replanner::heap_push(const int u, const int key) {
+	heap_key[u] = key;
+	heap[heap_size] = u;
+	heap_pos[u] = heap_size;
+	heap_size++;
+	sift_up(heap_size - 1);
+}
+
+void Replanner::heap_remove(const int u) {
+	int i = heap_pos[u];
+	heap_size--;
+	if (i != heap_size) {
+		heap_swap(i, heap_size);
+		sift_up(i);
+		sift_down(i);
+	}
+	heap_pos[u] = -1;
+}
+
+int Replanner::heap_pop() {
+	int u = heap[0];
+	heap_remove(u);
+	return u;
+}
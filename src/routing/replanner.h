@@ -0,0 +1,79 @@
+#pragma once
+#include "../etl/unordered_set.h"
+#include "dijkstra.h"
+#include <stdint.h>
+
+namespace Routing
+{
+
+const int REVERSE_STEP = 2; // the step from a merge onto its own reverse, next to DIR_AHEAD and DIR_CURVED
+const int MAX_PREDS = 4;
+// Nodes changed between two reroutes past which repairing the costs takes longer than searching again (see replantest)
+const int REPLAN_CHURN_LIMIT = 2;
+
+/**
+ * Incremental shortest paths toward one goal, kept from one reroute to the next (D* Lite with no heuristic). Costs are
+ * searched backwards from the goal, so the start can be anywhere and move between queries. When nodes become banned,
+ * unbanned, reserved or released, only the nodes whose cost to the goal actually changes are touched again.
+ *
+ * Costs are the ones the track server routes on: reversing allowed, reserved nodes dearer, no branch weights. A banned
+ * node can be neither entered nor left, same as in Dijkstra.
+ */
+class Replanner {
+public:
+	// Drops all costs and starts over toward goal from the current bans and reservations. The track data being
+	// reinitialized has to invalidate first, so the steps between nodes are worked out again.
+	void reset(track_node* track, const int goal, etl::unordered_set<int, TRACK_MAX>& banned_node);
+	void invalidate();
+	int get_goal() const;
+
+	// Nodes whose ban or reservation differs from what the search was last brought up to date with
+	int changes(etl::unordered_set<int, TRACK_MAX>& banned_node) const;
+	// Brings the search up to date with a new banned set and the current reservations on the track
+	void update(etl::unordered_set<int, TRACK_MAX>& banned_node);
+
+	// Cost from source to the goal, INT_MAX when there is no way there
+	int cost_from(const int source);
+
+	// Fills path from source to the goal and its length in mm. Returns false if there is no path, or if the path has to
+	// reverse: parking past the merge is worked out by Dijkstra::weighted_path_with_ban.
+	bool walk(const int source, int* path, int* path_len, int* dist);
+
+	// Nodes taken off the queue since the last reset_expanded
+	int get_expanded() const;
+	void reset_expanded();
+
+private:
+	track_node* track = nullptr;
+	int goal = NO_GOAL;
+	int expanded = 0;
+
+	int g[TRACK_MAX];	// cost to the goal as last settled
+	int rhs[TRACK_MAX]; // cost to the goal from the successors' g, differs from g while the node is queued
+	bool blocked[TRACK_MAX];
+	bool reserved[TRACK_MAX];
+	int num_blocked = 0;
+	int16_t preds[TRACK_MAX][MAX_PREDS];
+	int8_t num_preds[TRACK_MAX];
+
+	// indexed min heap on min(g, rhs)
+	int16_t heap[TRACK_MAX];
+	int16_t heap_pos[TRACK_MAX];
+	int heap_key[TRACK_MAX];
+	int heap_size = 0;
+
+	void build_preds();
+	int step_to(const int u, const int dir) const;
+	int step_cost(const int u, const int dir) const;
+	int best_step(const int u, int* dir) const;
+	void update_vertex(const int u);
+	void compute(const int start);
+
+	void heap_push(const int u, const int key);
+	void heap_remove(const int u);
+	int heap_pop();
+	void sift_up(int i);
+	void sift_down(int i);
+	void heap_swap(const int i, const int j);
+};
+}
@@ -0,0 +1,191 @@
+#include "bus_scheduler.h"
+#include "../etl/algorithm.h"
+#include "../kernel.h"
+
+using namespace Train;
+
+void BusScheduler::push(CommandClass cls, BusCommand& cmd) {
+	if (queues[cls].full()) {
+		Task::_KernelCrash("Bus Scheduler: class %d queue full\r\n", cls);
+	}
+	cmd.seq = next_seq++;
+	queues[cls].push_back(cmd);
+}
+
+void BusScheduler::supersede_speed(int train) {
+	// a newer speed makes the queued ones pointless, unless a reverse sits in between
+	uint32_t last_reverse = 0;
+	for (const BusCommand& cmd : queues[CLASS_REVERSE]) {
+		if (cmd.train == train) {
+			last_reverse = cmd.seq;
+		}
+	}
+	drop_speed(train, last_reverse);
+}
+
+void BusScheduler::express_stop(int train) {
+	// queued reverses stay, they only flip the direction of a stopped train
+	drop_speed(train, 0);
+}
+
+void BusScheduler::express_egress(uint64_t decided_at, uint64_t egress_at) {
+	uint32_t delay = (egress_at > decided_at) ? egress_at - decided_at : 0;
+	counters.express_sent += 1;
+	counters.express_total_delay += delay;
+	counters.express_max_delay = (delay > counters.express_max_delay) ? delay : counters.express_max_delay;
+}
+
+void BusScheduler::cancel_speed(int train) {
+	drop_speed(train, 0);
+}
+
+void BusScheduler::drop_speed(int train, uint32_t after_seq) {
+	const CommandClass speed_classes[] = { CLASS_STOP, CLASS_SPEED };
+	for (CommandClass cls : speed_classes) {
+		auto& queue = queues[cls];
+		for (auto it = queue.begin(); it != queue.end();) {
+			if (it->train == train && it->seq > after_seq) {
+				it = queue.erase(it);
+				counters.classes[cls].superseded += 1;
+			} else {
+				++it;
+			}
+		}
+	}
+}
+
+void BusScheduler::push_train(CommandClass cls, char train, char action, uint64_t now) {
+	if (cls == CLASS_STOP || cls == CLASS_SPEED) {
+		supersede_speed(train);
+	}
+	BusCommand cmd = { { action, train }, 2, train, 0, now };
+	push(cls, cmd);
+}
+
+void BusScheduler::push_switch(const char* bytes, int len, uint64_t now) {
+	BusCommand cmd = { { bytes[0], (len > 1) ? bytes[1] : (char)0 }, len, NO_BUS_TRAIN, 0, now };
+	push(CLASS_SWITCH, cmd);
+}
+
+bool BusScheduler::has_older(const BusCommand& cmd) const {
+	if (cmd.train == NO_BUS_TRAIN) {
+		return false;
+	}
+	for (int cls = 0; cls < NUM_COMMAND_CLASSES; cls++) {
+		for (const BusCommand& other : queues[cls]) {
+			if (other.train == cmd.train && other.seq < cmd.seq) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+int BusScheduler::fill_window(char* out, int budget, uint64_t now) {
+	int used = 0;
+	last_trains.clear();
+	last_lens.clear();
+	while (true) {
+		int pick = NUM_COMMAND_CLASSES;
+		for (int cls = 0; cls < NUM_COMMAND_CLASSES; cls++) {
+			if (queues[cls].empty()) {
+				continue;
+			}
+			const BusCommand& cmd = queues[cls].front();
+			if (cmd.len <= budget - used && !has_older(cmd)) {
+				pick = cls;
+				break;
+			}
+		}
+		if (pick == NUM_COMMAND_CLASSES) {
+			break;
+		}
+
+		const BusCommand& cmd = queues[pick].front();
+		for (int i = 0; i < cmd.len; i++) {
+			out[used++] = cmd.bytes[i];
+		}
+		last_lens.push_back((uint8_t)cmd.len);
+		bool speed = pick == CLASS_STOP || pick == CLASS_SPEED;
+		if (speed && etl::find(last_trains.begin(), last_trains.end(), cmd.train) == last_trains.end()) {
+			last_trains.push_back(cmd.train);
+		}
+		uint32_t delay = now - cmd.queued_at;
+		BusClassStats& stat = counters.classes[pick];
+		stat.sent += 1;
+		stat.total_delay += delay;
+		stat.max_delay = (delay > stat.max_delay) ? delay : stat.max_delay;
+		queues[pick].pop_front();
+	}
+
+	if (used > 0) {
+		counters.windows += 1;
+		counters.bytes += used;
+		counters.full_windows += empty() ? 0 : 1;
+	}
+	return used;
+}
+
+bool BusScheduler::empty() const {
+	for (int cls = 0; cls < NUM_COMMAND_CLASSES; cls++) {
+		if (!queues[cls].empty()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int BusScheduler::pending_bytes() const {
+	int bytes = 0;
+	for (int cls = 0; cls < NUM_COMMAND_CLASSES; cls++) {
+		for (const BusCommand& cmd : queues[cls]) {
+			bytes += cmd.len;
+		}
+	}
+	return bytes;
+}
+
+BusStats BusScheduler::stats() const {
+	BusStats res = counters;
+	for (int cls = 0; cls < NUM_COMMAND_CLASSES; cls++) {
+		res.classes[cls].pending = queues[cls].size();
+	}
+	return res;
+}
+
+void PollPacer::record(uint32_t latency_us, int window_bytes, int backlog_bytes) {
+	// the 0x85 waited behind the window in the uart
+	uint32_t window_us = window_bytes * MARKLIN_US_PER_BYTE;
+	uint32_t response = (latency_us > window_us) ? latency_us - window_us : 0;
+
+	// fastest recent reply, drifts up slowly so one lucky poll doesn't make every later one late
+	if (counters.baseline == 0 || response < counters.baseline) {
+		counters.baseline = response;
+	} else {
+		counters.baseline += (response - counters.baseline) / 64;
+	}
+
+	bool late = response > counters.baseline + POLL_LATE_US;
+	if (late) {
+		bytes = (bytes - 2 < BUS_MIN_BYTES_PER_POLL) ? BUS_MIN_BYTES_PER_POLL : bytes - 2;
+		gap = (gap + 1 > POLL_MAX_GAP_TICKS) ? POLL_MAX_GAP_TICKS : gap + 1;
+	} else if (backlog_bytes > 0) {
+		bytes = (bytes + 2 > BUS_MAX_BYTES_PER_POLL) ? BUS_MAX_BYTES_PER_POLL : bytes + 2;
+		gap = (gap > 0) ? gap - 1 : 0;
+	} else {
+		bytes = (bytes - 1 < BUS_MIN_BYTES_PER_POLL) ? BUS_MIN_BYTES_PER_POLL : bytes - 1;
+		gap = (gap > 0) ? gap - 1 : 0;
+	}
+
+	counters.polls += 1;
+	counters.late += late ? 1 : 0;
+	counters.total_response += response;
+	counters.max_response = (response > counters.max_response) ? response : counters.max_response;
+}
+
+PollStats PollPacer::stats() const {
+	PollStats res = counters;
+	res.budget = bytes;
+	res.gap = gap;
+	return res;
+}
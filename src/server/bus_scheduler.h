@@ -0,0 +1,142 @@
+#pragma once
+
+#include "../etl/deque.h"
+#include "../etl/vector.h"
+#include <stdint.h>
+namespace Train
+{
+
+// 2400 baud, a start bit, 8 data bits and 2 stop bits per byte
+constexpr int MARKLIN_BAUD = 2400;
+constexpr int MARKLIN_BITS_PER_BYTE = 11;
+constexpr int MARKLIN_US_PER_BYTE = 1000000 * MARKLIN_BITS_PER_BYTE / MARKLIN_BAUD;
+
+// how long the commands between two sensor polls may hold the bus, a poll itself is 11 bytes (~50ms)
+constexpr int BUS_COMMAND_WINDOW_US = 30000;
+constexpr int BUS_BYTES_PER_POLL = BUS_COMMAND_WINDOW_US / MARKLIN_US_PER_BYTE;
+
+// PollPacer moves the budget within these, a window always fits at least one train command
+constexpr int BUS_MIN_BYTES_PER_POLL = 2;
+constexpr int BUS_MAX_BYTES_PER_POLL = 12;
+// a reply this much slower than the fastest recent one counts as late, the Marklin is falling behind
+constexpr uint32_t POLL_LATE_US = 15000;
+// longest gap in front of a poll, the fixed delay every poll used to wait
+constexpr int POLL_MAX_GAP_TICKS = 7;
+
+constexpr int BUS_QUEUE_SIZE = 64;
+constexpr int BUS_MAX_COMMAND_LEN = 2;
+
+// lower goes first
+enum CommandClass : uint8_t { CLASS_STOP = 0, CLASS_SPEED, CLASS_REVERSE, CLASS_SWITCH, NUM_COMMAND_CLASSES };
+
+struct BusCommand {
+	char bytes[BUS_MAX_COMMAND_LEN];
+	int len;
+	int train;			// NO_BUS_TRAIN for switch commands
+	uint32_t seq;		// arrival order, commands for the same train never overtake each other
+	uint64_t queued_at; // system time in us
+};
+
+constexpr int NO_BUS_TRAIN = -1;
+
+struct BusClassStats {
+	uint32_t sent = 0;
+	uint32_t superseded = 0; // speed commands replaced by a newer one before they went out
+	uint32_t pending = 0;
+	uint64_t total_delay = 0; // us between queueing and the start of the window that sent it
+	uint32_t max_delay = 0;
+};
+
+struct PollStats {
+	uint32_t polls = 0;
+	uint32_t late = 0;
+	uint64_t total_response = 0; // us the Marklin took to answer, without the window written in front of the poll
+	uint32_t max_response = 0;
+	uint32_t baseline = 0;
+	int budget = 0; // current bytes per window
+	int gap = 0;	// current ticks in front of a poll
+};
+
+struct BusStats {
+	BusClassStats classes[NUM_COMMAND_CLASSES];
+	PollStats poll;
+	uint32_t windows = 0;
+	uint32_t full_windows = 0; // windows that left something queued
+	uint32_t bytes = 0;
+	// stops that skipped the windows, delay is from the decision to the last byte leaving the uart
+	uint32_t express_sent = 0;
+	uint64_t express_total_delay = 0;
+	uint32_t express_max_delay = 0;
+};
+
+/**
+ * Decides what train_admin writes to the Marklin between two sensor polls.
+ * Each window gets BUS_BYTES_PER_POLL bytes, filled by priority class (stop > speed > reverse > switch),
+ * first come first served within a class.
+ */
+class BusScheduler {
+public:
+	void push_train(CommandClass cls, char train, char action, uint64_t now);
+	void push_switch(const char* bytes, int len, uint64_t now);
+	// writes the commands for one window into out, returns the number of bytes to send
+	int fill_window(char* out, int budget, uint64_t now);
+	// trains with a speed or stop command in the last filled window
+	const etl::vector<char, BUS_MAX_BYTES_PER_POLL / BUS_MAX_COMMAND_LEN>& speed_trains() const {
+		return last_trains;
+	}
+	// length of each command in the last filled window, in the order they were written
+	const etl::vector<uint8_t, BUS_MAX_BYTES_PER_POLL>& command_lens() const {
+		return last_lens;
+	}
+	bool empty() const;
+	bool has_pending(CommandClass cls) const {
+		return !queues[cls].empty();
+	}
+	int pending_bytes() const;
+	// an express stop went straight to the uart, anything still queued to change the train's speed is dropped
+	void express_stop(int train);
+	// the express stop decided at decided_at (system time, us) left the uart at egress_at
+	void express_egress(uint64_t decided_at, uint64_t egress_at);
+	// a command for the train is held for a deadline, what is queued would land around it in no particular order
+	void cancel_speed(int train);
+	BusStats stats() const;
+
+private:
+	etl::deque<BusCommand, BUS_QUEUE_SIZE> queues[NUM_COMMAND_CLASSES];
+	uint32_t next_seq = 1;
+	BusStats counters;
+	etl::vector<char, BUS_MAX_BYTES_PER_POLL / BUS_MAX_COMMAND_LEN> last_trains;
+	etl::vector<uint8_t, BUS_MAX_BYTES_PER_POLL> last_lens;
+
+	void push(CommandClass cls, BusCommand& cmd);
+	bool has_older(const BusCommand& cmd) const;
+	void supersede_speed(int train);
+	void drop_speed(int train, uint32_t after_seq);
+};
+
+/**
+ * Picks the command budget of the next window and the gap in front of the next poll, from how long the Marklin took to
+ * answer the last one (0x85 to the tenth byte, measured by sensor_courier).
+ * Idle bus: no gap and a small window, so polls come back to back and sensor hits are seen sooner.
+ * Commands queued: a bigger window, the polls spread out so the commands get through.
+ * Late reply: commands are slowing the Marklin down, so a smaller window and a gap until it keeps up again.
+ */
+class PollPacer {
+public:
+	// window_bytes were written right before the poll, backlog_bytes are still queued after it
+	void record(uint32_t latency_us, int window_bytes, int backlog_bytes);
+	int budget() const {
+		return bytes;
+	}
+	int gap_ticks() const {
+		return gap;
+	}
+	PollStats stats() const;
+
+private:
+	int bytes = BUS_BYTES_PER_POLL;
+	int gap = 0;
+	PollStats counters;
+};
+
+}
@@ -24,9 +24,9 @@ void Clock::clock_server() {
 		switch (req.header) {
 		case Message::RequestHeader::NOTIFY_TIMER: {
 			Message::Reply::EmptyReply(from); // unblock ticker right away
-			ticks += 1;
+			ticks += req.body.ticks;		  // more than one if the notifier was late
 			auto it = delay_queue.begin();
-			while (it != delay_queue.end() && it->second == ticks) { // since we never skip any ticks we can do similar process to this
+			while (it != delay_queue.end() && it->second <= ticks) { // sorted, so everything due is at the front
 				Message::Reply::Reply(it->first, (const char*)&ticks, sizeof(ticks)); // unblock delayed task
 				it = delay_queue.erase(it);
 			}
@@ -84,7 +84,7 @@ void Clock::clock_notifier() {
 	AddressBook addr = getAddressBook();
 	ClockServerReq req = { Message::RequestHeader::NOTIFY_TIMER, { 0 } };
 	while (true) {
-		Interrupt::AwaitEvent(TIMER_INTERRUPT_ID);
+		Interrupt::AwaitEventWithBuffer(TIMER_INTERRUPT_ID, reinterpret_cast<char*>(&req.body.ticks), sizeof(req.body.ticks));
 		Message::Send::SendNoReply(addr.clock_tid, reinterpret_cast<const char*>(&req), sizeof(ClockServerReq));
 	}
 }
@@ -21,6 +21,10 @@ public:
 	};
 	void request(T* req);
 	void receive(int tid);
+	// every courier is out, the next request waits for one to come back
+	bool has_backlog() const {
+		return !request_queue.empty();
+	}
 	~CourierPool();
 
 private:
@@ -3,6 +3,7 @@
 #include "global_pathing_server.h"
 #include "../routing/kinematic.h"
 #include "courier_pool.h"
+#include "state_subscription.h"
 #include "train_admin.h"
 #include <climits>
 using namespace Train;
@@ -12,9 +13,11 @@ using namespace Routing;
 
 bool Planning::TrainStatus::toSpeed(SpeedLevel s) {
 	// it a massive state machine]
-	localization.acceleration_start_timestamp = Clock::Time(addr.clock_tid);
+	localization.acceleration_start_us = Clock::system_time();
+	localization.acceleration_start_timestamp = clock->to_tick(localization.acceleration_start_us);
 	localization.previous_velocity = getVelocity();
 	if (s != localization.speed) {
+		attribution->reopen(my_index);
 		if (localization.speed < s) {
 			localization.from = FROM_DOWN;
 		} else {
@@ -37,6 +40,18 @@ bool Planning::TrainStatus::isAccelerating(int current_time) {
 	return time_diff >= acceleration_time_tick;
 }
 
+void Planning::TrainStatus::speed_egress(uint64_t egress_us) {
+	// older than the last decision, the command it belongs to was already overridden
+	if (egress_us < localization.acceleration_start_us) {
+		return;
+	}
+	localization.acceleration_start_us = egress_us;
+	localization.acceleration_start_timestamp = clock->to_tick(egress_us);
+	if (localization.state == TrainState::CALIBRATE_ACCELERATION) {
+		cali_state.last_trigger_us = egress_us;
+	}
+}
+
 void Planning::TrainStatus::raw_reverse() {
 	// change state to reverse without actually reversing
 	localization.path_len = localization.direction
@@ -93,6 +108,21 @@ void Planning::TrainStatus::add_path(int landmark) {
 	localization.path.push_back(landmark);
 }
 
+/**
+ * Lets the track server hold off each switch on the reservation until just before we get to it.
+ * Only done while cruising on a path, the prediction is the one expected_arrival_ticks comes from.
+ */
+void Planning::TrainStatus::predict_switch_throws(Track::TrackServerReq* reservation_request) {
+	int current_time = clock->now();
+	reservation_request->body.reservation.now_tick = current_time;
+	reservation_request->body.reservation.velocity = 0;
+	reservation_request->body.reservation.origin_tick = localization.path_front_tick;
+	if (localization.state == TrainState::MULTI_PATHING && !isAccelerating(current_time) && !localization.path.empty()
+		&& track[localization.path.front()].type == node_type::NODE_SENSOR) {
+		reservation_request->body.reservation.velocity = localization.eventual_velocity;
+	}
+}
+
 bool Planning::TrainStatus::try_reserve_pre_fill(Track::TrackServerReq* reservation_request) {
 	reservation_request->body.reservation.total_len = 0;
 	for (auto it = localization.path.begin(); it != localization.path.end(); it++) {
@@ -104,6 +134,7 @@ bool Planning::TrainStatus::try_reserve_pre_fill(Track::TrackServerReq* reservat
 bool Planning::TrainStatus::try_reserve_no_fill(Track::TrackServerReq* reservation_request) {
 	reservation_request->header = RequestHeader::TRACK_TRY_RESERVE;
 	reservation_request->body.reservation.train_id = my_id;
+	predict_switch_throws(reservation_request);
 	Track::ReservationStatus status;
 	Send::Send(addr.track_server_tid, (const char*)reservation_request, sizeof(Track::TrackServerReq), (char*)&status, sizeof(status));
 	if (status.successful && reservation_request->body.reservation.len_until_reservation >= 1) {
@@ -120,6 +151,7 @@ bool Planning::TrainStatus::try_reserve(Track::TrackServerReq* reservation_reque
 	}
 	reservation_request->header = RequestHeader::TRACK_TRY_RESERVE;
 	reservation_request->body.reservation.train_id = my_id;
+	predict_switch_throws(reservation_request);
 	Track::ReservationStatus status;
 	Send::Send(addr.track_server_tid, (const char*)reservation_request, sizeof(Track::TrackServerReq), (char*)&status, sizeof(status));
 	if (status.successful && reservation_request->body.reservation.len_until_reservation >= 1) {
@@ -133,6 +165,7 @@ bool Planning::TrainStatus::try_reserve(Track::TrackServerReq* reservation_reque
 	reservation_request->body.reservation.total_len = total_len;
 	reservation_request->header = RequestHeader::TRACK_TRY_RESERVE;
 	reservation_request->body.reservation.train_id = my_id;
+	predict_switch_throws(reservation_request);
 	Track::ReservationStatus status;
 	Send::Send(addr.track_server_tid, (const char*)reservation_request, sizeof(Track::TrackServerReq), (char*)&status, sizeof(status));
 	if (status.successful && reservation_request->body.reservation.len_until_reservation >= 1) {
@@ -190,12 +223,28 @@ void Planning::TrainStatus::locate() {
 
 void Planning::TrainStatus::pipe_tr() {
 	debug_print(addr.term_trans_tid, "changing speed of train %d to %d \r\n", my_id, getTrainSpeedLevel());
+	if (getTrainSpeedLevel() % 16 == 0) {
+		pipe_stop();
+		return;
+	}
 	req_to_courier.header = RequestHeader::GLOBAL_COUR_SPEED;
 	req_to_courier.body.command.id = my_id;
 	req_to_courier.body.command.action = getTrainSpeedLevel();
 	courier_pool->request(&req_to_courier);
 }
 
+/**
+ * Stops skip the bus queue, train admin writes them out as soon as it gets them. They still go through a courier, so
+ * we never wait on a busy train admin, and in order behind the speed changes already handed to the couriers. The time
+ * we decided goes along, train admin reports how long it took from here to the wire.
+ */
+void Planning::TrainStatus::pipe_stop() {
+	req_to_courier.header = RequestHeader::GLOBAL_COUR_EXPRESS_STOP;
+	req_to_courier.body.express.id = my_id;
+	req_to_courier.body.express.decided_at = Clock::system_time();
+	courier_pool->request(&req_to_courier);
+}
+
 void Planning::TrainStatus::pipe_rv() {
 	debug_print(addr.term_trans_tid, "reversing %d \r\n", my_id);
 	req_to_courier.header = RequestHeader::GLOBAL_COUR_REV;
@@ -205,6 +254,10 @@ void Planning::TrainStatus::pipe_rv() {
 
 void Planning::TrainStatus::pipe_tr(char speed) {
 	debug_print(addr.term_trans_tid, "changing speed of train %d to %d \r\n", my_id, speed);
+	if (speed % 16 == 0) {
+		pipe_stop();
+		return;
+	}
 
 	req_to_courier.header = RequestHeader::GLOBAL_COUR_SPEED;
 	req_to_courier.body.command.id = my_id;
@@ -213,17 +266,19 @@ void Planning::TrainStatus::pipe_tr(char speed) {
 }
 
 void Planning::TrainStatus::clear_calibration() {
-	cali_state.last_trigger = 0;
+	cali_state.last_trigger_us = 0;
 	cali_state.needed_trigger = 0;
 	localization.distance_traveled = 0;
 }
 
-void Planning::TrainStatus::toIdle() {
+void Planning::TrainStatus::toIdle(bool stop_sent) {
 	if (localization.state != TrainState::IDLE) {
 		debug_print(addr.term_trans_tid, "heading into idle for train %d\r\n", my_id);
 		localization.state = TrainState::IDLE;
 		toSpeed(SpeedLevel::SPEED_STOP);
-		pipe_tr();
+		if (!stop_sent) {
+			pipe_tr();
+		}
 		localization.path.clear();
 		while (!train_sub.empty()) {
 			Reply::EmptyReply(train_sub.front());
@@ -238,10 +293,27 @@ void Planning::TrainStatus::toStopping(int64_t remaining_distance_mm) {
 	debug_print(
 		addr.term_trans_tid, "trying to stop remain_dist %llu, velocity %llu, ticks %d\r\n", remaining_distance_mm, getVelocity(), ticks_delay);
 
+	/**
+	 * The stop goes to train admin right away with the time it has to be on the wire, counted from the sensor hit, and
+	 * the uart server sends it at that microsecond. The courier only moves us to idle once it is out. With couriers
+	 * backed up the stop waits behind them instead, like pipe_stop, so it can't be overtaken by an older speed change.
+	 */
+	bool stop_sent = !courier_pool->has_backlog();
+	if (stop_sent) {
+		int64_t delay_us = remaining_distance_mm * TWO_DECIMAL_PLACE * Clock::MICROS_PER_TICK / getVelocity();
+		Train::TrainAdminReq req_to_train;
+		req_to_train.header = RequestHeader::TRAIN_SPEED_AT;
+		req_to_train.body.timed.id = my_id;
+		req_to_train.body.timed.action = 0;
+		req_to_train.body.timed.due = localization.sensor_us + ((delay_us > 0) ? delay_us : 0);
+		Send::SendNoReply(addr.train_admin_tid, reinterpret_cast<char*>(&req_to_train), sizeof(req_to_train));
+	}
+
 	PlanningCourReq req_to_courier;
 	req_to_courier.header = RequestHeader::GLOBAL_COUR_STOPPING;
 	req_to_courier.body.stopping_request.id = my_index;
 	req_to_courier.body.stopping_request.delay = ticks_delay;
+	req_to_courier.body.stopping_request.stop_sent = stop_sent;
 	courier_pool->request(&req_to_courier);
 }
 
@@ -505,30 +577,27 @@ void Planning::TrainStatus::subscribe(int from) {
 }
 
 void Planning::TrainStatus::sensor_unsub() {
-	for (auto it = sensor_subs->begin(); it != sensor_subs->end();) {
-		if (it->first == my_index) {
-			it = sensor_subs->erase(it);
-		} else {
-			it++;
-		}
-	}
+	sensor_subs->clear(my_index);
+	attribution->forget(my_index);
 }
 void Planning::TrainStatus::sub_to_sensor(int sensor_id) {
 	sensor_unsub();
-	sensor_subs->push_back(etl::make_pair(my_index, etl::unordered_set<int, 32> { sensor_id }));
+	sensor_subs->add(my_index, sensor_id);
 }
 
 void Planning::TrainStatus::sub_to_sensor(etl::unordered_set<int, 32> sensor_ids) {
 	sensor_unsub();
-	sensor_subs->push_back(etl::make_pair(my_index, sensor_ids));
+	sub_to_sensor_no_delete(sensor_ids);
 }
 
 void Planning::TrainStatus::sub_to_sensor_no_delete(int sensor_id) {
-	sensor_subs->push_back(etl::make_pair(my_index, etl::unordered_set<int, 32> { sensor_id }));
+	sensor_subs->add(my_index, sensor_id);
 }
 
 void Planning::TrainStatus::sub_to_sensor_no_delete(etl::unordered_set<int, 32> sensor_ids) {
-	sensor_subs->push_back(etl::make_pair(my_index, sensor_ids));
+	for (int sensor_id : sensor_ids) {
+		sensor_subs->add(my_index, sensor_id);
+	}
 }
 
 // Sets switches, determines next sensor to subscribe to, outputs useful info
@@ -567,26 +636,63 @@ void Planning::TrainStatus::simple_pre_compute_path(bool should_subscribe) {
 	 * it will reserve and flip all the switches for you, and will cause problem if you are not the only train on the track.
 	 */
 
+	/**
+	 * Waits on the sensors up to the end of the reservation, ATTRIBUTION_DEPTH of them plus any that are known to miss.
+	 * Their windows count from the sensor at the front of the path. A train that has been at its speed since before
+	 * that sensor has a window on both sides, one that is still changing speed only gets the early side, from the
+	 * fastest it can be going.
+	 */
+	if (!should_subscribe) {
+		return;
+	}
+	bool timed = !localization.path.empty() && track[localization.path.front()].type == node_type::NODE_SENSOR;
+	bool settled = localization.acceleration_start_timestamp + ATTRIBUTION_SETTLE_TICKS <= localization.path_front_tick;
+	int64_t fastest = (localization.previous_velocity > localization.eventual_velocity) ? localization.previous_velocity
+																						  : localization.eventual_velocity;
+	auto window = [&](ExpectedSensor& e, int64_t dist) {
+		e.earliest = WINDOW_OPEN_EARLY;
+		e.latest = WINDOW_OPEN_LATE;
+		if (!timed) {
+			return;
+		}
+		if (fastest > 0) {
+			int64_t ticks = dist * TWO_DECIMAL_PLACE * TWO_DECIMAL_PLACE / fastest;
+			e.earliest = localization.path_front_tick + ticks * (100 - ATTRIBUTION_SLACK_PERCENT) / 100 - ATTRIBUTION_MIN_SLACK_TICKS;
+		}
+		if (settled && localization.eventual_velocity > 0) {
+			int64_t ticks = dist * TWO_DECIMAL_PLACE * TWO_DECIMAL_PLACE / localization.eventual_velocity;
+			e.latest = localization.path_front_tick + ticks * (100 + ATTRIBUTION_SLACK_PERCENT) / 100 + ATTRIBUTION_MIN_SLACK_TICKS;
+		}
+	};
+
 	bool found_last_reserved = false;
 	int sensor_count = 0;
-	track_node* node;
-	etl::unordered_set<int, 32> subs;
-	for (auto it = localization.path.begin(); it != localization.path.end();) {
-		node = &track[*it];
+	int reliable = 0;
+	int64_t dist = 0;
+	ExpectedSensor expected[ATTRIBUTION_MAX_EXPECTED];
+	int num_expected = 0;
+	for (auto it = localization.path.begin(); it != localization.path.end() && !found_last_reserved;) {
+		track_node* node = &track[*it];
 		it++;
 		if (node->type == node_type::NODE_SENSOR) {
-			if (!found_last_reserved && sensor_count > 0 && sensor_count <= 4) {
-				subs.insert(node->num);
+			if (sensor_count > 0 && reliable < ATTRIBUTION_DEPTH && num_expected < ATTRIBUTION_MAX_EXPECTED) {
+				ExpectedSensor& e = expected[num_expected++];
+				e.sensor = node->num;
+				window(e, dist);
+				reliable += attribution->unreliable(node->num) ? 0 : 1;
 			}
 			sensor_count += 1;
-			if (node->num == localization.last_reserved_node) {
-				found_last_reserved = true;
-			}
+			found_last_reserved = node->num == localization.last_reserved_node;
+		}
+		if (it == localization.path.end()) {
+			break;
+		} else if (node->type == node_type::NODE_BRANCH) {
+			dist += (&track[*it] == node->edge[DIR_CURVED].dest) ? node->edge[DIR_CURVED].dist : node->edge[DIR_STRAIGHT].dist;
+		} else {
+			dist += node->edge[DIR_AHEAD].dist;
 		}
 	}
-	if (should_subscribe) {
-		sub_to_sensor_no_delete(subs);
-	}
+	attribution->expect(my_index, expected, num_expected);
 }
 
 bool Planning::TrainStatus::goTo(int dest, SpeedLevel speed) {
@@ -747,7 +853,7 @@ bool Planning::TrainStatus::calibrate_base_velocity(int from) {
 	pipe_tr(cali_state.slow_calibration_speed);
 
 	localization.distance_traveled = localization.last_node->edge[DIR_AHEAD].dist;
-	cali_state.last_trigger = Clock::Time(addr.clock_tid);
+	cali_state.last_trigger_us = Clock::system_time();
 
 	track_node* next_node = localization.last_node->edge[DIR_AHEAD].dest;
 	debug_print(addr.term_trans_tid, "last_node %s\r\n", localization.last_node->name);
@@ -951,32 +1057,32 @@ void Planning::TrainStatus::calibrate_stopping_distance_phase_2() {
 	 * March slowly toward the next sensor, also record the time
 	 */
 	localization.state = TrainState::CALIBRATE_STOPPING_DISTANCE_PHASE_2;
-	cali_state.last_trigger = Clock::Time(addr.clock_tid);
+	cali_state.last_trigger_us = Clock::system_time();
 	pipe_tr(cali_state.slow_calibration_speed);
 }
 
 void Planning::TrainStatus::continuous_velocity_calibration() {
 	cali_state.needed_trigger -= 1;
-	uint64_t current_time = Clock::Time(addr.clock_tid);
+	uint64_t current_us = localization.sensor_us;
 	if (cali_state.needed_trigger == 0) {
 		if (cali_state.ignore_first) {
 			cali_state.ignore_first = false;
 		} else {
-			// first 6 zeros to nano meter, later 2 zeros from /10ms to /seconds
-			uint64_t speed
-				= ((localization.distance_traveled - cali_state.distance_traveled_since_last_calibration) * TWO_DECIMAL_PLACE * TWO_DECIMAL_PLACE)
-				  / (current_time - cali_state.last_trigger); // store as MM / 10 micro seconds
+			// first 6 zeros to nano meter, later 2 zeros from /10ms to /seconds, the time is taken in us and scaled to ticks
+			uint64_t speed = ((localization.distance_traveled - cali_state.distance_traveled_since_last_calibration) * TWO_DECIMAL_PLACE
+							  * TWO_DECIMAL_PLACE * Clock::MICROS_PER_TICK)
+							 / (current_us - cali_state.last_trigger_us); // store as MM / 10 micro seconds
 			updateVelocity(speed);
 			debug_print(addr.term_trans_tid,
-						"time-diff %llu, total-distance %llu, new measurement %llu, actual speed %llu\r\n",
-						(current_time - cali_state.last_trigger),
+						"time-diff %llu us, total-distance %llu, new measurement %llu, actual speed %llu\r\n",
+						(current_us - cali_state.last_trigger_us),
 						localization.distance_traveled,
 						speed,
 						getVelocity());
 		}
 
 		// update and clear state
-		cali_state.last_trigger = current_time;
+		cali_state.last_trigger_us = current_us;
 		cali_state.distance_traveled_since_last_calibration = localization.distance_traveled;
 		cali_state.needed_trigger = getTriggerCountForSpeed();
 	}
@@ -995,7 +1101,7 @@ void Planning::TrainStatus::continuous_velocity_calibration() {
  * you are going through certain sensor, and give us a more fine gram control.
  */
 void Planning::TrainStatus::predict_future_sensor(int64_t* mm_look_ahead) {
-	int64_t current_time = Clock::Time(addr.clock_tid);
+	int64_t current_time = localization.sensor_tick; // arrivals count from the hit, not from when we got to it
 	localization.time_traveled = current_time;
 	if (!isAccelerating(current_time)) {
 		// we are not accelerating, thus we can actually predict with constant velocity assumption
@@ -1177,6 +1283,7 @@ void Planning::TrainStatus::clear_traveled_sensor(int sensor_index, bool clear_r
 	} else {
 		Track::TrackServerReq reservation_request;
 		reservation_request.body.reservation.len_until_reservation = 0;
+		localization.path_front_tick = localization.sensor_tick;
 
 		auto it = localization.path.begin();
 		reservation_request.body.reservation.path[reservation_request.body.reservation.len_until_reservation++] = *it;
@@ -1226,6 +1333,7 @@ void Planning::TrainStatus::clear_traveled_sensor_until(int sensor_index, bool c
 	} else {
 		Track::TrackServerReq reservation_request;
 		reservation_request.body.reservation.len_until_reservation = 0;
+		localization.path_front_tick = localization.sensor_tick;
 
 		auto it = localization.path.begin();
 		reservation_request.body.reservation.path[reservation_request.body.reservation.len_until_reservation++] = *it;
@@ -1588,26 +1696,26 @@ void Planning::TrainStatus::handle_train_calibrate_velocity(int sensor_index) {
 }
 
 void Planning::TrainStatus::end_acceleration_calibrate() {
-	uint64_t current_time = Clock::Time(addr.clock_tid);
+	uint64_t current_us = localization.sensor_us;
 	toIdle();
-	int64_t t = current_time - cali_state.last_trigger; // 10 ms
+	int64_t t_us = current_us - cali_state.last_trigger_us;
+	int64_t t = t_us / Clock::MICROS_PER_TICK; // 10 ms, only for the log, the math below stays in us
 	int64_t d = localization.distance_traveled;			// in MM
 	int64_t v_2 = cali_state.target_velocity;
 	int64_t v_1 = cali_state.prev_velocity;
 	int64_t v_a = (v_2 + v_1) / 2; // average velocity in NM / seconds
-	debug_print(
-		addr.term_trans_tid, "acceleration case: d %ld, t %ld, d*t %ld, v_a %ld \r\n", d, t, (d * TWO_DECIMAL_PLACE * TWO_DECIMAL_PLACE) / t, v_a);
-	if ((d * TWO_DECIMAL_PLACE * TWO_DECIMAL_PLACE) / t > v_a) {
+	int64_t v_s = (d * TWO_DECIMAL_PLACE * TWO_DECIMAL_PLACE * Clock::MICROS_PER_TICK) / t_us;
+	debug_print(addr.term_trans_tid, "acceleration case: d %ld, t %ld, d*t %ld, v_a %ld \r\n", d, t, v_s, v_a);
+	if (v_s > v_a) {
 		// convert d from mm to nm, then - nm / seconds * seconds
-		int64_t t_1 = (d * TWO_DECIMAL_PLACE - (v_2 * t / TWO_DECIMAL_PLACE)) * TWO_DECIMAL_PLACE / (v_a - v_2);
+		int64_t t_1 = (d * TWO_DECIMAL_PLACE - (v_2 * t_us / (TWO_DECIMAL_PLACE * Clock::MICROS_PER_TICK))) * TWO_DECIMAL_PLACE / (v_a - v_2);
 		int64_t acceleration = (v_2 - v_1) * TWO_DECIMAL_PLACE / t_1; // so it is MM / ticks
 		accelerations[cali_state.prev_speed][cali_state.target_speed] = acceleration;
 		debug_print(addr.term_trans_tid, "debug: t %ld, d %ld, v_2 %ld, v_1 %ld, v_a %ld\r\n", t, d, v_2, v_1, v_a);
 		debug_print(addr.term_trans_tid, "acceleration calibration result case 1: acceleration: %ld, t_1 %ld\r\n", acceleration, t_1);
 	} else {
-		int64_t v_s = (d * TWO_DECIMAL_PLACE * TWO_DECIMAL_PLACE) / t;
 		int64_t v_r = v_s + (v_s - v_1);
-		int64_t acceleration = (v_r - v_1) * TWO_DECIMAL_PLACE / t;
+		int64_t acceleration = (v_r - v_1) * TWO_DECIMAL_PLACE * Clock::MICROS_PER_TICK / t_us;
 		accelerations[cali_state.prev_speed][cali_state.target_speed] = acceleration;
 		debug_print(addr.term_trans_tid, "debug: t %ld, d %ld, v_2 %ld, v_1 %ld, v_a %ld, v_s %ld, v_r %ld\r\n", t, d, v_2, v_1, v_a, v_s, v_r);
 		debug_print(addr.term_trans_tid, "acceleration calibration result case 2: acceleration: %ld, v_r %ld\r\n", acceleration, v_r);
@@ -1635,7 +1743,7 @@ void Planning::TrainStatus::handle_train_calibrate_acceleration(int sensor_index
 		}
 	} else if (sensor_index == SENSOR_B[0]) { // speed it up when it hit the B1 the first time
 		toSpeed(cali_state.target_speed);
-		cali_state.last_trigger = Clock::Time(addr.clock_tid);
+		cali_state.last_trigger_us = localization.sensor_us;
 		pipe_tr();
 	}
 }
@@ -1656,10 +1764,10 @@ void TrainStatus::handle_train_calibrate_base_velocity() {
 	/**
 	 * if you are locating and you hit a sensor you stop immediately and you set your last_node = desire node
 	 */
-	uint64_t current_time = Clock::Time(addr.clock_tid);
-	// distance traveled is not in 2 decimal place, and / 10 ms instead of 1s, thus *100 *100
-	int mul = TWO_DECIMAL_PLACE * TWO_DECIMAL_PLACE;
-	cali_state.slow_calibration_mm = (localization.distance_traveled) * mul / (current_time - cali_state.last_trigger);
+	uint64_t current_us = localization.sensor_us;
+	// distance traveled is not in 2 decimal place, and / 10 ms instead of 1s, thus *100 *100, time is in us
+	int64_t mul = TWO_DECIMAL_PLACE * TWO_DECIMAL_PLACE * Clock::MICROS_PER_TICK;
+	cali_state.slow_calibration_mm = (localization.distance_traveled) * mul / (int64_t)(current_us - cali_state.last_trigger_us);
 	toIdle();
 	debug_print(addr.term_trans_tid, "base speed of train %d is %llu\r\n", my_id, cali_state.slow_calibration_mm);
 }
@@ -1685,8 +1793,8 @@ void TrainStatus::handle_train_calibrate_stopping_distance_phase_2(int sensor_in
 	 * you should be at stopping speed, which means, you listen to sensor, and record their distance traveld for all
 	 * that hits
 	 */
-	int64_t slow_travled_time = Clock::Time(addr.clock_tid) - cali_state.last_trigger;
-	int64_t slow_travled_distance = cali_state.slow_calibration_mm * slow_travled_time / TWO_DECIMAL_PLACE;
+	int64_t slow_travled_us = localization.sensor_us - cali_state.last_trigger_us;
+	int64_t slow_travled_distance = cali_state.slow_calibration_mm * slow_travled_us / (TWO_DECIMAL_PLACE * Clock::MICROS_PER_TICK);
 	clear_traveled_sensor(sensor_index);
 	int64_t real_stop_distance = localization.distance_traveled * TWO_DECIMAL_PLACE - slow_travled_distance;
 	// note that now we have real_stopping_distance, assuming our velocity is valid,
@@ -1739,7 +1847,9 @@ void TrainStatus::handle_train_locate(int sensor_index) {
 	}
 }
 
-void Planning::TrainStatus::sensor_notify(int sensor_index) {
+void Planning::TrainStatus::sensor_notify(int sensor_index, int event_tick, uint64_t event_us) {
+	localization.sensor_tick = event_tick;
+	localization.sensor_us = event_us;
 	if (localization.state == TrainState::GO_TO) {
 		handle_train_goto(sensor_index);
 	} else if (localization.state == TrainState::CALIBRATE_VELOCITY) {
@@ -1775,7 +1885,7 @@ void TrainStatus::init_calibration() {
 	cali_state.ignore_first = true;
 	cali_state.distance_traveled_since_last_calibration = 0;
 	cali_state.needed_trigger = getTriggerCountForSpeed();
-	cali_state.last_trigger = localization.time_traveled; // the first calibration is irrlevant anyway
+	cali_state.last_trigger_us = Clock::system_time(); // the first calibration is irrlevant anyway
 }
 
 void TrainStatus::update_switch_state() {
@@ -1814,7 +1924,9 @@ void TrainStatus::go_rng() {
 
 void initialize_all_train(TrainStatus* trains,
 						  Courier::CourierPool<PlanningCourReq, 32>* couriers,
-						  etl::list<etl::pair<int, etl::unordered_set<int, 32>>, Train::NUM_TRAINS>* sensors,
+						  SensorSubscriptions* sensors,
+						  SensorAttribution* attribution,
+						  const TickClock* clock,
 						  int* track_id,
 						  track_node track[]) {
 	for (int i = 0; i < NUM_TRAINS; i++) {
@@ -1822,6 +1934,8 @@ void initialize_all_train(TrainStatus* trains,
 		trains[i].my_index = i;
 		trains[i].courier_pool = couriers;
 		trains[i].sensor_subs = sensors;
+		trains[i].attribution = attribution;
+		trains[i].clock = clock;
 		trains[i].addr = getAddressBook();
 		trains[i].track = track;
 		trains[i].track_id = track_id;
@@ -1994,53 +2108,110 @@ void Planning::global_pathing_server() {
 	AddressBook addr = getAddressBook();
 	TrainStatus trains[NUM_TRAINS];
 	Terminal::GlobalTrainInfo global_info[NUM_TRAINS];
+	Subscription::VersionedState<Terminal::GlobalTrainInfo, NUM_TRAINS> global_info_versions;
 
 	Courier::CourierPool<PlanningCourReq, 32> courier_pool
 		= Courier::CourierPool<PlanningCourReq, 32>(&global_pathing_courier, Priority::HIGH_PRIORITY);
-	// first one tells who you are, second one tells you which sensor are you sub to
 	// -1 means sub to all sensor, only used during calibration
 	// (notice that it means you cannot have multiple trains calibrate at the same time)
-	etl::list<etl::pair<int, etl::unordered_set<int, 32>>, NUM_TRAINS> sensor_subs;
+	SensorSubscriptions sensor_subs;
+	SensorAttribution attribution;
+	// sensor bytes and egress reports carry the system time (us), the handlers compare them with ticks
+	TickClock clock;
+	clock.anchor(Clock::Time(addr.clock_tid));
 
 	track_node track[TRACK_MAX]; // This is guaranteed to be big enough.
 	init_tracka(track);			 // default configuration is part a
 	int track_id = GLOBAL_PATHING_TRACK_A_ID;
-	initialize_all_train(trains, &courier_pool, &sensor_subs, &track_id, track);
+	initialize_all_train(trains, &courier_pool, &sensor_subs, &attribution, &clock, &track_id, track);
 	// ask to observe the state of the sensor
 	PlanningCourReq req_to_unblock = { RequestHeader::GLOBAL_COUR_AWAIT_SENSOR, { 0x0 } };
 	courier_pool.request(&req_to_unblock);
-
-	auto sensor_update = [&](char* sensor_state) {
-		for (int i = 0; i < Sensor::NUM_SENSOR_BYTES; i++) {
-			for (int j = 1; j <= CHAR_BIT; j++) {
-				if (sensor_state[i] & (1 << (CHAR_BIT - j))) {
-					int sensor_index = i * CHAR_BIT + j - 1;
-					for (auto it = sensor_subs.begin(); it != sensor_subs.end(); it++) {
-						if (it->second.count(-1) == 1) {
-							bool identified = true;
-							for (int i = 0; i < Train::NUM_TRAINS; i++) {
-								if (i != it->first && trains[i].localization.last_node != nullptr
-									&& trains[i].localization.last_node->num == sensor_index) {
-									identified = false;
-									break;
-								}
-							}
-							if (identified) {
-								trains[it->first].sensor_notify(sensor_index);
-								it = sensor_subs.erase(it);
-								break;
-							}
-						} else if (it->second.count(sensor_index) == 1) {
-							trains[it->first].sensor_notify(sensor_index);
-							it = sensor_subs.erase(it);
-							break;
-						}
-					}
+	PlanningCourReq req_to_egress = { RequestHeader::GLOBAL_COUR_AWAIT_EGRESS, { Subscription::NOTHING_SEEN } };
+	courier_pool.request(&req_to_egress);
+
+
+	// the train that gets a hit on sensor_index, or NO_TRAIN, lowest index first when several wait on it
+	auto sensor_owner = [&](int sensor_index) {
+		uint8_t waiting = sensor_subs.waiting_on(sensor_index);
+		if (waiting != 0) {
+			return __builtin_ctz(waiting);
+		}
+		// a wildcard only claims a sensor no other train is known to be sitting on
+		for (uint8_t any = sensor_subs.waiting_on_any(); any != 0; any &= any - 1) {
+			int candidate = __builtin_ctz(any);
+			bool identified = true;
+			for (int i = 0; i < Train::NUM_TRAINS; i++) {
+				if (i != candidate && trains[i].localization.last_node != nullptr && trains[i].localization.last_node->num == sensor_index) {
+					identified = false;
+					break;
 				}
 			}
+			if (identified) {
+				return candidate;
+			}
+		}
+		return NO_TRAIN;
+	};
+
+	// sensor admin only sends sensors that went from off to on, a train sitting on a contact doesn't trigger it again
+	auto sensor_update = [&](const Sensor::SensorHits& hits) {
+		if (hits.dropped > 0) {
+			debug_print(addr.term_trans_tid, "sensor admin dropped %u hits up to poll %u\r\n", hits.dropped, hits.poll);
+		}
+		for (uint32_t i = 0; i < hits.count; i++) {
+			int sensor_index = hits.hits[i].sensor;
+			int event_tick = clock.to_tick(hits.hits[i].at);
+			// trains on a path go through their windows, plain subscriptions are for locating and calibration
+			int train_index = attribution.attribute(sensor_index, event_tick);
+			if (train_index == NO_TRAIN) {
+				train_index = sensor_owner(sensor_index);
+			}
+			if (train_index == NO_TRAIN) {
+				attribution.unclaimed(sensor_index);
+			} else {
+				sensor_subs.clear(train_index);
+				attribution.forget(train_index);
+				trains[train_index].sensor_notify(sensor_index, event_tick, hits.hits[i].at);
+			}
 		}
 	};
 
+	// nothing in here moves with the clock, so a train that is standing still isn't in the next delta
+	auto update_global_info = [&]() {
+		for (int i = 0; i < NUM_TRAINS; ++i) {
+			global_info[i].velocity = trains[i].getVelocity();
+			global_info[i].next_sensor = trains[i].localization.next_sensor;
+			int prev = trains[i].localization.last_node - track;
+			if (prev < TOTAL_SENSORS) {
+				global_info[i].prev_sensor = prev;
+			} else {
+				global_info[i].prev_sensor = NO_SENSOR;
+			}
+
+			if (!trains[i].localization.path.empty()) {
+				global_info[i].path_src = trains[i].localization.path.front();
+				global_info[i].path_dest = trains[i].localization.path.back();
+			} else {
+				global_info[i].path_src = NO_PATH;
+				global_info[i].path_dest = NO_PATH;
+			}
+
+			global_info[i].next_sensor_at
+				= clock.to_us(trains[i].localization.time_traveled + trains[i].localization.expected_arrival_ticks[0]);
+			global_info[i].eventual_velocity = trains[i].localization.eventual_velocity;
+		}
+	};
+
+	// subscribers see the train info as of the last sensor report, which is when most of it changes anyway
+	auto publish_global_info = [&]() {
+		update_global_info();
+		for (int i = 0; i < NUM_TRAINS; ++i) {
+			global_info_versions.set(i, global_info[i]);
+		}
+		global_info_versions.publish();
+	};
+
 	int from;
 	PlanningServerReq req;
 	while (true) {
@@ -2048,10 +2219,20 @@ void Planning::global_pathing_server() {
 		switch (req.header) {
 		case RequestHeader::GLOBAL_CLEAR_TO_SEND: {
 			courier_pool.receive(from);
-			char* sensor_state = req.body.sensor_state;
+			req_to_unblock.body.info = req.body.sensor_hits.poll;
 			courier_pool.request(&req_to_unblock);
 			// now we unblock each of the sensor if needed.
-			sensor_update(sensor_state);
+			sensor_update(req.body.sensor_hits);
+			publish_global_info();
+			break;
+		}
+		case RequestHeader::GLOBAL_SPEED_EGRESS: {
+			courier_pool.receive(from);
+			req_to_egress.body.info = req.body.egress.version;
+			courier_pool.request(&req_to_egress);
+			for (uint32_t i = 0; i < req.body.egress.count; i++) {
+				trains[req.body.egress.entries[i].index].speed_egress(req.body.egress.entries[i].value);
+			}
 			break;
 		}
 		case RequestHeader::GLOBAL_RNG: {
@@ -2081,7 +2262,7 @@ void Planning::global_pathing_server() {
 		case RequestHeader::GLOBAL_STOPPING_COMPLETE: {
 			courier_pool.receive(from);
 			int train_index = req.body.stopping_request.id;
-			trains[train_index].toIdle();
+			trains[train_index].toIdle(req.body.stopping_request.stop_sent);
 			break;
 		}
 
@@ -2232,32 +2413,19 @@ void Planning::global_pathing_server() {
 		}
 
 		case RequestHeader::GLOBAL_OBSERVE: {
-			for (int i = 0; i < NUM_TRAINS; ++i) {
-				global_info[i].velocity = trains[i].getVelocity();
-				global_info[i].next_sensor = trains[i].localization.next_sensor;
-				int prev = trains[i].localization.last_node - track;
-				if (prev < TOTAL_SENSORS) {
-					global_info[i].prev_sensor = prev;
-				} else {
-					global_info[i].prev_sensor = NO_SENSOR;
-				}
-
-				if (!trains[i].localization.path.empty()) {
-					global_info[i].path_src = trains[i].localization.path.front();
-					global_info[i].path_dest = trains[i].localization.path.back();
-				} else {
-					global_info[i].path_src = NO_PATH;
-					global_info[i].path_dest = NO_PATH;
-				}
+			update_global_info();
+			Reply::Reply(from, reinterpret_cast<char*>(global_info), sizeof(global_info));
+			break;
+		}
 
-				long current_time = Clock::Time(addr.clock_tid);
-				long tick_since_last_local = current_time - trains[i].localization.time_traveled;
-				global_info[i].time_to_next_sensor = trains[i].localization.expected_arrival_ticks[0] - tick_since_last_local;
-				global_info[i].dist_to_next_sensor
-					= global_info[i].time_to_next_sensor * trains[i].localization.eventual_velocity / TWO_DECIMAL_PLACE;
-			}
+		case RequestHeader::GLOBAL_SUBSCRIBE: {
+			global_info_versions.subscribe(from, req.body.info);
+			break;
+		}
 
-			Reply::Reply(from, reinterpret_cast<char*>(global_info), sizeof(global_info));
+		case RequestHeader::GLOBAL_SENSOR_RELIABILITY: {
+			const SensorReliability& r = attribution.reliability(req.body.info);
+			Reply::Reply(from, reinterpret_cast<const char*>(&r), sizeof(r));
 			break;
 		}
 
@@ -2287,7 +2455,10 @@ void Planning::global_pathing_courier() {
 	TrainAdminReq req_to_train;
 	Track::TrackServerReq req_to_track = {};
 
-	Sensor::SensorAdminReq req_to_sensor = { RequestHeader::SENSOR_AWAIT_STATE, 0x0 }; // this type of request doesn't need a body
+	Sensor::SensorAdminReq req_to_sensor;
+	req_to_sensor.header = RequestHeader::SENSOR_SUBSCRIBE;
+	// woken up by new hits, or after a few quiet polls so the train info published with them stays fresh
+	req_to_sensor.body.filter = Sensor::watch_all(Sensor::SensorTrigger::RISE, GLOBAL_INFO_REFRESH_POLLS);
 	etl::random_xorshift rng_boi = etl::random_xorshift();
 
 	// worker only has few types
@@ -2298,15 +2469,32 @@ void Planning::global_pathing_courier() {
 		case RequestHeader::GLOBAL_COUR_AWAIT_SENSOR: {
 			req_to_admin = { RequestHeader::GLOBAL_CLEAR_TO_SEND, RequestBody { 0x0 } };
 
+			req_to_sensor.body.filter.seen = req.body.info; // the poll global pathing has seen
 			Message::Send::Send(addr.sensor_admin_tid,
 								(const char*)&req_to_sensor,
 								sizeof(Sensor::SensorAdminReq),
-								(char*)&req_to_admin.body.sensor_state,
-								Sensor::NUM_SENSOR_BYTES);
+								(char*)&req_to_admin.body.sensor_hits,
+								sizeof(Sensor::SensorHits));
+			req_to_sensor.body.filter.fresh = false; // only the first wait starts from nothing
 			// now we have the next update time, we should notify trian admin that we are allow to sent again.
 			Message::Send::SendNoReply(addr.global_pathing_tid, (const char*)&req_to_admin, sizeof(req_to_admin));
 			break;
 		}
+		case RequestHeader::GLOBAL_COUR_AWAIT_EGRESS: {
+			Subscription::StateDelta<uint64_t, NUM_TRAINS> delta;
+			req_to_train.header = RequestHeader::TRAIN_SUBSCRIBE_EGRESS;
+			req_to_train.body.seen_version = req.body.info;
+			Message::Send::Send(
+				addr.train_admin_tid, (const char*)&req_to_train, sizeof(TrainAdminReq), (char*)&delta, sizeof(delta));
+			req_to_admin.header = RequestHeader::GLOBAL_SPEED_EGRESS;
+			req_to_admin.body.egress.version = delta.version;
+			req_to_admin.body.egress.count = delta.count;
+			for (uint32_t i = 0; i < delta.count; i++) {
+				req_to_admin.body.egress.entries[i] = delta.entries[i];
+			}
+			Message::Send::SendNoReply(addr.global_pathing_tid, (const char*)&req_to_admin, sizeof(req_to_admin));
+			break;
+		}
 		case RequestHeader::GLOBAL_COUR_BUSY_WAITING_AVAILABILITY: {
 			req_to_admin.header = RequestHeader::GLOBAL_BUSY_WAITING_AVAILABILITY;
 			req_to_admin.body.command = req.body.command;
@@ -2333,6 +2521,15 @@ void Planning::global_pathing_courier() {
 			Send::SendNoReply(addr.global_pathing_tid, (const char*)&req_to_admin, sizeof(req_to_admin));
 			break;
 		}
+		case RequestHeader::GLOBAL_COUR_EXPRESS_STOP: {
+			req_to_admin = { RequestHeader::GLOBAL_COURIER_COMPLETE, RequestBody { 0x0 } };
+
+			req_to_train.header = RequestHeader::TRAIN_EXPRESS_STOP;
+			req_to_train.body.express = req.body.express;
+			Send::SendNoReply(addr.train_admin_tid, reinterpret_cast<char*>(&req_to_train), sizeof(req_to_train));
+			Send::SendNoReply(addr.global_pathing_tid, (const char*)&req_to_admin, sizeof(req_to_admin));
+			break;
+		}
 		case RequestHeader::GLOBAL_COUR_REV: {
 			req_to_admin = { RequestHeader::GLOBAL_COURIER_COMPLETE, RequestBody { 0x0 } };
 
@@ -2348,6 +2545,7 @@ void Planning::global_pathing_courier() {
 			}
 			req_to_admin = { RequestHeader::GLOBAL_STOPPING_COMPLETE, RequestBody { 0x0 } };
 			req_to_admin.body.stopping_request.id = req.body.stopping_request.id;
+			req_to_admin.body.stopping_request.stop_sent = req.body.stopping_request.stop_sent;
 			Send::SendNoReply(addr.global_pathing_tid, (const char*)&req_to_admin, sizeof(req_to_admin));
 			break;
 		}
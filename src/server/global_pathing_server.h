@@ -9,6 +9,8 @@
 #include "../utils/utility.h"
 #include "courier_pool.h"
 #include "request_header.h"
+#include "sensor_attribution.h"
+#include "state_subscription.h"
 #include "track_server.h"
 #include "train_admin.h"
 using namespace Train;
@@ -40,6 +42,8 @@ const int RESERVE_AHEAD_MIN_SENSOR = 2;
 const int LOOK_AHEAD_SENSORS = 4;
 const int LOOK_AHEAD_DISTANCE = 2;
 const int PHASE_2_CALIBRATION_PAUSE = 700;
+// polls without a sensor hit before global pathing publishes train info anyway
+const int GLOBAL_INFO_REFRESH_POLLS = 3;
 
 const int SENSORS_PER_LETTER = 16;
 const int TOTAL_SENSORS = 80;
@@ -95,6 +99,7 @@ struct StoppingRequset {
 	uint64_t delay;
 	bool need_reverse;
 	TrainState future_state;
+	bool stop_sent; // GLOBAL_COUR_STOPPING, the stop went to train admin with a deadline already
 };
 
 struct PeddingRequest {
@@ -126,17 +131,26 @@ struct KnightRequest {
 	Track::PathRespond fake_response;
 };
 
+// GLOBAL_SPEED_EGRESS, the StateDelta the courier got from train admin for TRAIN_SUBSCRIBE_EGRESS
+struct SpeedEgress {
+	uint32_t version;
+	uint32_t count;
+	Subscription::StateEntry<uint64_t> entries[Train::NUM_TRAINS];
+};
+
 union RequestBody
 {
 	uint64_t info;
 	Command command;
+	Train::ExpressCommand express; // GLOBAL_COUR_EXPRESS_STOP
 	StoppingRequset stopping_request;
 	RoutingRequest routing_request;
 	CalibrationRequest calibration_request;
 	AccelerationCalibrationRequest calibration_request_acceleration;
 	PeddingRequest pedding_request;
 	KnightRequest knight_request;
-	char sensor_state[Sensor::NUM_SENSOR_BYTES];
+	Sensor::SensorHits sensor_hits;
+	SpeedEgress egress;
 };
 
 struct PlanningServerReq {
@@ -148,6 +162,67 @@ struct PlanningCourReq {
 	Message::RequestHeader header;
 	RequestBody body;
 } __attribute__((aligned(8)));
+
+/**
+ * Which trains wait on which sensor, as a bitmask of train indices per sensor, so a hit finds its trains with one load.
+ * A subscription is one shot, the first hit that goes to a train clears everything it was waiting on.
+ */
+class SensorSubscriptions {
+public:
+	static constexpr int ANY_SENSOR = -1; // calibration and locating, any sensor no other train is sitting on
+
+	void add(int train_index, int sensor) {
+		if (sensor == ANY_SENSOR) {
+			any |= 1 << train_index;
+		} else {
+			by_sensor[sensor] |= 1 << train_index;
+		}
+	}
+	void clear(int train_index) {
+		uint8_t keep = ~(1 << train_index);
+		any &= keep;
+		for (int i = 0; i < TOTAL_SENSORS; i++) {
+			by_sensor[i] &= keep;
+		}
+	}
+	uint8_t waiting_on(int sensor) const {
+		return by_sensor[sensor];
+	}
+	uint8_t waiting_on_any() const {
+		return any;
+	}
+
+private:
+	uint8_t by_sensor[TOTAL_SENSORS] = { 0 };
+	uint8_t any = 0;
+};
+static_assert(Train::NUM_TRAINS <= 8, "SensorSubscriptions keeps one bit per train");
+
+/**
+ * Sensor bytes and egress reports carry system times (us), the clock server counts ticks from its own start. Remembering
+ * where it was at one known system time converts between the two, and gives the current tick without asking it.
+ */
+class TickClock {
+public:
+	void anchor(int tick) {
+		anchor_us = Clock::system_time();
+		anchor_tick = tick;
+	}
+	int to_tick(uint64_t us) const {
+		return anchor_tick + (int)(((int64_t)us - (int64_t)anchor_us) / Clock::MICROS_PER_TICK);
+	}
+	uint64_t to_us(int64_t tick) const {
+		return (uint64_t)((int64_t)anchor_us + (tick - anchor_tick) * Clock::MICROS_PER_TICK);
+	}
+	int now() const {
+		return to_tick(Clock::system_time());
+	}
+
+private:
+	uint64_t anchor_us = 0;
+	int anchor_tick = 0;
+};
+
 class TrainStatus {
 public:
 	struct SpeedInfo {
@@ -165,7 +240,7 @@ public:
 	struct CalibrationState {
 		uint64_t slow_calibration_speed = 2; // speed level used for localization.
 		int64_t slow_calibration_mm = 0;
-		uint64_t last_trigger = 0;
+		uint64_t last_trigger_us = 0; // system time (us), calibration never rounds to ticks
 		uint64_t needed_trigger = 0;
 		int64_t distance_traveled_since_last_calibration = 0;
 		bool ignore_first = false;
@@ -204,6 +279,9 @@ public:
 		int64_t distance_traveled = 0;
 		// future sensor prediction related
 		int64_t time_traveled = 0;
+		int path_front_tick = 0; // when we passed the sensor at the front of the path
+		int sensor_tick = 0;	 // when the sensor being handled fired, from the uart interrupt rather than when we got to it
+		uint64_t sensor_us = 0;	 // same, as a system time (us)
 		int64_t eventual_velocity = 0;				// the desire velocity which we will be traveling on
 		int64_t previous_velocity = 0;				// the previous velocity which we were traveling on
 		int64_t expected_arrival_ticks[32] = { 0 }; // will be dropped / changed in the future
@@ -211,6 +289,7 @@ public:
 		int64_t sensor_ahead = 0;
 		int64_t acceleration = 0;			  // acceleration since the start of time
 		int acceleration_start_timestamp = 0; // when did we start to change speed
+		uint64_t acceleration_start_us = 0;	  // same, as a system time (us)
 		bool reverse_after = false;
 		int reverse_offset = 0;
 		bool deadlocked = false;
@@ -224,6 +303,8 @@ public:
 	bool is_next_branch();
 	// initialization related functions
 	bool isAccelerating(int current_time);
+	// the last speed command left the uart at tick, the train starts changing speed then and not when it was decided
+	void speed_egress(uint64_t egress_us);
 	void deadlock_init(bool deadlocked);
 	// setup function before setting state for each state transition
 	void locate();
@@ -275,13 +356,14 @@ public:
 	bool try_reserve(Track::TrackServerReq* reservation_request);
 	bool try_reserve_pre_fill(Track::TrackServerReq* reservation_request);
 	bool try_reserve_no_fill(Track::TrackServerReq* reservation_request);
+	void predict_switch_throws(Track::TrackServerReq* reservation_request);
 
 	bool try_reserve(Track::TrackServerReq* reservation_request, int total_len);
 
 	void cancel_reservation(Track::TrackServerReq* reservation_request);
 	void update_switch_state();
 
-	void sensor_notify(int sensor_index);
+	void sensor_notify(int sensor_index, int event_tick, uint64_t event_us);
 	void continuous_localization(int sensor_index);
 	void continuous_velocity_calibration();
 	void predict_future_sensor(int64_t* mm_look_ahead);
@@ -343,7 +425,9 @@ public:
 	// shared attribute with main thread
 	AddressBook addr;
 	Courier::CourierPool<PlanningCourReq, 32>* courier_pool = nullptr;
-	etl::list<etl::pair<int, etl::unordered_set<int, 32>>, Train::NUM_TRAINS>* sensor_subs = nullptr;
+	SensorSubscriptions* sensor_subs = nullptr;
+	SensorAttribution* attribution = nullptr;
+	const TickClock* clock = nullptr;
 
 	etl::queue<int, NUM_TRAIN_SUBS> train_sub;
 	track_node* track;
@@ -355,7 +439,7 @@ public:
 
 	bool is_knight = false;
 
-	void toIdle();
+	void toIdle(bool stop_sent = false);
 	void bunnyHopStopping();
 	void tryBunnyHopping();
 
@@ -364,6 +448,7 @@ private:
 	void pipe_tr();
 	void pipe_tr(char speed);
 	void pipe_rv();
+	void pipe_stop();
 	void toStopping(int64_t remaining_distance_NM);
 	void toMultiStopping(int64_t remaining_distance_NM);
 	void toMultiStoppingFromZero(int64_t remaining_distance_NM);
@@ -0,0 +1,245 @@
+#include "recorder.h"
+#include "../etl/circular_buffer.h"
+#include "../etl/vector.h"
+#include "../interrupt/clock.h"
+#include "../kernel.h"
+#include "../utils/telemetry.h"
+
+using namespace Recorder;
+using namespace Message;
+
+Mode Recorder::Append(int tid, RecordKind kind, const char* data, int len, uint64_t at) {
+	RecorderReq req;
+	req.header = RequestHeader::REC_APPEND;
+	req.body.record.at = at;
+	req.body.record.kind = kind;
+	req.body.record.len = (len > RECORD_DATA_LEN) ? RECORD_DATA_LEN : len;
+	for (int i = 0; i < req.body.record.len; i++) {
+		req.body.record.data[i] = data[i];
+	}
+	char mode = MODE_IDLE;
+	Send::Send(tid, reinterpret_cast<const char*>(&req), sizeof(req), &mode, 1);
+	return static_cast<Mode>(mode);
+}
+
+bool Recorder::NextReplay(int tid, RecordKind kind, bool wait, ReplayEvent* event) {
+	RecorderReq req;
+	req.header = RequestHeader::REC_REPLAY_NEXT;
+	req.body.replay = { kind, wait };
+	Send::Send(tid, reinterpret_cast<const char*>(&req), sizeof(req), reinterpret_cast<char*>(event), sizeof(ReplayEvent));
+	return event->record.kind != RECORD_NONE;
+}
+
+RecorderStatus Recorder::Control(int tid, RecorderOp op) {
+	RecorderReq req;
+	req.header = RequestHeader::REC_CONTROL;
+	req.body.op = op;
+	RecorderStatus status;
+	Send::Send(tid, reinterpret_cast<const char*>(&req), sizeof(req), reinterpret_cast<char*>(&status), sizeof(status));
+	return status;
+}
+
+void Recorder::recorder() {
+	Name::RegisterAs(RECORDER_NAME);
+	int dumper = Task::Create(Priority::TERMINAL_PRIORITY, &dump_courier);
+
+	etl::circular_buffer<Record, RECORD_RING_SIZE> ring; // oldest first, a full ring drops the oldest
+	etl::circular_buffer<Record, REPLAY_OUT_SIZE> replay_out;
+	bool recording = false;
+	uint32_t dropped = 0;
+
+	// replay walks the ring once per kind, every event is due at its offset from the first record
+	bool replaying = false;
+	uint64_t replay_start = 0;
+	int cursor[RECORD_TRAIN_OUT + 1] = { 0 };
+	struct Waiter {
+		int tid;
+		RecordKind kind;
+	};
+	etl::vector<Waiter, RECORDER_NUM_WAITERS> waiters;
+
+	// a dump pauses recording, so the ring doesn't move under it
+	bool dumping = false;
+	bool recording_before_dump = false;
+	RecordRing dump_ring = RING_RECORDED;
+	int dump_pos = 0;
+	bool dump_waiting = false;
+
+	// a dump only holds recording back, the backends keep sending so nothing has to tell them when it is over
+	auto mode = [&]() {
+		if (replaying) {
+			return MODE_REPLAYING;
+		}
+		return (recording || (dumping && recording_before_dump)) ? MODE_RECORDING : MODE_IDLE;
+	};
+
+	auto status = [&]() {
+		return RecorderStatus { recording, replaying, dumping, (uint32_t)ring.size(), (uint32_t)replay_out.size(), dropped, mode() };
+	};
+
+	// next event of that kind, RECORD_NONE once the ring has no more of them
+	auto next_event = [&](RecordKind kind) {
+		ReplayEvent event;
+		event.record.kind = RECORD_NONE;
+		while (replaying && cursor[kind] < (int)ring.size()) {
+			const Record& record = ring[cursor[kind]++];
+			if (record.kind == kind) {
+				event.due = replay_start + (record.at - ring.front().at);
+				event.record = record;
+				break;
+			}
+		}
+		return event;
+	};
+
+	auto reply_event = [&](int tid, const ReplayEvent& event) {
+		Reply::Reply(tid, reinterpret_cast<const char*>(&event), sizeof(event));
+	};
+
+	auto reply_dump = [&]() {
+		// the ring goes out as a plain record, the courier frames it
+		ReplayEvent out;
+		out.record.kind = RECORD_NONE;
+		out.due = dump_ring;
+		int size = (dump_ring == RING_RECORDED) ? ring.size() : replay_out.size();
+		if (dump_pos < size) {
+			out.record = (dump_ring == RING_RECORDED) ? ring[dump_pos] : replay_out[dump_pos];
+			// times are from the first record of the ring, so a dump fits in 32 bits
+			out.record.at -= (dump_ring == RING_RECORDED) ? ring.front().at : replay_out.front().at;
+			dump_pos += 1;
+		} else {
+			dumping = false;
+			recording = recording_before_dump;
+		}
+		reply_event(dumper, out);
+		dump_waiting = false;
+	};
+
+	int from;
+	RecorderReq req;
+	while (true) {
+		Receive::Receive(&from, (char*)&req, sizeof(req));
+		switch (req.header) {
+		case RequestHeader::REC_APPEND: {
+			char reply = mode();
+			Reply::Reply(from, &reply, 1);
+			if (replaying) {
+				// what the replayed run decided to write is the result, the inputs came from the ring
+				if (req.body.record.kind == RECORD_TRAIN_OUT) {
+					replay_out.push(req.body.record);
+				}
+			} else if (recording) {
+				dropped += ring.full() ? 1 : 0;
+				ring.push(req.body.record);
+			}
+			break;
+		}
+		case RequestHeader::REC_REPLAY_NEXT: {
+			ReplayEvent event = next_event(req.body.replay.kind);
+			if (event.record.kind != RECORD_NONE || !req.body.replay.wait) {
+				reply_event(from, event);
+			} else if (waiters.full()) {
+				Task::_KernelCrash("Recorder: too many replay backends waiting\r\n");
+			} else {
+				waiters.push_back(Waiter { from, req.body.replay.kind });
+			}
+			break;
+		}
+		case RequestHeader::REC_DUMP_NEXT: {
+			dump_waiting = true;
+			if (dumping) {
+				reply_dump();
+			}
+			break;
+		}
+		case RequestHeader::REC_CONTROL: {
+			switch (req.body.op) {
+			case OP_RECORD_OFF:
+				recording = false;
+				break;
+			case OP_RECORD_ON:
+				// a new recording starts from an empty ring
+				if (!recording && !replaying && !dumping) {
+					ring.clear();
+					dropped = 0;
+				}
+				recording = true;
+				break;
+			case OP_REPLAY_START:
+				if (!replaying && !dumping && !ring.empty()) {
+					replaying = true;
+					replay_out.clear();
+					replay_start = Clock::system_time();
+					for (int& c : cursor) {
+						c = 0;
+					}
+					for (const Waiter& waiter : waiters) {
+						reply_event(waiter.tid, next_event(waiter.kind));
+					}
+					waiters.clear();
+				}
+				break;
+			case OP_REPLAY_STOP:
+				replaying = false;
+				break;
+			case OP_DUMP_RECORDED:
+			case OP_DUMP_REPLAY_OUT:
+				if (!dumping) {
+					dumping = true;
+					recording_before_dump = recording;
+					recording = false;
+					dump_ring = (req.body.op == OP_DUMP_RECORDED) ? RING_RECORDED : RING_REPLAY_OUT;
+					dump_pos = 0;
+					if (dump_waiting) {
+						reply_dump();
+					}
+				}
+				break;
+			case OP_STATUS:
+				break;
+			}
+			RecorderStatus s = status();
+			Reply::Reply(from, reinterpret_cast<const char*>(&s), sizeof(s));
+			break;
+		}
+		default: {
+			Task::_KernelCrash("Recorder: illegal type: [%d]\r\n", req.header);
+		}
+		}
+
+		// a replay is over once every kind has been handed out, train admin goes back to the Marklin
+		if (replaying && cursor[RECORD_SENSOR] >= (int)ring.size() && cursor[RECORD_COMMAND] >= (int)ring.size()) {
+			replaying = false;
+		}
+	}
+}
+
+/**
+ * Writes a dump out as FRAME_RECORD telemetry frames, a few per tick so the terminal lane keeps up.
+ * An empty record ends the dump.
+ */
+void Recorder::dump_courier() {
+	AddressBook addr = getAddressBook();
+	int recorder_tid = Name::WhoIs(RECORDER_NAME);
+	char frame_buf[Telemetry::FRAME_BUFFER_SIZE];
+	RecorderReq req;
+	req.header = RequestHeader::REC_DUMP_NEXT;
+	ReplayEvent out;
+
+	int sent = 0;
+	while (true) {
+		Send::Send(recorder_tid, reinterpret_cast<const char*>(&req), sizeof(req), reinterpret_cast<char*>(&out), sizeof(out));
+		Telemetry::FrameWriter frame(frame_buf, Telemetry::FRAME_RECORD);
+		frame.put_u8((uint8_t)out.due); // ring
+		frame.put_u8(out.record.kind);
+		frame.put_u32((uint32_t)out.record.at);
+		frame.put_bytes(out.record.data, (out.record.kind == RECORD_NONE) ? 0 : out.record.len);
+		int len = frame.finish();
+		UART::Puts(addr.term_trans_tid, 0, frame_buf, len);
+
+		sent += 1;
+		if (sent % DUMP_FRAMES_PER_TICK == 0) {
+			Clock::Delay(addr.clock_tid, 1);
+		}
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../rpi.h"
+#include "request_header.h"
+#include <stdint.h>
+namespace Recorder
+{
+
+/**
+ * Keeps what went into and out of the track during a run: every sensor reading, every terminal command and every write
+ * to the Marklin, with the system time (us) it happened at. The ring keeps the newest RECORD_RING_SIZE events, and can
+ * be dumped over uart 0 as telemetry frames (recdump) or played back (replay).
+ *
+ * Playback feeds the sensor readings and commands back at their original timing through alternate backends, the sensor
+ * courier reads the ring instead of polling, and the terminal types the commands again. Train admin keeps deciding what
+ * to write, but the writes go to a second ring instead of the Marklin, so the output of a changed routing or
+ * reservation policy can be compared against the recorded one.
+ *
+ * Nothing is recorded until rec 1. Backends only talk to the recorder while it records or replays: they keep the Mode
+ * of its last reply, and the terminal hands them the new one after every rec or replay command.
+ */
+constexpr char RECORDER_NAME[] = "RECORDER";
+constexpr int RECORD_DATA_LEN = 62; // a terminal command fits
+constexpr int RECORD_RING_SIZE = 2048;
+constexpr int REPLAY_OUT_SIZE = 512;
+constexpr int RECORDER_NUM_WAITERS = 4;
+constexpr int DUMP_FRAMES_PER_TICK = 2; // ~150 bytes per tick keeps the terminal lane from dropping frames
+
+enum RecordKind : uint8_t {
+	RECORD_NONE = 0, // end of a dump, nothing left to replay
+	RECORD_SENSOR,	 // 10 sensor bytes, the poll latency (u32 us), then how long before the last byte each came in (u32 us)
+	RECORD_COMMAND,	 // terminal command, without the \r
+	RECORD_TRAIN_OUT // bytes train admin wrote to the Marklin
+};
+
+enum RecordRing : uint8_t { RING_RECORDED = 0, RING_REPLAY_OUT = 1 };
+
+struct Record {
+	uint64_t at;
+	RecordKind kind;
+	uint8_t len;
+	char data[RECORD_DATA_LEN];
+};
+
+// what a replay backend gets, due is the system time (us) to act at
+struct ReplayEvent {
+	uint64_t due;
+	Record record;
+};
+
+struct ReplayRequest {
+	RecordKind kind;
+	bool wait; // block until a replay has an event of this kind, instead of answering RECORD_NONE
+};
+
+// what backends do with their events, and whether they tell the recorder about them at all
+enum Mode : char { MODE_IDLE = 0, MODE_RECORDING = 1, MODE_REPLAYING = 2 };
+
+enum RecorderOp : uint8_t { OP_STATUS, OP_RECORD_OFF, OP_RECORD_ON, OP_REPLAY_START, OP_REPLAY_STOP, OP_DUMP_RECORDED, OP_DUMP_REPLAY_OUT };
+
+struct RecorderStatus {
+	bool recording;
+	bool replaying;
+	bool dumping;
+	uint32_t records;
+	uint32_t replay_out;
+	uint32_t dropped; // overwritten because the ring was full
+	Mode mode;
+};
+
+union RequestBody
+{
+	uint64_t info;
+	Record record;
+	ReplayRequest replay;
+	RecorderOp op;
+};
+
+struct RecorderReq {
+	Message::RequestHeader header;
+	RequestBody body;
+} __attribute__((aligned(8)));
+
+void recorder();
+void dump_courier();
+
+// REC_APPEND, at is the system time of the event, replies what the caller should do with its next events
+Mode Append(int tid, RecordKind kind, const char* data, int len, uint64_t at);
+// REC_REPLAY_NEXT, false once there is nothing of that kind to replay
+bool NextReplay(int tid, RecordKind kind, bool wait, ReplayEvent* event);
+RecorderStatus Control(int tid, RecorderOp op);
+
+}
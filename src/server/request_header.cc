@@ -2,6 +2,7 @@
 #include "clock_server.h"
 #include "global_pathing_server.h"
 #include "local_pathing_server.h"
+#include "recorder.h"
 #include "train_admin.h"
 #include "uart_server.h"
 #include "track_server.h"
@@ -18,6 +19,7 @@ Message::AddressBook Message::getAddressBook() {
 	book.terminal_admin_tid = Name::WhoIs(Terminal::TERMINAL_ADMIN);
 	book.global_pathing_tid = Name::WhoIs(Planning::GLOBAL_PATHING_SERVER_NAME);
 	book.track_server_tid = Name::WhoIs(Track::TRACK_SERVER_NAME);
+	book.recorder_tid = Name::WhoIs(Recorder::RECORDER_NAME);
 
 	char buf[Name::MAX_NAME_LENGTH];
 	for (int i = 0; i < Train::NUM_TRAINS; ++i) {
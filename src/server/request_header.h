@@ -25,7 +25,11 @@ enum class RequestHeader : uint32_t {
 	// sensor related
 	SENSOR_UPDATE,
 	SENSOR_AWAIT_STATE,
+	SENSOR_SUBSCRIBE, // filtered, replies a SensorHits once the filter matches
 	SENSOR_START_UPDATE,
+	SENSOR_HISTORY_QUERY, // replies a SensorLog, cut to its count
+	SENSOR_HISTORY_RATES, // replies a SensorRates
+	SENSOR_RECORDER_MODE, // from the terminal, passed on to the courier with its next poll
 
 	// sensor cour related
 	SENSOR_COUR_AWAIT_READING,
@@ -63,24 +67,42 @@ enum class RequestHeader : uint32_t {
 
 	// train related
 	TRAIN_SPEED,
+	TRAIN_EXPRESS_STOP, // skips the bus windows, written to the uart right away
+	TRAIN_EGRESS,		// from train_egress_courier, a tagged write has left the uart
+	TRAIN_SPEED_AT,		// held by the uart server until the due time, then written before anything queued
 	TRAIN_REV,
 	TRAIN_SWITCH,
+	TRAIN_SWITCH_ALL, // a direction per switch index, they go out in one burst
 	TRAIN_COURIER_COMPLETE,
 	TRAIN_SWITCH_DELAY_COMPLETE,
+	TRAIN_SWITCH_COALESCE_COMPLETE,
 	TRAIN_SENSOR_READING_COMPLETE,
 	TRAIN_OBSERVE,
+	TRAIN_SUBSCRIBE,
+	TRAIN_SUBSCRIBE_EGRESS, // replies a StateDelta of the system time (us) each train's last speed command left the uart
+	TRAIN_BUS_STATS,
+	TRAIN_RECORDER_MODE, // from the terminal after a rec or replay command
 
 	// train cour related
 	TRAIN_COUR_SWITCH_DELAY,
+	TRAIN_COUR_SWITCH_COALESCE,
 	TRAIN_COUR_SENSOR_START,
 
 	// uart related
 	UART_NOTIFY_RECEIVE,
 	UART_NOTIFY_TRANSMISSION,
-	UART_NOTIFY_CTS,
 	UART_GETC,
 	UART_PUTC,
 	UART_PUTS,
+	UART_AWAIT_EGRESS,		// uart 1, blocks until a tagged message is out, replies with an EgressReport
+	UART_NOTIFY_DEADLINE,	// uart 1, a deadline notifier woke up, replied to with the next due time of its slot
+	UART_DEADLINE_STATS,	// uart 1, replies with a DeadlineHistogram
+
+	// recorder related
+	REC_APPEND,		 // replies with a Mode
+	REC_CONTROL,	 // replies with a RecorderStatus
+	REC_REPLAY_NEXT, // from a replay backend, replies with a ReplayEvent
+	REC_DUMP_NEXT,	 // from the dump courier
 
 	// Global Pathing Related,
 	GLOBAL_SET_TRACK,			  // determine which trakc are you on
@@ -96,6 +118,7 @@ enum class RequestHeader : uint32_t {
 	GLOBAL_CALIBRATE_BASE_VELOCITY,
 	// at the specific sensor
 	GLOBAL_CLEAR_TO_SEND, // clear the dirty bit for train server to talk to
+	GLOBAL_SPEED_EGRESS,  // from the egress courier, speed commands that left the uart
 	GLOBAL_STOPPING_COMPLETE,
 	GLOBAL_MULTI_STOPPING_COMPLETE,
 	GLOBAL_MULTI_STOPPING_END,
@@ -119,7 +142,9 @@ enum class RequestHeader : uint32_t {
 
 	GLOBAL_COUR_INIT_TRACK,
 	GLOBAL_COUR_AWAIT_SENSOR,
+	GLOBAL_COUR_AWAIT_EGRESS,
 	GLOBAL_COUR_SPEED,
+	GLOBAL_COUR_EXPRESS_STOP,
 	GLOBAL_COUR_REV,
 	GLOBAL_COUR_MULTI_STOPPING,
 	GLOBAL_COUR_MULTI_STOPPING_END,
@@ -134,6 +159,8 @@ enum class RequestHeader : uint32_t {
 	GLOBAL_COUR_STOPPING_DISTANCE_PHASE_2_DELAY,
 	GLOBAL_COUR_CALIBRATE_VELOCITY,
 	GLOBAL_OBSERVE,
+	GLOBAL_SUBSCRIBE,
+	GLOBAL_SENSOR_RELIABILITY, // info is the sensor, replies its SensorReliability
 	GLOBAL_COUR_DEADLOCK_UNBLOCK,
 	GLOBAL_COUR_BUSY_WAITING_AVAILABILITY,
 	GLOBAL_COUR_BUSY_WAITING_BUNNY_HOPPING,
@@ -158,12 +185,16 @@ enum class RequestHeader : uint32_t {
 	TRACK_TRY_RESERVE,		 // provide a path of connected nodes, try to reserve the corresponding section of the tracks
 	TRACK_UNRESERVE,		 // used for unreserve your track once your usage is over
 	TRACK_COURIER_COMPLETE,	 // completion of courier with no side-affect
-	TRACK_SWITCH_SUBSCRIBE,	 // allowing arbitrary server to subscribe to the state of the switch
+	TRACK_SWITCH_SUBSCRIBE,	 // allowing arbitrary server to subscribe to the state of the switch, body is the last version seen
+	TRACK_RESERVE_SUBSCRIBE, // same as above, for the reservation state
 	TRACK_GET_SWITCH_STATE,	 // noneblocking, just get the most up-to-date switch state.
 	TRACK_GET_RESERVE_STATE, // get the up-to-date reservation state of the track
 	TRACK_RNG,				 // rng commands
+	TRACK_THROW_TICK,		 // time to look at the scheduled switch throws
 
 	TRACK_COUR_SWITCH,
+	TRACK_COUR_SWITCH_ALL,
+	TRACK_COUR_THROW_TIMER,
 };
 
 struct AddressBook {
@@ -177,6 +208,7 @@ struct AddressBook {
 	int terminal_admin_tid;
 	int global_pathing_tid;
 	int track_server_tid;
+	int recorder_tid;
 
 	int local_pathing_tids[10]; // I want this to be Trains::NUM_TRAINS, but circular dependencies :(
 };
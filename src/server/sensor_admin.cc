@@ -1,7 +1,56 @@
 #include "sensor_admin.h"
+#include "../etl/circular_buffer.h"
+#include "../etl/vector.h"
 #include "courier_pool.h"
+#include "recorder.h"
+#include "sensor_history.h"
+#include <stddef.h>
 using namespace Message;
 
+namespace
+{
+// a RECORD_SENSOR record: the bytes, the poll latency, then how long before the last byte each byte came in
+constexpr int SENSOR_RECORD_OFFSETS = Sensor::NUM_SENSOR_BYTES + sizeof(uint32_t);
+constexpr int SENSOR_RECORD_LEN = SENSOR_RECORD_OFFSETS + Sensor::NUM_SENSOR_BYTES * sizeof(uint32_t);
+static_assert(SENSOR_RECORD_LEN <= Recorder::RECORD_DATA_LEN, "a poll fits in one record");
+
+void pack_u32(char* out, uint32_t val) {
+	for (int i = 0; i < (int)sizeof(uint32_t); i++) {
+		out[i] = (char)(val >> (i * 8));
+	}
+}
+
+uint32_t unpack_u32(const char* in) {
+	return (uint8_t)in[0] | (uint8_t)in[1] << 8 | (uint8_t)in[2] << 16 | (uint32_t)(uint8_t)in[3] << 24;
+}
+}
+
+Sensor::SensorFilter Sensor::watch_all(SensorTrigger trigger, uint32_t max_polls) {
+	SensorFilter filter;
+	for (int i = 0; i < NUM_SENSOR_BYTES; i++) {
+		filter.mask[i] = (char)0xff;
+	}
+	filter.trigger = trigger;
+	filter.fresh = true;
+	filter.seen = 0;
+	filter.max_polls = max_polls;
+	return filter;
+}
+
+int Sensor::History(int tid, int sensor, uint64_t since, int max, SensorLog* out) {
+	SensorAdminReq req;
+	req.header = RequestHeader::SENSOR_HISTORY_QUERY;
+	req.body.history = HistoryQuery { (int16_t)sensor, (uint16_t)max, since };
+	Message::Send::Send(tid, reinterpret_cast<const char*>(&req), sizeof(req), reinterpret_cast<char*>(out), sizeof(SensorLog));
+	return out->count;
+}
+
+void Sensor::Rates(int tid, SensorRates* out) {
+	SensorAdminReq req;
+	req.header = RequestHeader::SENSOR_HISTORY_RATES;
+	Message::Send::Send(tid, reinterpret_cast<const char*>(&req), sizeof(req), reinterpret_cast<char*>(out), sizeof(SensorRates));
+}
+
 void Sensor::sensor_admin() {
 	Name::RegisterAs(SENSOR_ADMIN_NAME);
 	AddressBook addr = getAddressBook();
@@ -9,12 +58,74 @@ void Sensor::sensor_admin() {
 	// sensor subscribers
 	etl::queue<int, SENSOR_ADMIN_NUM_SUBSCRIBERS> subscribers;
 
+	/**
+	 * Filtered subscribers are only woken up by the sensors they care about. The last few readings are kept, so one that
+	 * was busy with the previous reply when a poll came in still sees it.
+	 */
+	struct Watcher {
+		int tid;
+		SensorFilter filter;
+	};
+	etl::vector<Watcher, SENSOR_ADMIN_NUM_SUBSCRIBERS> watchers;
+	etl::circular_buffer<SensorReading, SENSOR_HISTORY> history; // back is the newest poll
+	uint32_t poll = 0;
+	SensorHits hits;
+
+	// rising edges for history queries, the log outlives the few readings above
+	SensorHistory edges;
+	SensorLog log;
+	SensorRates rates;
+
+	// fills hits with what the filter wants to hear about since its seen poll, false if nothing yet
+	auto match = [&](const SensorFilter& filter) {
+		hits.poll = poll;
+		hits.count = 0;
+		hits.dropped = 0;
+		if (history.empty()) {
+			return false;
+		}
+		for (int i = 0; i < NUM_SENSOR_BYTES; i++) {
+			hits.state[i] = history.back().sensor_state[i];
+		}
+
+		bool changed = false;
+		// history[i] is poll (poll - size + 1 + i), an edge needs the poll in front of it, a fresh filter starts from all off
+		static const char all_off[NUM_SENSOR_BYTES] = { 0 };
+		int size = history.size();
+		int first = filter.fresh ? size - 1 : (int)(filter.seen - (poll - size + 1)) + 1;
+		for (int p = (first < 1 && !filter.fresh) ? 1 : first; p < size; p++) {
+			const char* before = (filter.fresh && p == first) ? all_off : history[p - 1].sensor_state;
+			const SensorReading& now = history[p];
+			for (int i = 0; i < NUM_SENSOR_BYTES; i++) {
+				uint8_t flipped = (uint8_t)((before[i] ^ now.sensor_state[i]) & filter.mask[i]);
+				changed = changed || flipped != 0;
+				for (uint32_t rising = flipped & (uint8_t)now.sensor_state[i]; rising != 0; rising &= rising - 1) {
+					if (hits.count < SENSOR_MAX_HITS) {
+						// the top bit is the lowest numbered sensor of the byte
+						hits.hits[hits.count++] = SensorHit { now.byte_at[i], (uint8_t)(i * CHAR_BIT + CHAR_BIT - 1 - __builtin_ctz(rising)) };
+					} else {
+						hits.dropped++;
+					}
+				}
+			}
+		}
+		bool quiet_too_long = !filter.fresh && filter.max_polls > 0 && poll - filter.seen >= filter.max_polls;
+		bool wanted = (filter.trigger == SensorTrigger::RISE) ? hits.count > 0 : changed || filter.fresh;
+		return wanted || quiet_too_long;
+	};
+
+	auto reply_hits = [&](int tid) {
+		int len = offsetof(SensorHits, hits) + hits.count * sizeof(SensorHit);
+		Message::Reply::Reply(tid, reinterpret_cast<const char*>(&hits), len);
+	};
+
 	// sensor couriers
 	int courier = Task::Create(Priority::HIGH_PRIORITY, &sensor_courier);
 	// sensor requests
 	int from;
 	SensorAdminReq req;
-	char sensor_state[NUM_SENSOR_BYTES] = { 0b10101010 };
+	SensorReading reading = {};
+	reading.sensor_state[0] = 0b10101010;
 	if (UART::Putc(addr.train_trans_tid, 1, 0xc0) == -1) {
 		Task::_KernelCrash("Failed to enable sensor\r\n");
 	}
@@ -24,26 +135,69 @@ void Sensor::sensor_admin() {
 		switch (req.header) {
 		case Message::RequestHeader::SENSOR_UPDATE: {
 			Message::Reply::EmptyReply(from); // after copying
-			for (int i = 0; i < NUM_SENSOR_BYTES; i++) {
-				sensor_state[i] = req.body.sensor_state[i];
+			if (!history.empty()) {
+				edges.record(history.back(), req.body.reading); // sensors already on at the first poll aren't edges
+			}
+			reading = req.body.reading;
+			history.push(reading);
+			poll += 1;
+			for (auto it = watchers.begin(); it != watchers.end();) {
+				if (match(it->filter)) {
+					reply_hits(it->tid);
+					it = watchers.erase(it);
+				} else {
+					++it;
+				}
 			}
 			while (!subscribers.empty()) {
-				// regular subscriber gets information on current sensor state
-				Message::Reply::Reply(subscribers.front(), sensor_state, NUM_SENSOR_BYTES);
+				// regular subscriber gets information on current sensor state, reply is cut to the size they receive into
+				Message::Reply::Reply(subscribers.front(), reinterpret_cast<const char*>(&reading), sizeof(SensorReading));
 				subscribers.pop();
 			}
 			break;
 		}
+		case Message::RequestHeader::SENSOR_HISTORY_QUERY: {
+			edges.query(req.body.history, &log);
+			int len = offsetof(SensorLog, hits) + log.count * sizeof(SensorHit);
+			Message::Reply::Reply(from, reinterpret_cast<const char*>(&log), len);
+			break;
+		}
+		case Message::RequestHeader::SENSOR_HISTORY_RATES: {
+			for (int i = 0; i < NUM_SENSORS; i++) {
+				rates.sensors[i] = edges.rate(i);
+			}
+			Message::Reply::Reply(from, reinterpret_cast<const char*>(&rates), sizeof(rates));
+			break;
+		}
 		case Message::RequestHeader::SENSOR_AWAIT_STATE: {
 			subscribers.push(from);
 			break;
 		}
+		case Message::RequestHeader::SENSOR_SUBSCRIBE: {
+			Watcher watcher = { from, req.body.filter };
+			if (match(watcher.filter)) {
+				reply_hits(from);
+				break;
+			} else if (watchers.full()) {
+				Task::_KernelCrash("Sensor Admin: too many filtered subscribers\r\n");
+			}
+			watchers.push_back(watcher);
+			break;
+		}
+		case Message::RequestHeader::SENSOR_RECORDER_MODE: {
+			Message::Reply::EmptyReply(from);
+			req_to_courier.body.recorder_changed = true;
+			req_to_courier.body.recorder_mode = req.body.recorder_mode;
+			break;
+		}
 		case Message::RequestHeader::SENSOR_START_UPDATE: {
 			/**
 			 * This call subscribe yourself to the right sensor while initializing a sensor reading
 			 */
 			subscribers.push(from);
+			req_to_courier.body.info = req.body.poll_gap;
 			Message::Send::SendNoReply(courier, (const char*)&req_to_courier, sizeof(SensorCourierReq));
+			req_to_courier.body.recorder_changed = false;
 			break;
 		}
 		default: {
@@ -60,19 +214,69 @@ void Sensor::sensor_courier() {
 
 	SensorCourierReq req;
 	SensorAdminReq req_to_admin;
+	Recorder::ReplayEvent replay;
+	Recorder::Mode recorder_mode = Recorder::MODE_IDLE; // from the recorder's last reply, or the terminal
+	UART::SensorFrame frame;
+	UART::SensorFrameMode(KERNEL_SENSOR_FRAMES);
 	while (true) {
 		Message::Receive::Receive(&from, (char*)&req, sizeof(SensorCourierReq));
 		Message::Reply::EmptyReply(from); // unblock caller right away
 		switch (req.header) {
 		case Message::RequestHeader::SENSOR_COUR_AWAIT_READING: {
-			UART::Putc(addr.train_trans_tid, 1, (char)133);
-			Clock::Delay(addr.clock_tid, SENSOR_DELAY); // actual delay time is managed by the main server
+			SensorReading& reading = req_to_admin.body.reading;
+			req_to_admin.header = Message::RequestHeader::SENSOR_UPDATE;
+			if (req.body.recorder_changed) {
+				recorder_mode = req.body.recorder_mode;
+			}
+			if (recorder_mode == Recorder::MODE_REPLAYING && Recorder::NextReplay(addr.recorder_tid, Recorder::RECORD_SENSOR, false, &replay)) {
+				// replaying, the reading comes out of the recorder at the time it was recorded, the Marklin isn't asked
+				uint64_t now = Clock::system_time();
+				if (replay.due > now) {
+					Clock::Delay(addr.clock_tid, (replay.due - now) / Clock::MICROS_PER_TICK);
+				}
+				// the bytes keep their spacing from the recorded poll, the last one lands at the due time
+				const char* data = replay.record.data;
+				for (int i = 0; i < NUM_SENSOR_BYTES; i++) {
+					reading.sensor_state[i] = data[i];
+					reading.byte_at[i] = replay.due - unpack_u32(data + SENSOR_RECORD_OFFSETS + i * sizeof(uint32_t));
+				}
+				reading.latency_us = unpack_u32(data + NUM_SENSOR_BYTES);
+				Message::Send::SendNoReply(addr.sensor_admin_tid, (const char*)&req_to_admin, sizeof(SensorAdminReq));
+				break;
+			}
 
-			for (int i = 0; i < NUM_SENSOR_BYTES; i++) {
-				req_to_admin.body.sensor_state[i] = UART::Getc(addr.train_receive_tid, 1);
+			if (req.body.info > 0) {
+				Clock::Delay(addr.clock_tid, req.body.info); // the gap is picked by train admin, see PollPacer
 			}
-			req_to_admin.header = Message::RequestHeader::SENSOR_UPDATE;
+			uint64_t requested_at = Clock::system_time();
+			UART::Putc(addr.train_trans_tid, 1, UART::SENSOR_FRAME_REQUEST);
+
+			if (KERNEL_SENSOR_FRAMES) {
+				Interrupt::AwaitEventWithBuffer(UART::UART_1_SENSOR_FRAME, reinterpret_cast<char*>(&frame), sizeof(frame));
+				for (int i = 0; i < NUM_SENSOR_BYTES; i++) {
+					reading.sensor_state[i] = frame.bytes[i];
+					reading.byte_at[i] = frame.byte_at[i];
+				}
+			} else {
+				// Getc blocks until the byte is in, the time comes from the interrupt so waking up late doesn't skew it
+				for (int i = 0; i < NUM_SENSOR_BYTES; i++) {
+					reading.sensor_state[i] = UART::GetcTimed(addr.train_receive_tid, 1, &reading.byte_at[i]);
+				}
+			}
+			uint64_t last_at = reading.byte_at[NUM_SENSOR_BYTES - 1];
+			reading.latency_us = (last_at > requested_at) ? last_at - requested_at : 0;
 			Message::Send::SendNoReply(addr.sensor_admin_tid, (const char*)&req_to_admin, sizeof(SensorAdminReq));
+
+			// recorded after sensor admin has the reading, a replay that ran out goes back to the Marklin the same way
+			if (recorder_mode != Recorder::MODE_IDLE) {
+				char record[SENSOR_RECORD_LEN];
+				for (int i = 0; i < NUM_SENSOR_BYTES; i++) {
+					record[i] = reading.sensor_state[i];
+					pack_u32(record + SENSOR_RECORD_OFFSETS + i * sizeof(uint32_t), last_at - reading.byte_at[i]);
+				}
+				pack_u32(record + NUM_SENSOR_BYTES, reading.latency_us);
+				recorder_mode = Recorder::Append(addr.recorder_tid, Recorder::RECORD_SENSOR, record, sizeof(record), last_at);
+			}
 			break;
 		}
 		default: {
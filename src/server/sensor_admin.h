@@ -3,7 +3,9 @@
 #include "../etl/queue.h"
 #include "../kernel.h"
 #include "../rpi.h"
+#include "recorder.h"
 #include "request_header.h"
+#include <climits>
 namespace Sensor
 {
 
@@ -11,16 +13,104 @@ constexpr char SENSOR_ADMIN_NAME[] = "SENSOR_ADMIN";
 constexpr int SENSOR_UART_CHANNEL = 1;
 constexpr int SENSOR_ADMIN_NUM_SUBSCRIBERS = 16;
 constexpr int NUM_SENSOR_BYTES = 10;
-constexpr int SENSOR_DELAY = 7;
+// readings kept for subscribers that come back after the next poll already went out
+constexpr int SENSOR_HISTORY = 8;
+constexpr int SENSOR_MAX_HITS = 16;
+constexpr int NUM_SENSORS = NUM_SENSOR_BYTES * CHAR_BIT;
+// rising edges kept for history queries, over all sensors and per sensor, a quiet sensor keeps its own past the log
+constexpr int SENSOR_LOG_SIZE = 128;
+constexpr int SENSOR_EDGES_PER_SENSOR = 8;
+constexpr int SENSOR_LOG_MAX_REPLY = 32;
+constexpr int HISTORY_ANY_SENSOR = -1;
+// the kernel collects the bytes of a poll and wakes the courier once, instead of a Getc per byte
+constexpr bool KERNEL_SENSOR_FRAMES = true;
+static_assert(NUM_SENSOR_BYTES == UART::SENSOR_FRAME_LEN, "a sensor frame is one poll");
 
 void sensor_admin();
 void sensor_courier();
 void courier_time_out();
 
 
+// what a poll brings back, subscribers that only want the state can receive the first NUM_SENSOR_BYTES
+struct SensorReading {
+	char sensor_state[NUM_SENSOR_BYTES];
+	uint32_t latency_us;				 // from queueing the 0x85 to the tenth byte
+	uint64_t byte_at[NUM_SENSOR_BYTES]; // system time (us) the uart interrupt for each byte fired
+};
+
+enum class SensorTrigger : uint8_t {
+	RISE,	// a sensor in the mask went from off to on
+	CHANGE, // a sensor in the mask went on or off, for views of the whole state
+};
+
+/**
+ * SENSOR_SUBSCRIBE, replied to once a poll after seen matches, subscribe again with the poll of the reply.
+ * A new subscriber sets fresh and has no seen poll, its first poll is measured against nothing being on, so RISE
+ * hears about sensors that were already on and CHANGE gets the current state right away.
+ */
+struct SensorFilter {
+	char mask[NUM_SENSOR_BYTES]; // bit per sensor, in the order the Marklin sends them
+	SensorTrigger trigger;
+	bool fresh;	   // first subscription, seen is ignored
+	uint32_t seen; // newest poll already replied with
+	uint32_t max_polls; // reply with nothing after this many polls, 0 to only reply on a match
+};
+
+SensorFilter watch_all(SensorTrigger trigger, uint32_t max_polls = 0);
+
+struct SensorHit {
+	uint64_t at; // system time (us) of the uart interrupt that brought the byte in
+	uint8_t sensor;
+};
+
+// only the first count hits are sent
+struct SensorHits {
+	uint32_t poll;	  // newest poll this covers
+	uint32_t count;	  // sensors that went on, oldest first
+	uint32_t dropped; // newer ones past SENSOR_MAX_HITS that did not fit, their edges are still in the history
+	char state[NUM_SENSOR_BYTES];
+	SensorHit hits[SENSOR_MAX_HITS];
+};
+
+/**
+ * SENSOR_HISTORY_QUERY, the newest max rising edges at or after since, of one sensor or of HISTORY_ANY_SENSOR.
+ * "C13 since t" is { C13, max, t }, "last k anywhere" is { HISTORY_ANY_SENSOR, k, 0 }.
+ */
+struct HistoryQuery {
+	int16_t sensor;
+	uint16_t max;
+	uint64_t since; // system time (us)
+};
+
+// only the first count hits are sent, oldest first
+struct SensorLog {
+	uint32_t count;
+	SensorHit hits[SENSOR_LOG_MAX_REPLY];
+};
+
+struct SensorRate {
+	uint32_t triggers;		   // rising edges since boot
+	uint32_t mean_interval_ms; // between the kept edges, 0 with fewer than two
+	uint64_t last_at;		   // system time (us) of the newest edge, 0 if it never fired
+};
+
+// SENSOR_HISTORY_RATES, indexed by sensor
+struct SensorRates {
+	SensorRate sensors[NUM_SENSORS];
+};
+
+// SENSOR_HISTORY_QUERY and SENSOR_HISTORY_RATES in a single Send each
+int History(int tid, int sensor, uint64_t since, int max, SensorLog* out);
+void Rates(int tid, SensorRates* out);
+
 union RequestBody {
 	char sensor_state[NUM_SENSOR_BYTES];
+	SensorReading reading;		  // SENSOR_UPDATE
+	SensorFilter filter;		  // SENSOR_SUBSCRIBE
+	HistoryQuery history;		  // SENSOR_HISTORY_QUERY
+	uint64_t poll_gap;			  // SENSOR_START_UPDATE, ticks to wait before the poll
 	uint64_t time_out_id;
+	Recorder::Mode recorder_mode; // SENSOR_RECORDER_MODE
 };
 
 struct SensorAdminReq {
@@ -31,6 +121,8 @@ struct SensorAdminReq {
 
 struct CourierRequestBody {
 	uint64_t info = 0;
+	bool recorder_changed = false; // the terminal changed what the recorder does since the last poll
+	Recorder::Mode recorder_mode = Recorder::MODE_IDLE;
 };
 
 struct SensorCourierReq {
@@ -0,0 +1,89 @@
+#include "sensor_attribution.h"
+
+using namespace Planning;
+
+void SensorAttribution::expect(int train, const ExpectedSensor* sensors, int count) {
+	expected[train].clear();
+	for (int i = 0; i < count && !expected[train].full(); i++) {
+		expected[train].push_back(sensors[i]);
+	}
+}
+
+void SensorAttribution::forget(int train) {
+	expected[train].clear();
+}
+
+void SensorAttribution::reopen(int train) {
+	for (ExpectedSensor& e : expected[train]) {
+		e.earliest = WINDOW_OPEN_EARLY;
+		e.latest = WINDOW_OPEN_LATE;
+	}
+}
+
+bool SensorAttribution::overdue(int train, int tick) const {
+	for (const ExpectedSensor& e : expected[train]) {
+		if (tick <= e.latest) {
+			return false;
+		}
+	}
+	return !expected[train].empty();
+}
+
+int SensorAttribution::attribute(int sensor, int tick) {
+	// the train that expects this sensor soonest on its path, several trains only wait on one sensor around a merge
+	int best = Train::NO_TRAIN;
+	int best_pos = ATTRIBUTION_MAX_EXPECTED;
+	bool rejected = false;
+	for (int train = 0; train < Train::NUM_TRAINS; train++) {
+		for (int pos = 0; pos < (int)expected[train].size() && pos < best_pos; pos++) {
+			const ExpectedSensor& e = expected[train][pos];
+			if (e.sensor != sensor) {
+				continue;
+			}
+			bool in_window = e.earliest <= tick && (tick <= e.latest || overdue(train, tick));
+			if (in_window) {
+				best = train;
+				best_pos = pos;
+			} else {
+				rejected = true;
+			}
+			break;
+		}
+	}
+
+	if (best != Train::NO_TRAIN) {
+		// the train is past every sensor it expected before this one
+		for (int pos = 0; pos < best_pos; pos++) {
+			sensors[expected[best][pos].sensor].missed += 1;
+		}
+		sensors[sensor].hits += 1;
+		expected[best].clear();
+	} else if (rejected) {
+		sensors[sensor].rejected += 1;
+	}
+	return best;
+}
+
+bool SensorAttribution::expected_by_any(int sensor) const {
+	for (int train = 0; train < Train::NUM_TRAINS; train++) {
+		for (const ExpectedSensor& e : expected[train]) {
+			if (e.sensor == sensor) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void SensorAttribution::unclaimed(int sensor) {
+	// a train waiting on it turned the hit down, attribute already counted it as rejected
+	if (!expected_by_any(sensor)) {
+		sensors[sensor].unclaimed += 1;
+	}
+}
+
+bool SensorAttribution::unreliable(int sensor) const {
+	const SensorReliability& r = sensors[sensor];
+	uint32_t samples = r.hits + r.missed;
+	return samples >= UNRELIABLE_MIN_SAMPLES && r.missed * 100 >= samples * UNRELIABLE_MISS_PERCENT;
+}
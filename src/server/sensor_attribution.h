@@ -0,0 +1,72 @@
+#pragma once
+
+#include "../etl/vector.h"
+#include "sensor_admin.h"
+#include "train_admin.h"
+#include <climits>
+#include <stdint.h>
+namespace Planning
+{
+
+constexpr int ATTRIBUTION_SENSORS = Sensor::NUM_SENSOR_BYTES * CHAR_BIT;
+// sensors a train waits on at once, sensors known to miss hits don't count toward it
+constexpr int ATTRIBUTION_DEPTH = 3;
+constexpr int ATTRIBUTION_MAX_EXPECTED = 6;
+// how far off the kinematic model may be, in both directions
+constexpr int ATTRIBUTION_SLACK_PERCENT = 35;
+constexpr int ATTRIBUTION_MIN_SLACK_TICKS = 30;
+// a train has to hold its speed this long before it reaches a sensor for its window to close on the late side
+constexpr int ATTRIBUTION_SETTLE_TICKS = 300;
+// a sensor that missed this share of the trains that passed it is expected past the depth
+constexpr int UNRELIABLE_MIN_SAMPLES = 4;
+constexpr int UNRELIABLE_MISS_PERCENT = 25;
+
+constexpr int WINDOW_OPEN_EARLY = 0;
+constexpr int WINDOW_OPEN_LATE = INT_MAX;
+
+// a sensor a train should reach next, earliest and latest are ticks
+struct ExpectedSensor {
+	int sensor;
+	int earliest;
+	int latest;
+};
+
+struct SensorReliability {
+	uint32_t hits = 0;		// attributed to a train
+	uint32_t missed = 0;	// a train was seen past it without it firing
+	uint32_t rejected = 0;	// fired outside the window of every train waiting on it
+	uint32_t unclaimed = 0; // fired while no train was waiting on it
+};
+
+/**
+ * Decides which train a sensor hit belongs to.
+ * Each train waits on the next few sensors of its path, every one with a window of ticks the kinematic model expects the
+ * train there. A hit inside a window goes to that train, and the sensors in front of it that stayed quiet are counted as
+ * missed. A hit outside every window is ignored, so a flicker doesn't make a train jump ahead on its path.
+ * A train that is past every latest tick waits with its windows open, being late is never a reason to lose it.
+ */
+class SensorAttribution {
+public:
+	// replaces what the train waits on, sensors in path order
+	void expect(int train, const ExpectedSensor* sensors, int count);
+	void forget(int train);
+	// the train changed speed, its windows don't hold anymore
+	void reopen(int train);
+	// the train the hit belongs to, or Train::NO_TRAIN, the train stops waiting once it has its hit
+	int attribute(int sensor, int tick);
+	// a hit that no train took, neither here nor as a plain subscription, counted once with the rejected ones
+	void unclaimed(int sensor);
+	bool unreliable(int sensor) const;
+	const SensorReliability& reliability(int sensor) const {
+		return sensors[sensor];
+	}
+
+private:
+	etl::vector<ExpectedSensor, ATTRIBUTION_MAX_EXPECTED> expected[Train::NUM_TRAINS];
+	SensorReliability sensors[ATTRIBUTION_SENSORS];
+
+	bool overdue(int train, int tick) const;
+	bool expected_by_any(int sensor) const;
+};
+
+}
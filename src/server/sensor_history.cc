@@ -0,0 +1,50 @@
+#include "sensor_history.h"
+
+using namespace Sensor;
+
+void SensorHistory::record(const SensorReading& before, const SensorReading& now) {
+	for (int i = 0; i < NUM_SENSOR_BYTES; i++) {
+		for (uint32_t rising = (uint8_t)(~before.sensor_state[i] & now.sensor_state[i]); rising != 0; rising &= rising - 1) {
+			// the top bit is the lowest numbered sensor of the byte
+			uint8_t sensor = i * CHAR_BIT + CHAR_BIT - 1 - __builtin_ctz(rising);
+			log.push(SensorHit { now.byte_at[i], sensor });
+			edges[sensor].push(now.byte_at[i]);
+			triggers[sensor] += 1;
+		}
+	}
+}
+
+int SensorHistory::query(const HistoryQuery& q, SensorLog* out) const {
+	int max = (q.max > SENSOR_LOG_MAX_REPLY || q.max == 0) ? SENSOR_LOG_MAX_REPLY : q.max;
+	bool one = q.sensor >= 0 && q.sensor < NUM_SENSORS;
+
+	// walk back from the newest until max are found or the edges get older than since
+	int first = one ? edges[q.sensor].size() : log.size();
+	int found = 0;
+	while (first > 0 && found < max) {
+		uint64_t at = one ? edges[q.sensor][first - 1] : log[first - 1].at;
+		if (at < q.since) {
+			break;
+		}
+		first -= 1;
+		found += 1;
+	}
+
+	for (int i = 0; i < found; i++) {
+		out->hits[i] = one ? SensorHit { edges[q.sensor][first + i], (uint8_t)q.sensor } : log[first + i];
+	}
+	out->count = found;
+	return found;
+}
+
+SensorRate SensorHistory::rate(int sensor) const {
+	const etl::circular_buffer<uint64_t, SENSOR_EDGES_PER_SENSOR>& e = edges[sensor];
+	SensorRate r = { triggers[sensor], 0, 0 };
+	if (!e.empty()) {
+		r.last_at = e.back();
+	}
+	if (e.size() > 1) {
+		r.mean_interval_ms = (e.back() - e.front()) / (e.size() - 1) / 1000;
+	}
+	return r;
+}
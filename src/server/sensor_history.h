@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../etl/circular_buffer.h"
+#include "sensor_admin.h"
+namespace Sensor
+{
+
+/**
+ * Timestamped rising edges, kept in one log for all sensors and in a short ring per sensor.
+ * Edges are found between two consecutive readings, and carry the interrupt time of the byte they came in.
+ */
+class SensorHistory {
+public:
+	void record(const SensorReading& before, const SensorReading& now);
+	// fills out with what the query asks for, returns the count
+	int query(const HistoryQuery& q, SensorLog* out) const;
+	SensorRate rate(int sensor) const;
+
+private:
+	etl::circular_buffer<SensorHit, SENSOR_LOG_SIZE> log; // back is the newest
+	etl::circular_buffer<uint64_t, SENSOR_EDGES_PER_SENSOR> edges[NUM_SENSORS];
+	uint32_t triggers[NUM_SENSORS] = { 0 };
+};
+
+}
@@ -0,0 +1,10 @@
+#include "state_subscription.h"
+#include "../kernel.h"
+
+void Subscription::send_delta(int tid, const char* delta, int len) {
+	Message::Reply::Reply(tid, delta, len);
+}
+
+void Subscription::too_many_subscribers() {
+	Task::_KernelCrash("Subscription: too many subscribers\r\n");
+}
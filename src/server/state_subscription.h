@@ -0,0 +1,112 @@
+#pragma once
+
+#include "../etl/queue.h"
+#include <stdint.h>
+namespace Subscription
+{
+
+const int MAX_SUBSCRIBERS = 4;
+constexpr uint32_t NOTHING_SEEN = 0; // version a new subscriber starts with, it gets a full snapshot
+
+// kernel.h includes terminal_admin.h, which needs the delta types, so the syscalls live in state_subscription.cc
+void send_delta(int tid, const char* delta, int len);
+void too_many_subscribers();
+
+template <typename T>
+struct StateEntry {
+	uint16_t index;
+	T value;
+};
+
+/**
+ * Reply to a subscriber, every entry that changed after the version it has last seen.
+ * Only the first count entries are sent, so the reply is as long as the change is.
+ */
+template <typename T, int N>
+struct StateDelta {
+	uint32_t version = NOTHING_SEEN;
+	uint32_t count = 0;
+	StateEntry<T> entries[N];
+};
+
+/**
+ * State of a server that other tasks want to follow without polling it.
+ * Every entry remembers the version it last changed in. A subscriber sends the version of the last delta it got,
+ * and is replied to right away if it is behind, or parked until the next publish() otherwise.
+ */
+template <typename T, int N>
+class VersionedState {
+public:
+	// stage a new value for entry i, subscribers only see it after publish()
+	void set(int i, const T& value);
+	const T& get(int i) const {
+		return values[i];
+	}
+	void subscribe(int tid, uint32_t seen);
+	// bump the version if anything changed since the last publish, and wake up every parked subscriber
+	void publish();
+
+private:
+	struct Waiter {
+		int tid;
+		uint32_t seen;
+	};
+
+	T values[N] = {};
+	uint32_t stamps[N] = { 0 };
+	uint32_t version = NOTHING_SEEN;
+	bool pending = false;
+	etl::queue<Waiter, MAX_SUBSCRIBERS> waiting;
+
+	void reply(int tid, uint32_t seen);
+};
+
+template <typename T, int N>
+void VersionedState<T, N>::set(int i, const T& value) {
+	if (values[i] != value) {
+		values[i] = value;
+		stamps[i] = version + 1;
+		pending = true;
+	}
+}
+
+template <typename T, int N>
+void VersionedState<T, N>::subscribe(int tid, uint32_t seen) {
+	if (seen < version) {
+		reply(tid, seen);
+	} else if (waiting.full()) {
+		too_many_subscribers();
+	} else {
+		waiting.push(Waiter { tid, seen });
+	}
+}
+
+template <typename T, int N>
+void VersionedState<T, N>::publish() {
+	if (!pending) {
+		return;
+	}
+	pending = false;
+	version += 1;
+	while (!waiting.empty()) {
+		reply(waiting.front().tid, waiting.front().seen);
+		waiting.pop();
+	}
+}
+
+template <typename T, int N>
+void VersionedState<T, N>::reply(int tid, uint32_t seen) {
+	StateDelta<T, N> delta;
+	delta.version = version;
+	for (int i = 0; i < N; i++) {
+		if (seen == NOTHING_SEEN || stamps[i] > seen) {
+			delta.entries[delta.count].index = i;
+			delta.entries[delta.count].value = values[i];
+			delta.count += 1;
+		}
+	}
+	int len = sizeof(delta) - (N - delta.count) * sizeof(StateEntry<T>);
+	send_delta(tid, reinterpret_cast<const char*>(&delta), len);
+}
+
+}
@@ -4,12 +4,18 @@
 #include "../etl/queue.h"
 #include "../server/global_pathing_server.h"
 #include "../server/local_pathing_server.h"
+#include "../server/recorder.h"
 #include "../server/track_server.h"
 #include "../server/train_admin.h"
+#include "bus_scheduler.h"
 #include "../utils/buffer.h"
+#include "../utils/format.h"
 #include "../utils/printf.h"
+#include "../utils/telemetry.h"
 #include "courier_pool.h"
+#include "terminal_screen.h"
 #include <climits>
+#include <cstddef>
 using namespace Terminal;
 using namespace Message;
 
@@ -150,6 +156,15 @@ void sw_to_cursor_pos(char sw, int* r, int* c) {
 	}
 }
 
+// Ticks and mm left to the train's next sensor at system time now, global pathing only publishes when it is due there
+long ticks_to_next_sensor(const GlobalTrainInfo& info, uint64_t now) {
+	return ((int64_t)info.next_sensor_at - (int64_t)now) / Clock::MICROS_PER_TICK;
+}
+
+long mm_to_next_sensor(const GlobalTrainInfo& info, uint64_t now) {
+	return ticks_to_next_sensor(info, now) * info.eventual_velocity / Planning::TWO_DECIMAL_PLACE;
+}
+
 // Given a train number and a UI request enum class, find the cursor position
 // of the train in the UI and return the x and y position as a pair
 etl::pair<int, int> train_to_cursor_pos(int train, TrainUIReq req) {
@@ -428,7 +443,9 @@ void Terminal::terminal_admin() {
 	Task::Create(Priority::TERMINAL_PRIORITY, &user_input_courier);
 	Task::Create(Priority::TERMINAL_PRIORITY, &switch_state_courier);
 	Task::Create(Priority::TERMINAL_PRIORITY, &train_state_courier);
+	Task::Create(Priority::TERMINAL_PRIORITY, &train_info_courier);
 	Task::Create(Priority::TERMINAL_PRIORITY, &reservation_courier);
+	Task::Create(Priority::TERMINAL_PRIORITY, &replay_command_courier);
 
 	bool isRunning = false;
 	bool isDebug = false;
@@ -447,7 +464,7 @@ void Terminal::terminal_admin() {
 	etl::deque<etl::pair<int, int>, RECENT_SENSOR_COUNT> recent_sensor = etl::deque<etl::pair<int, int>, RECENT_SENSOR_COUNT>();
 	bool sensor_table[Sensor::NUM_SENSOR_BYTES][CHAR_BIT] = { false };
 	char reserve_table[TRACK_MAX] = { 0 };
-	// bool reserve_dirty_bits[TRACK_MAX] = { false };
+	Screen screen;
 
 	int prev_train_sensors[Train::NUM_TRAINS] = {
 		Train::NO_TRAIN, Train::NO_TRAIN, Train::NO_TRAIN, Train::NO_TRAIN, Train::NO_TRAIN, Train::NO_TRAIN,
@@ -464,7 +481,7 @@ void Terminal::terminal_admin() {
 	bool accept_wasd = true; // Used to prevent WASD from being accepted more than once every 100ms
 
 	bool isSwitchStateModified = false;
-	char switch_state[Train::NUM_SWITCHES];
+	char switch_state[Train::NUM_SWITCHES] = { 0 };
 
 	bool isTrainStateModified = false;
 	Train::TrainRaw train_state[Train::NUM_TRAINS];
@@ -474,32 +491,109 @@ void Terminal::terminal_admin() {
 	bool abyssJumping = false;
 	int knight = KNIGHT;
 
+	bool isTelemetry = false; // binary frames instead of the ANSI dashboard, see utils/telemetry.h
+	Recorder::Mode recorder_mode = Recorder::MODE_IDLE; // commands are only sent to the recorder while it records
+	uint32_t telemetry_frames = 0;
+	uint32_t sensor_updates = 0;
+
 	WhichTrack which_track = WhichTrack::TRACK_A;
 	track_node track[TRACK_MAX];
 	init_tracka(track);
 
 	// This is used to keep track of number of activated sensors
 
-	auto trigger_print = [&]() {
-		if (isRunning) {
+	auto send_frame = [&](Telemetry::FrameWriter& frame, char* frame_buf) {
+		int len = frame.finish();
+		UART::Puts(addr.term_trans_tid, 0, frame_buf, len);
+		telemetry_frames += 1;
+	};
+
+	auto trigger_telemetry = [&]() {
+		char frame_buf[Telemetry::FRAME_BUFFER_SIZE];
+		{
+			Telemetry::FrameWriter frame(frame_buf, Telemetry::FRAME_COUNTERS);
+			frame.put_u32(ticks);
+			frame.put_u16(total_time == 0 ? 0 : idle_time * 10000 / total_time);
+			frame.put_u32(telemetry_frames);
+			frame.put_u32(sensor_updates);
+			send_frame(frame, frame_buf);
+		}
+		isIdleTimeModified = false; // carried by the counters frame
+
+		if (isSensorModified) {
+			isSensorModified = false;
+			Telemetry::FrameWriter frame(frame_buf, Telemetry::FRAME_SENSORS);
+			frame.put_u32(ticks);
+			frame.put_bytes(sensor_state, Sensor::NUM_SENSOR_BYTES);
+			send_frame(frame, frame_buf);
+		}
+
+		if (isSwitchStateModified) {
+			isSwitchStateModified = false;
+			Telemetry::FrameWriter frame(frame_buf, Telemetry::FRAME_SWITCHES);
+			frame.put_bytes(switch_state, Train::NUM_SWITCHES);
+			send_frame(frame, frame_buf);
+		}
+
+		if (isReserveModified) {
+			isReserveModified = false;
+			Telemetry::FrameWriter frame(frame_buf, Telemetry::FRAME_RESERVATIONS);
+			frame.put_bytes(reserve_table, TRACK_MAX);
+			send_frame(frame, frame_buf);
+		}
+
+		if (isTrainStateModified) {
+			isTrainStateModified = false;
+			Telemetry::FrameWriter frame(frame_buf, Telemetry::FRAME_TRAINS);
+			uint64_t now = Clock::system_time();
+			frame.put_u8(Train::NUM_TRAINS);
+			for (int i = 0; i < Train::NUM_TRAINS; ++i) {
+				frame.put_u8(Train::TRAIN_NUMBERS[i]);
+				frame.put_u8(train_state[i].speed);
+				frame.put_u8(train_state[i].direction);
+				frame.put_u32(global_train_info[i].velocity);
+				frame.put_u16(global_train_info[i].next_sensor);
+				frame.put_u16(global_train_info[i].prev_sensor);
+				frame.put_u32(ticks_to_next_sensor(global_train_info[i], now));
+				frame.put_u32(mm_to_next_sensor(global_train_info[i], now));
+				frame.put_u16(global_train_info[i].path_src);
+				frame.put_u16(global_train_info[i].path_dest);
+			}
+			send_frame(frame, frame_buf);
+		}
+	};
+
+	// Widgets only say what they want on screen, the screen works out what actually has to be sent
+	auto flush_screen = [&]() {
+		const int trailer = sizeof(WHITE_CURSOR) - 1 + sizeof(RESTORE_CURSOR) - 1;
+		while (screen.has_changes()) {
 			printing_index = 0;
 			str_cpy(SAVE_CURSOR_NO_JUMP, printing_buffer, &printing_index, sizeof(SAVE_CURSOR_NO_JUMP) - 1);
-			sprintf(buf, MOVE_CURSOR_F, UI_BOT, 1);
-			str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
+			printing_index += screen.render(printing_buffer + printing_index, UART::UART_MESSAGE_LIMIT - 1 - printing_index - trailer);
+			str_cpy(WHITE_CURSOR, printing_buffer, &printing_index, sizeof(WHITE_CURSOR) - 1);
+			str_cpy(RESTORE_CURSOR, printing_buffer, &printing_index, sizeof(RESTORE_CURSOR) - 1);
+			UART::Puts(addr.term_trans_tid, 0, printing_buffer, printing_index);
+		}
+	};
+
+	auto trigger_print = [&]() {
+		if (isRunning && isTelemetry) {
+			trigger_telemetry();
+		} else if (isRunning) {
 			log_time(buf, ticks);
-			str_cpy(buf, printing_buffer, &printing_index, 8);
+			buf[8] = '\0';
+			screen.put_str(UI_BOT, 1, buf);
 			if (isIdleTimeModified) {
 				isIdleTimeModified = false;
 				uint64_t leading = idle_time * 100 / total_time;
 				uint64_t trailing = (idle_time * 100000) / total_time % 1000;
 
-				sprintf(buf, "\033[%d;60HPercent: %llu.%03llu", UI_BOT, leading, trailing);
-				str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
+				Format::format<IDLE_PRINTOUT>(buf, leading, trailing);
+				screen.put_str(UI_BOT, 60, buf);
 			}
 
 			if (isSensorModified) {
 				isSensorModified = false;
-				str_cpy(SENSOR_CURSOR, printing_buffer, &printing_index, sizeof(SENSOR_CURSOR) - 1);
 				for (int i = 0; i < Sensor::NUM_SENSOR_BYTES; i++) {
 					for (int j = 1; j <= CHAR_BIT; j++) {
 						if (sensor_state[i] & (1 << (CHAR_BIT - j)) && !sensor_table[i][j - 1]) {
@@ -515,12 +609,14 @@ void Terminal::terminal_admin() {
 				}
 
 				// Print every sensor that has been activated
+				int col = SENSOR_COLUMN;
 				for (auto& it : recent_sensor) {
 					const char l = SENSOR_LETTERS[it.first / 2];
 					int pos = CHAR_BIT * (it.first % 2);
 					char ones = '0' + ((it.second + pos) % 10);
-					char write[4] = { l, ((it.second + pos > 9) ? '1' : '0'), ones, '|' };
-					str_cpy(write, printing_buffer, &printing_index, 4);
+					char write[5] = { l, ((it.second + pos > 9) ? '1' : '0'), ones, '|', '\0' };
+					screen.put_str(SENSOR_ROW, col, write);
+					col += 4;
 				}
 			}
 
@@ -529,70 +625,16 @@ void Terminal::terminal_admin() {
 				int r, c;
 				for (uint64_t i = 0; i < sizeof(switch_state); i++) {
 					sw_to_cursor_pos(i + 1, &r, &c);
-					sprintf(buf, "\033[%d;%dH%c", r, c, switch_state[i]);
-					str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
+					screen.put(r, c, switch_state[i]);
 				}
 			}
 
-			if (isReserveModified) {
-				isReserveModified = false;
-				for (int i = 0; i < Planning::TOTAL_SENSORS + 2 * Track::NUM_SWITCHES; ++i) {
-					// if (reserve_dirty_bits[i]) {
-					// 	reserve_dirty_bits[i] = false;
-					etl::pair<int, int> pos = track_node_to_reserve_cursor_pos(i);
-					if (pos.first == NO_NODE || contains<int>(curr_train_sensors, Train::NUM_TRAINS, i)) {
-						// bad node, or node that a train is sitting on
-						continue;
-					}
-
-					sprintf(buf, MOVE_CURSOR_F, pos.first, pos.second);
-					str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
-
-					int tindex = Train::train_num_to_index(reserve_table[i]);
-					const char* colour = (reserve_table[i] != 0) ? TRAIN_COLOURS[tindex] : GREEN_CURSOR;
-					str_cpy(colour, printing_buffer, &printing_index, sizeof(RED_CURSOR) - 1);
-
-					if (i < Planning::TOTAL_SENSORS) {
-						const int num = i % Planning::SENSORS_PER_LETTER + 1;
-						const char l = SENSOR_LETTERS[i / Planning::SENSORS_PER_LETTER];
-						const char ones = '0' + (num % 10);
-						const char write[3] = { l, (num > 9) ? '1' : '0', ones };
-						str_cpy(write, printing_buffer, &printing_index, 3);
-
-						// Try to modify it on the map as well
-						// const UIPosition* smap = TRACK_SENSORS[static_cast<int>(which_track)];
-						// const UIPosition p = smap[i];
-						// const char c = STOP_CHECK[i] ? '0' : 'o';
-						// sprintf(buf, MOVE_CURSOR_FO, p.r + TRACK_STARTING_ROW, p.c + TRACK_STARTING_COLUMN, c);
-						// str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
-					} else {
-						str_cpy(track[i].name, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
-					}
-					// }
-
-					if (printing_index > UART::UART_MESSAGE_LIMIT / 2) {
-						str_cpy(RESTORE_CURSOR, printing_buffer, &printing_index, sizeof(RESTORE_CURSOR) - 1);
-						UART::Puts(addr.term_trans_tid, 0, printing_buffer, printing_index);
-						printing_index = 0;
-						str_cpy(SAVE_CURSOR, printing_buffer, &printing_index, sizeof(SAVE_CURSOR) - 1);
-					}
-				}
-			}
-
-			str_cpy(RESTORE_CURSOR, printing_buffer, &printing_index, sizeof(RESTORE_CURSOR) - 1);
-			UART::Puts(addr.term_trans_tid, 0, printing_buffer, printing_index);
-			printing_index = 0;
-			str_cpy(SAVE_CURSOR, printing_buffer, &printing_index, sizeof(SAVE_CURSOR) - 1);
-			str_cpy(WHITE_CURSOR, printing_buffer, &printing_index, sizeof(WHITE_CURSOR) - 1);
-
 			if (isTrainStateModified) {
 				isTrainStateModified = false;
 				for (int i = 0; i < Train::NUM_TRAINS; ++i) {
 					int train_num = Train::TRAIN_NUMBERS[i];
 					for (int j = static_cast<int>(TrainUIReq::TrainUISpeedDir); j != static_cast<int>(TrainUIReq::DEFAULT); ++j) {
 						etl::pair<int, int> pos = train_to_cursor_pos(train_num, static_cast<TrainUIReq>(j));
-						int len = sprintf(buf, MOVE_CURSOR_F, pos.first, pos.second);
-						str_cpy(buf, printing_buffer, &printing_index, len);
 
 						switch (static_cast<TrainUIReq>(j)) {
 						case TrainUIReq::TrainUISpeedDir: {
@@ -600,7 +642,7 @@ void Terminal::terminal_admin() {
 							char dir = train_state[i].direction ? 'S' : 'R';
 
 							long vel = global_train_info[i].velocity;
-							sprintf(buf, TRAIN_PRINTOUT[j], speed, dir, relu(vel) / 100, relu(vel) % 100);
+							Format::format<TRAIN_PRINTOUT_L0>(buf, speed, dir, Format::Fixed2 { relu(vel) });
 							break;
 						}
 						case TrainUIReq::TrainUINextPrev: {
@@ -620,14 +662,15 @@ void Terminal::terminal_admin() {
 								curr_train_sensors[i] = prev - (prev % 2 == 1);
 							}
 
-							sprintf(buf, TRAIN_PRINTOUT[j], nc, nnum, pc, pnum);
+							Format::format<TRAIN_PRINTOUT_L1>(buf, nc, nnum, pc, pnum);
 							break;
 						}
 						case TrainUIReq::TrainUITimeDist: {
-							int t = global_train_info[i].time_to_next_sensor;
-							int d = global_train_info[i].dist_to_next_sensor;
+							uint64_t now = Clock::system_time();
+							int t = ticks_to_next_sensor(global_train_info[i], now);
+							int d = mm_to_next_sensor(global_train_info[i], now);
 
-							sprintf(buf, TRAIN_PRINTOUT[j], relu(t) % FOUR_DIGITS, relu(d) % FOUR_DIGITS);
+							Format::format<TRAIN_PRINTOUT_L2>(buf, relu(t) % FOUR_DIGITS, relu(d) % FOUR_DIGITS);
 							break;
 						}
 						case TrainUIReq::TrainUISrcDst: {
@@ -642,14 +685,14 @@ void Terminal::terminal_admin() {
 								Task::_KernelCrash("TrainUI: Invalid src/dst");
 							}
 
-							sprintf(buf, TRAIN_PRINTOUT[j], track[src].name, track[dst].name);
+							Format::format<TRAIN_PRINTOUT_L3>(buf, track[src].name, track[dst].name);
 							break;
 						}
 						case TrainUIReq::TrainUIBarge: {
 							int barge_count = global_train_info[i].barge_count;
 							int barge_weight = global_train_info[i].barge_weight;
 
-							sprintf(buf, TRAIN_PRINTOUT[j], barge_count, barge_weight % THREE_DIGITS);
+							Format::format<TRAIN_PRINTOUT_L4>(buf, barge_count, barge_weight % THREE_DIGITS);
 							break;
 						}
 						default: {
@@ -657,7 +700,7 @@ void Terminal::terminal_admin() {
 						}
 
 						} // switch
-						str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
+						screen.put_str(pos.first, pos.second, buf);
 
 						const UIPosition* smap = TRACK_SENSORS[static_cast<int>(which_track)];
 						if (prev_train_sensors[i] != curr_train_sensors[i]) {
@@ -665,14 +708,11 @@ void Terminal::terminal_admin() {
 								// set the previous sensor back to an o
 								const UIPosition p = smap[prev_train_sensors[i]];
 								const char c = STOP_CHECK[prev_train_sensors[i]] ? '0' : 'o';
-								sprintf(buf, MOVE_CURSOR_FO, p.r + TRACK_STARTING_ROW, p.c + TRACK_STARTING_COLUMN, c);
-								str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
+								screen.put(p.r + TRACK_STARTING_ROW, p.c + TRACK_STARTING_COLUMN, c);
 							}
 
-							str_cpy(TRAIN_COLOURS[i], printing_buffer, &printing_index, TERM_A_BUFLEN, true);
 							const UIPosition p = smap[curr_train_sensors[i]];
-							sprintf(buf, MOVE_CURSOR_FT, p.r + TRACK_STARTING_ROW, p.c + TRACK_STARTING_COLUMN);
-							str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
+							screen.put(p.r + TRACK_STARTING_ROW, p.c + TRACK_STARTING_COLUMN, GLYPH_TRAIN, TRAIN_SCREEN_COLOURS[i]);
 
 							prev_train_sensors[i] = curr_train_sensors[i];
 						}
@@ -684,33 +724,41 @@ void Terminal::terminal_admin() {
 								reached_targets[target_ind] = true;
 								int r = TARGET_ROW + 1;
 								int c = TARGET_COL + 2 + target_ind * TARGET_WIDTH;
-								sprintf(buf, MOVE_CURSOR_F, r, c);
-								str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
-								str_cpy(TRAIN_COLOURS[i], printing_buffer, &printing_index, TERM_A_BUFLEN, true);
-								str_cpy(TARGET_SENSORS[target_ind], printing_buffer, &printing_index, TERM_A_BUFLEN, true);
+								screen.put_str(r, c, TARGET_SENSORS[target_ind], TRAIN_SCREEN_COLOURS[i]);
 							} else if (finish_ind != HANDLE_FAIL && all_true<bool>(reached_targets, NUM_TARGETS)) {
-								int r = SCROLL_BOTTOM + 2;
-								sprintf(buf, MOVE_CURSOR_F, r, 1);
-								str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
-								str_cpy(WIN, printing_buffer, &printing_index, sizeof(WIN) - 1);
+								screen.put_str(SCROLL_BOTTOM + 2, 1, WIN);
 							}
 						}
+					}
+				}
+			}
 
-						str_cpy(WHITE_CURSOR, printing_buffer, &printing_index, sizeof(WHITE_CURSOR) - 1);
+			// Reservations go last, they depend on where the trains are
+			if (isReserveModified) {
+				isReserveModified = false;
+				for (int i = 0; i < Planning::TOTAL_SENSORS + 2 * Track::NUM_SWITCHES; ++i) {
+					etl::pair<int, int> pos = track_node_to_reserve_cursor_pos(i);
+					if (pos.first == NO_NODE || contains<int>(curr_train_sensors, Train::NUM_TRAINS, i)) {
+						// bad node, or node that a train is sitting on
+						continue;
 					}
 
-					str_cpy(RESTORE_CURSOR, printing_buffer, &printing_index, sizeof(RESTORE_CURSOR) - 1);
-					UART::Puts(addr.term_trans_tid, 0, printing_buffer, printing_index);
-					printing_index = 0;
-					str_cpy(SAVE_CURSOR, printing_buffer, &printing_index, sizeof(SAVE_CURSOR) - 1);
+					int tindex = Train::train_num_to_index(reserve_table[i]);
+					ScreenColour colour = (reserve_table[i] != 0) ? TRAIN_SCREEN_COLOURS[tindex] : COLOUR_GREEN;
+
+					if (i < Planning::TOTAL_SENSORS) {
+						const int num = i % Planning::SENSORS_PER_LETTER + 1;
+						const char l = SENSOR_LETTERS[i / Planning::SENSORS_PER_LETTER];
+						const char ones = '0' + (num % 10);
+						const char write[4] = { l, (num > 9) ? '1' : '0', ones, '\0' };
+						screen.put_str(pos.first, pos.second, write, colour);
+					} else {
+						screen.put_str(pos.first, pos.second, track[i].name, colour);
+					}
 				}
 			}
 
-			str_cpy(RESTORE_CURSOR, printing_buffer, &printing_index, sizeof(RESTORE_CURSOR) - 1);
-			if (printing_index >= UART::UART_MESSAGE_LIMIT) {
-				Task::_KernelCrash("Too much printing\r\n");
-			}
-			UART::Puts(addr.term_trans_tid, 0, printing_buffer, printing_index);
+			flush_screen();
 		}
 	};
 
@@ -749,19 +797,15 @@ void Terminal::terminal_admin() {
 			// 100ms clock update
 			Reply::EmptyReply(from);
 			ticks += 1;
+			// the time and distance to the next sensor count down between the deltas from global pathing
+			for (const GlobalTrainInfo& info : global_train_info) {
+				isTrainStateModified = isTrainStateModified || info.next_sensor_at > Clock::system_time();
+			}
 			trigger_print();
 
 			// Don't accept this more than once every 100ms
 			accept_wasd = true;
 
-			// Every now and again, clear out the reserve table because reservation printing is weird
-			if (ticks % 50 == 0) {
-				for (int i = 0; i < TRACK_MAX; ++i) {
-					reserve_table[i] = 0;
-					// reserve_dirty_bits[i] = true;
-				}
-			}
-
 			break;
 		}
 		case RequestHeader::TERM_SENSORS: {
@@ -772,6 +816,7 @@ void Terminal::terminal_admin() {
 				sensor_state[i] = req.body.worker_msg.msg[i];
 			}
 			isSensorModified = true;
+			sensor_updates += 1;
 			break;
 		}
 		case RequestHeader::TERM_IDLE: {
@@ -994,37 +1039,38 @@ void Terminal::terminal_admin() {
 		}
 		case RequestHeader::TERM_SWITCH: {
 			Reply::EmptyReply(from);
-			for (uint64_t i = 0; i < sizeof(switch_state); i++) {
-				switch_state[i] = req.body.worker_msg.msg[i];
+			const auto& delta = req.body.switch_delta;
+			for (uint32_t i = 0; i < delta.count; i++) {
+				switch_state[delta.entries[i].index] = delta.entries[i].value;
 			}
 			isSwitchStateModified = true;
 			break;
 		}
 		case RequestHeader::TERM_RESERVATION: {
 			Reply::EmptyReply(from);
-			for (int i = 0; i < TRACK_MAX; ++i) {
-				// reserve_dirty_bits[i] = (reserve_table[i] != req.body.reserve_state[i]);
-				isReserveModified = isReserveModified || (reserve_table[i] != req.body.reserve_state[i]);
-				reserve_table[i] = req.body.reserve_state[i];
+			const auto& delta = req.body.reserve_delta;
+			for (uint32_t i = 0; i < delta.count; i++) {
+				reserve_table[delta.entries[i].index] = delta.entries[i].value;
 			}
+			isReserveModified = true;
 			break;
 		}
 		case RequestHeader::TERM_TRAIN_STATUS: {
 			Reply::EmptyReply(from);
-			Train::TrainRaw* body = reinterpret_cast<Train::TrainRaw*>(req.body.worker_msg.msg);
-			for (int i = 0; i < Train::NUM_TRAINS; ++i) {
-				isTrainStateModified = isTrainStateModified || (train_state[i] != body[i]);
-				train_state[i] = body[i];
+			const auto& delta = req.body.train_delta;
+			for (uint32_t i = 0; i < delta.count; i++) {
+				train_state[delta.entries[i].index] = delta.entries[i].value;
 			}
+			isTrainStateModified = true;
 			break;
 		}
 		case RequestHeader::TERM_TRAIN_STATUS_MORE: {
 			Reply::EmptyReply(from);
-			GlobalTrainInfo* body = req.body.train_info;
-			for (int i = 0; i < TERM_NUM_TRAINS; ++i) {
-				isTrainStateModified = isTrainStateModified || (global_train_info[i] != body[i]);
-				global_train_info[i] = body[i];
+			const auto& delta = req.body.train_info_delta;
+			for (uint32_t i = 0; i < delta.count; i++) {
+				global_train_info[delta.entries[i].index] = delta.entries[i].value;
 			}
+			isTrainStateModified = true;
 			break;
 		}
 		case RequestHeader::TERM_PUTC: {
@@ -1181,6 +1227,13 @@ void Terminal::terminal_admin() {
 			} else if (c == '\r') {
 				cmd_history[cmd_history_index].cmd[char_count] = '\r';
 				GenericCommand cmd_parsed = handle_generic(cmd_history[cmd_history_index].cmd, which_track);
+				bool recorder_command = strncmp(cmd_parsed.name, "rec", MAX_COMMAND_LEN) == 0
+										|| strncmp(cmd_parsed.name, "recdump", MAX_COMMAND_LEN) == 0
+										|| strncmp(cmd_parsed.name, "replay", MAX_COMMAND_LEN) == 0;
+				if (!recorder_command && recorder_mode != Recorder::MODE_IDLE) {
+					recorder_mode = Recorder::Append(
+						addr.recorder_tid, Recorder::RECORD_COMMAND, cmd_history[cmd_history_index].cmd, char_count, Clock::system_time());
+				}
 
 				// Restore the cursor so functions can use debug printing unimpeded
 				// UART::PutsNullTerm(addr.term_trans_tid, 0, RESTORE_CURSOR, sizeof(RESTORE_CURSOR) - 1);
@@ -1232,11 +1285,9 @@ void Terminal::terminal_admin() {
 					} else {
 						int res = cmd_parsed.args.front();
 						if (res >= 0 && res < TRACK_MAX) {
-							// reserve_dirty_bits[res] = true;
 							reserve_table[res] = 24;
 						} else {
 							for (int i = 0; i < Planning::TOTAL_SENSORS + 2 * Track::NUM_SWITCHES; ++i) {
-								// reserve_dirty_bits[i] = true;
 								reserve_table[i] = 24;
 							}
 						}
@@ -1288,6 +1339,148 @@ void Terminal::terminal_admin() {
 					sprintf(buf, PROMPT_CURSOR, sizeof(PROMPT_NNL) + char_count);
 					str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
 
+				} else if (strncmp(cmd_parsed.name, "telem", MAX_COMMAND_LEN) == 0) {
+					// telem [0|1], toggles when no argument is given
+					isTelemetry = (cmd_parsed.args.size() > 0) ? (cmd_parsed.args.front() != 0) : !isTelemetry;
+					// start every stream from a full snapshot, and repaint everything when going back to text
+					isSensorModified = true;
+					isSwitchStateModified = true;
+					isReserveModified = true;
+					isTrainStateModified = true;
+					if (!isTelemetry) {
+						screen.invalidate();
+					}
+				} else if (strncmp(cmd_parsed.name, "bus", MAX_COMMAND_LEN) == 0) {
+					// queueing delay on the Marklin bus, per priority class
+					const char* class_names[] = { "stop", "speed", "rev", "switch" };
+					Train::TrainAdminReq req_to_train;
+					req_to_train.header = RequestHeader::TRAIN_BUS_STATS;
+					Train::BusStats stats;
+					Send::Send(addr.train_admin_tid,
+							   reinterpret_cast<char*>(&req_to_train),
+							   sizeof(req_to_train),
+							   reinterpret_cast<char*>(&stats),
+							   sizeof(stats));
+					debug_print(addr.term_trans_tid,
+								"windows: %u (%u full), bytes: %u\r\n",
+								stats.windows,
+								stats.full_windows,
+								stats.bytes);
+					for (int i = 0; i < Train::NUM_COMMAND_CLASSES; i++) {
+						const Train::BusClassStats& c = stats.classes[i];
+						uint32_t avg = (c.sent == 0) ? 0 : c.total_delay / c.sent / 1000;
+						debug_print(addr.term_trans_tid,
+									"%s: sent %u, pending %u, superseded %u, avg %ums, max %ums\r\n",
+									class_names[i],
+									c.sent,
+									c.pending,
+									c.superseded,
+									avg,
+									c.max_delay / 1000);
+					}
+					const Train::PollStats& p = stats.poll;
+					uint32_t response_avg = (p.polls == 0) ? 0 : p.total_response / p.polls / 1000;
+					debug_print(addr.term_trans_tid,
+								"polls: %u (%u late), reply avg %ums, max %ums, fastest %ums, window %d bytes, gap %d ticks\r\n",
+								p.polls,
+								p.late,
+								response_avg,
+								p.max_response / 1000,
+								p.baseline / 1000,
+								p.budget,
+								p.gap);
+					uint32_t express_avg = (stats.express_sent == 0) ? 0 : stats.express_total_delay / stats.express_sent;
+					debug_print(addr.term_trans_tid,
+								"express stops: sent %u, decision to wire avg %uus, max %uus\r\n",
+								stats.express_sent,
+								express_avg,
+								stats.express_max_delay);
+					UART::DeadlineHistogram deadlines;
+					UART::GetDeadlineHistogram(addr.train_trans_tid, &deadlines);
+					uint32_t deadline_avg = (deadlines.sent == 0) ? 0 : deadlines.total_late_us / deadlines.sent;
+					debug_print(addr.term_trans_tid,
+								"deadline commands: sent %u, late avg %uus, max %uus\r\n",
+								deadlines.sent,
+								deadline_avg,
+								deadlines.max_late_us);
+					char hist[256];
+					int hist_len = 0;
+					for (int i = 0; i < UART::DEADLINE_BUCKETS - 1; i++) {
+						hist_len += sprintf(hist + hist_len, "<=%uus: %u  ", UART::DEADLINE_BUCKET_US[i], deadlines.buckets[i]);
+					}
+					sprintf(hist + hist_len, "more: %u", deadlines.buckets[UART::DEADLINE_BUCKETS - 1]);
+					debug_print(addr.term_trans_tid, "%s\r\n", hist);
+				} else if (strncmp(cmd_parsed.name, "hist", MAX_COMMAND_LEN) == 0) {
+					// hist [sensor], the last rising edges anywhere, or of one sensor with how often it fires and how its hits were attributed
+					int sensor = (cmd_parsed.args.size() > 0) ? cmd_parsed.args.front() : Sensor::HISTORY_ANY_SENSOR;
+					if (cmd_parsed.args.size() > 0 && (sensor < 0 || sensor >= Sensor::NUM_SENSORS)) {
+						result = HANDLE_FAIL;
+					} else {
+						Sensor::SensorLog log;
+						Sensor::History(addr.sensor_admin_tid, sensor, 0, 10, &log);
+						uint64_t now = Clock::system_time();
+						for (uint32_t i = 0; i < log.count; i++) {
+							const Sensor::SensorHit& hit = log.hits[i];
+							debug_print(addr.term_trans_tid,
+										"%c%d %ums ago\r\n",
+										'A' + hit.sensor / Planning::SENSORS_PER_LETTER,
+										hit.sensor % Planning::SENSORS_PER_LETTER + 1,
+										(uint32_t)((now - hit.at) / 1000));
+						}
+						if (sensor != Sensor::HISTORY_ANY_SENSOR) {
+							Sensor::SensorRates rates;
+							Sensor::Rates(addr.sensor_admin_tid, &rates);
+							const Sensor::SensorRate& r = rates.sensors[sensor];
+							debug_print(addr.term_trans_tid, "triggers %u, every %ums on average\r\n", r.triggers, r.mean_interval_ms);
+
+							// how the hits went when global pathing gave them to trains
+							Planning::PlanningServerReq req_to_global;
+							req_to_global.header = RequestHeader::GLOBAL_SENSOR_RELIABILITY;
+							req_to_global.body.info = sensor;
+							Planning::SensorReliability reliability;
+							Send::Send(addr.global_pathing_tid,
+									   reinterpret_cast<char*>(&req_to_global),
+									   sizeof(req_to_global),
+									   reinterpret_cast<char*>(&reliability),
+									   sizeof(reliability));
+							debug_print(addr.term_trans_tid,
+										"attributed %u, missed %u, outside a window %u, unclaimed %u\r\n",
+										reliability.hits,
+										reliability.missed,
+										reliability.rejected,
+										reliability.unclaimed);
+						}
+					}
+				} else if (recorder_command) {
+					// rec [0|1], recdump [0 recorded|1 replay output], replay [0|1], status without an argument
+					int arg = (cmd_parsed.args.size() > 0) ? cmd_parsed.args.front() : -1;
+					Recorder::RecorderOp op = Recorder::OP_STATUS;
+					if (cmd_parsed.name[3] == '\0') {
+						op = (arg == 0) ? Recorder::OP_RECORD_OFF : (arg == 1) ? Recorder::OP_RECORD_ON : Recorder::OP_STATUS;
+					} else if (cmd_parsed.name[3] == 'd') {
+						op = (arg == 1) ? Recorder::OP_DUMP_REPLAY_OUT : Recorder::OP_DUMP_RECORDED;
+					} else {
+						op = (arg == 0) ? Recorder::OP_REPLAY_STOP : Recorder::OP_REPLAY_START;
+					}
+					Recorder::RecorderStatus status = Recorder::Control(addr.recorder_tid, op);
+					// the backends don't ask the recorder while it is idle, so they hear about it from here
+					recorder_mode = status.mode;
+					Train::TrainAdminReq req_to_train;
+					req_to_train.header = RequestHeader::TRAIN_RECORDER_MODE;
+					req_to_train.body.recorder_mode = status.mode;
+					Send::SendNoReply(addr.train_admin_tid, reinterpret_cast<char*>(&req_to_train), sizeof(req_to_train));
+					Sensor::SensorAdminReq req_to_sensor;
+					req_to_sensor.header = RequestHeader::SENSOR_RECORDER_MODE;
+					req_to_sensor.body.recorder_mode = status.mode;
+					Send::SendNoReply(addr.sensor_admin_tid, reinterpret_cast<char*>(&req_to_sensor), sizeof(req_to_sensor));
+					debug_print(addr.term_trans_tid,
+								"recording %d, replaying %d, dumping %d, records %u (%u dropped), replay output %u\r\n",
+								status.recording,
+								status.replaying,
+								status.dumping,
+								status.records,
+								status.dropped,
+								status.replay_out);
 				} else if (strncmp(cmd_parsed.name, "go", MAX_COMMAND_LEN) == 0) {
 					result = handle_global_pathing(courier_pool, cmd_parsed, RequestHeader::TERM_COUR_LOCAL_GO);
 				} else if (strncmp(cmd_parsed.name, "locate", MAX_COMMAND_LEN) == 0) {
@@ -1317,6 +1510,8 @@ void Terminal::terminal_admin() {
 								printing_index = 0;
 								Clock::Delay(addr.clock_tid, 2);
 							}
+							// the new diagram covers the train markers
+							screen.invalidate();
 
 							sprintf(buf, PROMPT_CURSOR, sizeof(PROMPT_NNL) + char_count);
 							str_cpy(buf, printing_buffer, &printing_index, TERM_A_BUFLEN, true);
@@ -1376,7 +1571,7 @@ void Terminal::terminal_admin() {
 				str_cpy(RESTORE_CURSOR, printing_buffer, &printing_index, sizeof(RESTORE_CURSOR) - 1);
 			}
 
-			UART::Puts(addr.term_trans_tid, 0, printing_buffer, printing_index);
+			UART::Puts(addr.term_trans_tid, 0, printing_buffer, printing_index, UART::LANE_ECHO);
 			break;
 		}
 		default: {
@@ -1511,12 +1706,20 @@ void Terminal::sensor_query_courier() {
 	int sensor_admin = Name::WhoIs(Sensor::SENSOR_ADMIN_NAME);
 	int terminal_tid = Name::WhoIs(Terminal::TERMINAL_ADMIN);
 	Sensor::SensorAdminReq req;
-	req.header = RequestHeader::SENSOR_AWAIT_STATE;
+	req.header = RequestHeader::SENSOR_SUBSCRIBE;
+	// the sensor table shows sensors going off as well, so any change, but nothing while the track is quiet
+	req.body.filter = Sensor::watch_all(Sensor::SensorTrigger::CHANGE);
+	Sensor::SensorHits hits;
 
 	Terminal::TerminalServerReq treq;
 	treq.header = RequestHeader::TERM_SENSORS;
 	while (true) {
-		Send::Send(sensor_admin, reinterpret_cast<char*>(&req), sizeof(Sensor::SensorAdminReq), treq.body.worker_msg.msg, Sensor::NUM_SENSOR_BYTES);
+		Send::Send(sensor_admin, reinterpret_cast<char*>(&req), sizeof(Sensor::SensorAdminReq), reinterpret_cast<char*>(&hits), sizeof(hits));
+		req.body.filter.fresh = false;
+		req.body.filter.seen = hits.poll;
+		for (int i = 0; i < Sensor::NUM_SENSOR_BYTES; i++) {
+			treq.body.worker_msg.msg[i] = hits.state[i];
+		}
 		Send::SendNoReply(terminal_tid, reinterpret_cast<char*>(&treq), sizeof(Terminal::TerminalServerReq));
 	}
 }
@@ -1555,6 +1758,33 @@ void Terminal::user_input_courier() {
 	}
 }
 
+/**
+ * Types the recorded commands again while a replay runs, each at the time it was entered, the same way
+ * user_input_courier hands over keystrokes.
+ */
+void Terminal::replay_command_courier() {
+	Terminal::TerminalServerReq treq;
+	treq.header = RequestHeader::TERM_PUTC;
+	AddressBook addr = getAddressBook();
+	Recorder::ReplayEvent replay;
+	while (true) {
+		if (!Recorder::NextReplay(addr.recorder_tid, Recorder::RECORD_COMMAND, true, &replay)) {
+			continue; // the replay had no commands left
+		}
+		uint64_t now = Clock::system_time();
+		if (replay.due > now) {
+			Clock::Delay(addr.clock_tid, (replay.due - now) / Clock::MICROS_PER_TICK);
+		}
+		for (int i = 0; i < replay.record.len; i++) {
+			treq.body.regular_msg = replay.record.data[i];
+			Send::SendNoReply(addr.terminal_admin_tid, reinterpret_cast<char*>(&treq), sizeof(Terminal::TerminalServerReq));
+		}
+		treq.body.regular_msg = '\r';
+		Send::SendNoReply(addr.terminal_admin_tid, reinterpret_cast<char*>(&treq), sizeof(Terminal::TerminalServerReq));
+	}
+}
+
+// The couriers below block on a subscription and forward whatever changed, the reply is only as long as the change
 void Terminal::switch_state_courier() {
 	Terminal::TerminalServerReq req_to_terminal;
 	Track::TrackServerReq req_to_track = {};
@@ -1562,16 +1792,13 @@ void Terminal::switch_state_courier() {
 
 	req_to_track.header = RequestHeader::TRACK_SWITCH_SUBSCRIBE;
 	req_to_terminal.header = RequestHeader::TERM_SWITCH;
-	req_to_terminal.body.worker_msg.msg_len = Train::NUM_SWITCHES;
-	int update_frequency = 100; // update once a second
+	auto& delta = req_to_terminal.body.switch_delta;
+	delta.version = Subscription::NOTHING_SEEN;
 	while (true) {
-		Send::Send(addr.track_server_tid,
-				   reinterpret_cast<char*>(&req_to_track),
-				   sizeof(req_to_track),
-				   req_to_terminal.body.worker_msg.msg,
-				   req_to_terminal.body.worker_msg.msg_len);
-		Send::SendNoReply(addr.terminal_admin_tid, reinterpret_cast<char*>(&req_to_terminal), sizeof(Terminal::TerminalServerReq));
-		Clock::Delay(addr.clock_tid, update_frequency);
+		req_to_track.body.info = delta.version;
+		int len = Send::Send(
+			addr.track_server_tid, reinterpret_cast<char*>(&req_to_track), sizeof(req_to_track), reinterpret_cast<char*>(&delta), sizeof(delta));
+		Send::SendNoReply(addr.terminal_admin_tid, reinterpret_cast<char*>(&req_to_terminal), offsetof(TerminalServerReq, body) + len);
 	}
 }
 
@@ -1580,44 +1807,51 @@ void Terminal::reservation_courier() {
 	Track::TrackServerReq req_to_track = {};
 	AddressBook addr = getAddressBook();
 
-	req_to_track.header = RequestHeader::TRACK_GET_RESERVE_STATE;
+	req_to_track.header = RequestHeader::TRACK_RESERVE_SUBSCRIBE;
 	req_to_terminal.header = RequestHeader::TERM_RESERVATION;
-	req_to_terminal.body.worker_msg.msg_len = TRACK_MAX;
-	int update_frequency = 100; // update once a second
+	auto& delta = req_to_terminal.body.reserve_delta;
+	delta.version = Subscription::NOTHING_SEEN;
 	while (true) {
-		Send::Send(
-			addr.track_server_tid, reinterpret_cast<char*>(&req_to_track), sizeof(req_to_track), req_to_terminal.body.reserve_state, TRACK_MAX);
-		Send::SendNoReply(addr.terminal_admin_tid, reinterpret_cast<char*>(&req_to_terminal), sizeof(Terminal::TerminalServerReq));
-		Clock::Delay(addr.clock_tid, update_frequency);
+		req_to_track.body.info = delta.version;
+		int len = Send::Send(
+			addr.track_server_tid, reinterpret_cast<char*>(&req_to_track), sizeof(req_to_track), reinterpret_cast<char*>(&delta), sizeof(delta));
+		Send::SendNoReply(addr.terminal_admin_tid, reinterpret_cast<char*>(&req_to_terminal), offsetof(TerminalServerReq, body) + len);
 	}
 }
 
 void Terminal::train_state_courier() {
 	Terminal::TerminalServerReq req_to_terminal;
 	Train::TrainAdminReq req_to_train;
+	AddressBook addr = getAddressBook();
+
+	req_to_train.header = RequestHeader::TRAIN_SUBSCRIBE;
+	req_to_terminal.header = RequestHeader::TERM_TRAIN_STATUS;
+	auto& delta = req_to_terminal.body.train_delta;
+	delta.version = Subscription::NOTHING_SEEN;
+	while (true) {
+		req_to_train.body.seen_version = delta.version;
+		int len = Send::Send(
+			addr.train_admin_tid, reinterpret_cast<char*>(&req_to_train), sizeof(req_to_train), reinterpret_cast<char*>(&delta), sizeof(delta));
+		Send::SendNoReply(addr.terminal_admin_tid, reinterpret_cast<char*>(&req_to_terminal), offsetof(TerminalServerReq, body) + len);
+	}
+}
+
+void Terminal::train_info_courier() {
+	Terminal::TerminalServerReq req_to_terminal;
 	Planning::PlanningServerReq req_to_global_planning;
 	AddressBook addr = getAddressBook();
 
-	req_to_train.header = RequestHeader::TRAIN_OBSERVE;
-	req_to_global_planning.header = RequestHeader::GLOBAL_OBSERVE;
-	int update_frequency = 100; // update once a second
+	req_to_global_planning.header = RequestHeader::GLOBAL_SUBSCRIBE;
+	req_to_terminal.header = RequestHeader::TERM_TRAIN_STATUS_MORE;
+	auto& delta = req_to_terminal.body.train_info_delta;
+	delta.version = Subscription::NOTHING_SEEN;
 	while (true) {
-		req_to_terminal.header = RequestHeader::TERM_TRAIN_STATUS;
-		req_to_terminal.body.worker_msg.msg_len = Train::NUM_TRAINS * sizeof(Train::TrainRaw);
-		Send::Send(addr.train_admin_tid,
-				   reinterpret_cast<char*>(&req_to_train),
-				   sizeof(Train::TrainAdminReq),
-				   req_to_terminal.body.worker_msg.msg,
-				   req_to_terminal.body.worker_msg.msg_len);
-		Send::SendNoReply(addr.terminal_admin_tid, reinterpret_cast<char*>(&req_to_terminal), sizeof(Terminal::TerminalServerReq));
-
-		req_to_terminal.header = RequestHeader::TERM_TRAIN_STATUS_MORE;
-		Send::Send(addr.global_pathing_tid,
-				   reinterpret_cast<char*>(&req_to_global_planning),
-				   sizeof(Planning::PlanningServerReq),
-				   reinterpret_cast<char*>(&req_to_terminal.body),
-				   sizeof(RequestBody));
-		Send::SendNoReply(addr.terminal_admin_tid, reinterpret_cast<char*>(&req_to_terminal), sizeof(Terminal::TerminalServerReq));
-		Clock::Delay(addr.clock_tid, update_frequency);
+		req_to_global_planning.body.info = delta.version;
+		int len = Send::Send(addr.global_pathing_tid,
+							 reinterpret_cast<char*>(&req_to_global_planning),
+							 sizeof(Planning::PlanningServerReq),
+							 reinterpret_cast<char*>(&delta),
+							 sizeof(delta));
+		Send::SendNoReply(addr.terminal_admin_tid, reinterpret_cast<char*>(&req_to_terminal), offsetof(TerminalServerReq, body) + len);
 	}
-}
\ No newline at end of file
+}
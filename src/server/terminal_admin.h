@@ -6,6 +6,7 @@
 #include "../utils/utility.h"
 #include "request_header.h"
 #include "sensor_admin.h"
+#include "state_subscription.h"
 #include "train_admin.h"
 
 namespace Terminal
@@ -24,7 +25,8 @@ constexpr char RESET_CURSOR[] = "\033[0m";
 constexpr char SAVE_CURSOR[] = "\033[s\033[H";
 constexpr char SAVE_CURSOR_NO_JUMP[] = "\033[s";
 constexpr char RESTORE_CURSOR[] = "\033[u";
-constexpr char SENSOR_CURSOR[] = "\033[44;2H";
+const int SENSOR_ROW = 44;
+const int SENSOR_COLUMN = 2;
 constexpr char BLACK_CURSOR[] = "\033[30m";
 constexpr char RED_CURSOR[] = "\033[31m";
 constexpr char GREEN_CURSOR[] = "\033[32m";
@@ -130,12 +132,12 @@ const char* const TRAIN_UI[] = { TRAIN_UI_L0, TRAIN_UI_L1, TRAIN_UI_L2,	 TRAIN_U
 
 enum class TrainUIReq { TrainUISpeedDir = 0, TrainUINextPrev, TrainUITimeDist, TrainUISrcDst, TrainUIBarge, DEFAULT };
 
-const char TRAIN_PRINTOUT_L0[] = ": %02d%c %03ld.%02ld";
-const char TRAIN_PRINTOUT_L1[] = "NxS: %c%02d PrS: %c%02d";
-const char TRAIN_PRINTOUT_L2[] = "T: %04dt P: %04dmm";
-const char TRAIN_PRINTOUT_L3[] = "S: %5s D: %5s";
-const char TRAIN_PRINTOUT_L4[] = "BgC: %03d BgW: %03d";
-const char* const TRAIN_PRINTOUT[] = { TRAIN_PRINTOUT_L0, TRAIN_PRINTOUT_L1, TRAIN_PRINTOUT_L2, TRAIN_PRINTOUT_L3, TRAIN_PRINTOUT_L4 };
+constexpr char TRAIN_PRINTOUT_L0[] = ": %02d%c %06.2f";
+constexpr char TRAIN_PRINTOUT_L1[] = "NxS: %c%02d PrS: %c%02d";
+constexpr char TRAIN_PRINTOUT_L2[] = "T: %04dt P: %04dmm";
+constexpr char TRAIN_PRINTOUT_L3[] = "S: %5s D: %5s";
+constexpr char TRAIN_PRINTOUT_L4[] = "BgC: %03d BgW: %03d";
+constexpr char IDLE_PRINTOUT[] = "Percent: %llu.%03llu";
 
 const char TRAIN_LEGEND[] = "██ %02d";
 
@@ -366,6 +368,8 @@ void user_input_courier();
 void switch_state_courier();
 void reservation_courier();
 void train_state_courier();
+void train_info_courier();
+void replay_command_courier();
 
 struct GenericCommand {
 	char name[MAX_COMMAND_LEN] = { 0 };
@@ -380,8 +384,8 @@ struct GlobalTrainInfo {
 	int next_sensor;
 	int prev_sensor;
 
-	long time_to_next_sensor; // expected time to next sensor in ticks
-	long dist_to_next_sensor; // expected distance to next sensor in mm
+	uint64_t next_sensor_at; // system time (us) the train is expected at next_sensor
+	long eventual_velocity;	 // the velocity it is settling into, the distance left is worked out from it
 
 	int path_src;
 	int path_dest;
@@ -391,7 +395,7 @@ struct GlobalTrainInfo {
 
 	friend bool operator==(const GlobalTrainInfo& lhs, const GlobalTrainInfo& rhs) {
 		return lhs.velocity == rhs.velocity && lhs.next_sensor == rhs.next_sensor && lhs.prev_sensor == rhs.prev_sensor
-			   && lhs.time_to_next_sensor == rhs.time_to_next_sensor && lhs.dist_to_next_sensor == rhs.dist_to_next_sensor
+			   && lhs.next_sensor_at == rhs.next_sensor_at && lhs.eventual_velocity == rhs.eventual_velocity
 			   && lhs.path_src == rhs.path_src && lhs.path_dest == rhs.path_dest && lhs.barge_count == rhs.barge_count
 			   && lhs.barge_weight == rhs.barge_weight;
 	}
@@ -410,8 +414,10 @@ union RequestBody
 {
 	char regular_msg;
 	WorkerRequestBody worker_msg;
-	GlobalTrainInfo train_info[TERM_NUM_TRAINS];
-	char reserve_state[TRACK_MAX];
+	Subscription::StateDelta<char, Train::NUM_SWITCHES> switch_delta;
+	Subscription::StateDelta<char, TRACK_MAX> reserve_delta;
+	Subscription::StateDelta<Train::TrainRaw, Train::NUM_TRAINS> train_delta;
+	Subscription::StateDelta<GlobalTrainInfo, TERM_NUM_TRAINS> train_info_delta;
 };
 
 struct TerminalServerReq {
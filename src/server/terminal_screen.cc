@@ -0,0 +1,130 @@
+#include "terminal_screen.h"
+#include "terminal_admin.h"
+#include "../utils/format.h"
+
+using namespace Terminal;
+
+namespace
+{
+const char* const SCREEN_COLOURS[] = { WHITE_CURSOR, RED_CURSOR, GREEN_CURSOR, YELLOW_CURSOR, BLUE_CURSOR, MAGENTA_CURSOR, CYAN_CURSOR };
+const char* const SCREEN_GLYPHS[] = { "", "▄" };
+const int NUM_SCREEN_GLYPHS = sizeof(SCREEN_GLYPHS) / sizeof(SCREEN_GLYPHS[0]);
+
+constexpr char CURSOR_FORWARD_F[] = "\033[%dC";
+
+// a full cursor move, a colour and the widest glyph
+const int RENDER_CELL_WORST = 10 + 5 + 4;
+// re-sending up to this many unchanged cells is no longer than a cursor forward
+const int REWRITE_LIMIT = 3;
+
+int emit(char* out, const char* s) {
+	int len = 0;
+	for (; s[len] != '\0'; len++) {
+		out[len] = s[len];
+	}
+	return len;
+}
+
+int emit_cell(char* out, char ch) {
+	if (ch > GLYPH_NONE && ch < NUM_SCREEN_GLYPHS) {
+		return emit(out, SCREEN_GLYPHS[(int)ch]);
+	}
+	out[0] = ch;
+	return 1;
+}
+}
+
+void Screen::put(int r, int c, char ch, ScreenColour colour) {
+	if (r < 1 || r > SCREEN_ROWS || c < 1 || c > SCREEN_COLS || ch == GLYPH_NONE) {
+		return;
+	}
+	ScreenCell& cell = wanted[r - 1][c - 1];
+	cell.ch = ch;
+	cell.colour = colour;
+	if (cell != shown[r - 1][c - 1]) {
+		row_dirty[r - 1] = true;
+	}
+}
+
+void Screen::put_str(int r, int c, const char* s, ScreenColour colour) {
+	for (int i = 0; s[i] != '\0' && s[i] != '\r' && s[i] != '\n' && c + i <= SCREEN_COLS; i++) {
+		put(r, c + i, s[i], colour);
+	}
+}
+
+bool Screen::has_changes() {
+	for (int r = 0; r < SCREEN_ROWS; r++) {
+		if (row_dirty[r]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Screen::can_rewrite(int r, int from, int to, int colour) {
+	if (to - from > REWRITE_LIMIT) {
+		return false;
+	}
+	for (int c = from; c < to; c++) {
+		// the cells in between must be plain characters that are already on screen in the current colour
+		if (shown[r][c].ch < ' ' || shown[r][c].colour != colour) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int Screen::render(char* out, int limit) {
+	int len = 0;
+	// where the terminal cursor is and what colour is set, unknown at the start of every render
+	int cursor_r = -1;
+	int cursor_c = -1;
+	int colour = -1;
+
+	for (int r = 0; r < SCREEN_ROWS; r++) {
+		if (!row_dirty[r]) {
+			continue;
+		}
+		for (int c = 0; c < SCREEN_COLS; c++) {
+			const ScreenCell& want = wanted[r][c];
+			if (want.ch == GLYPH_NONE || want == shown[r][c]) {
+				continue;
+			}
+			if (len + RENDER_CELL_WORST > limit) {
+				return len; // row stays dirty, the next call picks it up from here
+			}
+
+			if (cursor_r == r && cursor_c == c) {
+				// already there
+			} else if (cursor_r == r && cursor_c < c && can_rewrite(r, cursor_c, c, colour)) {
+				for (int k = cursor_c; k < c; k++) {
+					out[len++] = shown[r][k].ch;
+				}
+			} else if (cursor_r == r && cursor_c < c) {
+				len += Format::format<CURSOR_FORWARD_F>(out + len, c - cursor_c);
+			} else {
+				len += Format::format<MOVE_CURSOR_F>(out + len, r + 1, c + 1);
+			}
+
+			if (want.colour != colour) {
+				colour = want.colour;
+				len += emit(out + len, SCREEN_COLOURS[colour]);
+			}
+			len += emit_cell(out + len, want.ch);
+			shown[r][c] = want;
+			cursor_r = r;
+			cursor_c = c + 1;
+		}
+		row_dirty[r] = false;
+	}
+	return len;
+}
+
+void Screen::invalidate() {
+	for (int r = 0; r < SCREEN_ROWS; r++) {
+		for (int c = 0; c < SCREEN_COLS; c++) {
+			shown[r][c] = ScreenCell();
+		}
+		row_dirty[r] = true;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+
+namespace Terminal
+{
+constexpr int SCREEN_ROWS = 80;
+constexpr int SCREEN_COLS = 256;
+
+enum ScreenColour : uint8_t { COLOUR_WHITE = 0, COLOUR_RED, COLOUR_GREEN, COLOUR_YELLOW, COLOUR_BLUE, COLOUR_MAGENTA, COLOUR_CYAN };
+
+// 1, 2, 24, 58, 74, 78, same order as TRAIN_COLOURS
+constexpr ScreenColour TRAIN_SCREEN_COLOURS[] = { COLOUR_CYAN, COLOUR_RED, COLOUR_MAGENTA, COLOUR_WHITE, COLOUR_YELLOW, COLOUR_BLUE };
+
+// glyphs that are a single column on screen but more than one byte on the wire
+enum ScreenGlyph : char { GLYPH_NONE = 0, GLYPH_TRAIN = 1 };
+
+struct ScreenCell {
+	char ch = GLYPH_NONE; // GLYPH_NONE means unknown, it is never drawn and anything else is always different from it
+	uint8_t colour = COLOUR_WHITE;
+
+	friend bool operator==(const ScreenCell& lhs, const ScreenCell& rhs) {
+		return lhs.ch == rhs.ch && lhs.colour == rhs.colour;
+	}
+
+	friend bool operator!=(const ScreenCell& lhs, const ScreenCell& rhs) {
+		return !(lhs == rhs);
+	}
+};
+
+/**
+ * Virtual copy of the dynamic parts of the dashboard.
+ * Widgets write whatever they want shown into it, and render() emits only the cells that differ from what the terminal
+ * is already showing, with as few cursor moves and colour changes as it can. Rows and columns are 1 based, like the
+ * terminal itself.
+ */
+class Screen {
+public:
+	void put(int r, int c, char ch, ScreenColour colour = COLOUR_WHITE);
+	// one line of text, stops at the end of the string, a line break or the edge of the screen
+	void put_str(int r, int c, const char* s, ScreenColour colour = COLOUR_WHITE);
+	bool has_changes();
+	// writes at most limit bytes of escape sequences into out and returns the length, call again while has_changes()
+	int render(char* out, int limit);
+	// forget what the terminal shows, everything written so far is drawn again on the next render
+	void invalidate();
+
+private:
+	ScreenCell wanted[SCREEN_ROWS][SCREEN_COLS];
+	ScreenCell shown[SCREEN_ROWS][SCREEN_COLS];
+	bool row_dirty[SCREEN_ROWS] = { false };
+
+	bool can_rewrite(int r, int from, int to, int colour);
+};
+}
@@ -1,8 +1,12 @@
 
 #include "track_server.h"
+#include "../etl/algorithm.h"
 #include "../etl/queue.h"
+#include "../etl/vector.h"
 #include "../etl/unordered_set.h"
+#include "../routing/replanner.h"
 #include "../routing/track_data_new.h"
+#include "state_subscription.h"
 #include "train_admin.h"
 #include <climits>
 
@@ -11,14 +15,6 @@ using namespace Message;
 using namespace Routing;
 using namespace Task;
 
-char get_switch_index_to_id(int index) {
-	if (0 <= index && index <= 17) {
-		return '\0' + index + 1;
-	} else {
-		return '\0' + index - 18 + 153;
-	}
-}
-
 int get_switch_id_to_index(int id) {
 	if (1 <= id && id <= 18) {
 		return id - 1;
@@ -55,13 +51,18 @@ void Track::track_server() {
 	track_node track[TRACK_MAX];
 	etl::unordered_set<int, TRACK_MAX> train_wanted_nodes[Train::NUM_TRAINS];
 	init_tracka(track);
+	PathTable path_table;
 	Dijkstra dijkstra = Dijkstra(track);
+	dijkstra.build_table(&path_table);
+	// per train, toward the destination of its hot reroutes and toward that destination's reverse
+	Replanner replanners[Train::NUM_TRAINS][2];
 	char switch_state[NUM_SWITCHES];
 	for (int i = 0; i < NUM_SWITCHES; i++) {
 		switch_state[i] = '\0';
 	}
-	etl::queue<int, 4> switch_subscriber;
 	char reserve_state[TRACK_MAX];
+	Subscription::VersionedState<char, NUM_SWITCHES> switch_versions;
+	Subscription::VersionedState<char, TRACK_MAX> reserve_versions;
 
 	/**
 	 * 3 responsibilities
@@ -72,6 +73,14 @@ void Track::track_server() {
 
 	TrackCourierReq req_to_courier = {};
 
+	/**
+	 * Switches on a reserved path are thrown as late as the prediction allows, instead of as soon as the path is reserved,
+	 * so a switch stays free for other trains for as long as possible. At most one goes out per bus cycle, and a throw is
+	 * dropped if the train loses the reservation before it is due.
+	 */
+	etl::vector<ScheduledThrow, NUM_SWITCHES> scheduled_throws;
+	bool throw_timer = false;
+
 	auto owned_node = [&](int id) {
 		debug_print(addr.term_trans_tid, "owned: ");
 		for (int i = 0; i < TRACK_MAX; i++) {
@@ -104,10 +113,87 @@ void Track::track_server() {
 		}
 	};
 
+	// a track initialization sets every switch, one request to train admin so they leave in a single burst
+	auto pipe_all_sw = [&](const char* new_switch_state) {
+		req_to_courier.header = RequestHeader::TRACK_COUR_SWITCH_ALL;
+		for (int i = 0; i < NUM_SWITCHES; i++) {
+			switch_state[i] = new_switch_state[i];
+			req_to_courier.body.switches[i] = new_switch_state[i];
+		}
+		courier_pool.request(&req_to_courier);
+	};
+
+	auto drop_scheduled_throw = [&](char id) {
+		for (auto it = scheduled_throws.begin(); it != scheduled_throws.end(); it++) {
+			if (it->id == id) {
+				scheduled_throws.erase(it);
+				return;
+			}
+		}
+	};
+
+	auto drop_lost_throws = [&]() {
+		for (auto it = scheduled_throws.begin(); it != scheduled_throws.end();) {
+			if (track[it->node].reserved_by != it->train_id) {
+				it = scheduled_throws.erase(it);
+			} else {
+				it++;
+			}
+		}
+	};
+
+	auto start_throw_timer = [&]() {
+		if (!throw_timer && !scheduled_throws.empty()) {
+			throw_timer = true;
+			req_to_courier.header = RequestHeader::TRACK_COUR_THROW_TIMER;
+			courier_pool.request(&req_to_courier);
+		}
+	};
+
+	// throw the switch of a reserved branch now, or schedule it if the train is far enough away and there is room
+	auto throw_for_train = [&](track_node* node, char dir, int train_id, int64_t dist, const Reserve& reservation) {
+		drop_scheduled_throw(node->num);
+		if (reservation.velocity > 0 && !scheduled_throws.full()) {
+			// same prediction as expected_arrival_ticks in global pathing
+			int due = reservation.origin_tick + dist * 100 * 100 / reservation.velocity - SWITCH_THROW_LEAD_TICKS;
+			if (due > reservation.now_tick && switch_state[get_switch_id_to_index(node->num)] != dir) {
+				scheduled_throws.push_back(ScheduledThrow { due, node->index, (char)node->num, dir, train_id });
+				return false;
+			}
+		}
+		return pipe_sw(node->num, dir);
+	};
+
+	// earliest deadline first, but one throw per bus cycle, so a throw may have to start before its own deadline
+	auto throw_due_switches = [&](int now) {
+		drop_lost_throws();
+		if (scheduled_throws.empty()) {
+			return false;
+		}
+		etl::sort(scheduled_throws.begin(), scheduled_throws.end(), [](const ScheduledThrow& a, const ScheduledThrow& b) {
+			return a.due < b.due;
+		});
+		int start = INT_MAX;
+		for (int i = scheduled_throws.size() - 1; i >= 0; i--) {
+			start = etl::min(scheduled_throws[i].due, start - SWITCH_THROW_SPACING_TICKS);
+		}
+		if (start > now + SWITCH_THROW_SPACING_TICKS) {
+			return false;
+		}
+		ScheduledThrow next = scheduled_throws.front();
+		scheduled_throws.erase(scheduled_throws.begin());
+		return pipe_sw(next.id, next.dir);
+	};
+
 	// this is all hard coded, changes based on the condition of the track
 	auto tracka_initialization_sequence = [&]() {
 		init_tracka(track); // default configuration is part a
 		dijkstra = Dijkstra(track);
+		dijkstra.build_table(&path_table);
+		for (int i = 0; i < Train::NUM_TRAINS; i++) {
+			replanners[i][0].invalidate();
+			replanners[i][1].invalidate();
+		}
 		char new_switch_state[NUM_SWITCHES];
 
 		for (int i = 0; i < NUM_SWITCHES; i++) {
@@ -115,14 +201,17 @@ void Track::track_server() {
 		}
 		new_switch_state[18] = 's';
 		new_switch_state[20] = 's';
-		for (int i = 0; i < NUM_SWITCHES; i++) {
-			pipe_sw(get_switch_index_to_id(i), new_switch_state[i]);
-		}
+		pipe_all_sw(new_switch_state);
 	};
 
 	auto trackb_initialization_sequence = [&]() {
 		init_trackb(track); // default configuration is part a
 		dijkstra = Dijkstra(track);
+		dijkstra.build_table(&path_table);
+		for (int i = 0; i < Train::NUM_TRAINS; i++) {
+			replanners[i][0].invalidate();
+			replanners[i][1].invalidate();
+		}
 		char new_switch_state[NUM_SWITCHES];
 		for (int i = 0; i < NUM_SWITCHES; i++) {
 			new_switch_state[i] = 's';
@@ -131,18 +220,30 @@ void Track::track_server() {
 		new_switch_state[6] = 'c';
 		new_switch_state[18] = 'c';
 		new_switch_state[20] = 'c';
+		pipe_all_sw(new_switch_state);
+	};
+
+	auto publish_switch_state = [&]() {
 		for (int i = 0; i < NUM_SWITCHES; i++) {
-			pipe_sw(get_switch_index_to_id(i), new_switch_state[i]);
+			switch_versions.set(i, switch_state[i]);
 		}
+		switch_versions.publish();
 	};
 
-	auto reply_to_switch_subs = [&]() {
-		while (!switch_subscriber.empty()) {
-			Message::Reply::Reply(switch_subscriber.front(), switch_state, sizeof(switch_state));
-			switch_subscriber.pop();
+	auto update_reserve_state = [&]() {
+		for (int i = 0; i < TRACK_MAX; i++) {
+			reserve_state[i] = (track[i].reserved_by == RESERVED_BY_NO_ONE) ? 0 : track[i].reserved_by;
 		}
 	};
 
+	auto publish_reserve_state = [&]() {
+		update_reserve_state();
+		for (int i = 0; i < TRACK_MAX; i++) {
+			reserve_versions.set(i, reserve_state[i]);
+		}
+		reserve_versions.publish();
+	};
+
 	auto can_reserve = [&](track_node* node, int reserver_id) {
 		if (node->reserved_by == RESERVED_BY_NO_ONE || node->reserved_by == reserver_id) {
 			return true;
@@ -233,6 +334,68 @@ void Track::track_server() {
 		}
 	};
 
+	/**
+	 * Hot reroutes from one train keep asking for the same destination while bans and reservations shift under them, so
+	 * they are answered by the train's replanners, which only repair what changed since its last reroute. Same four
+	 * combinations and the same tie order as try_dijkstra. A path that reverses goes through decide_optimal_path, which
+	 * knows where to park past the merge.
+	 *
+	 * Repairing gets dearer with every node that changed, past REPLAN_CHURN_LIMIT of them a plain search is quicker. That
+	 * reroute goes to try_dijkstra and the replanners start over from the current state, ready for calmer reroutes.
+	 */
+	auto try_replanner = [&](PathRespond& res, int id, int source, int dest, etl::unordered_set<int, TRACK_MAX>& banned_node) {
+		Replanner* planners = replanners[Train::train_num_to_index(id)];
+		int dests[2] = { dest, track[dest].reverse->index };
+		int sources[2] = { source, track[source].reverse->index };
+		bool searched = false;
+		for (int d = 0; d < 2; d++) {
+			if (planners[d].get_goal() != dests[d] || planners[d].changes(banned_node) > REPLAN_CHURN_LIMIT) {
+				planners[d].reset(track, dests[d], banned_node);
+				searched = true;
+			}
+		}
+		if (searched) {
+			try_dijkstra(res, source, dest, banned_node, true);
+			return;
+		}
+		for (int d = 0; d < 2; d++) {
+			planners[d].update(banned_node);
+		}
+
+		res.successful = false;
+		res.cost = INT_MAX;
+		res.reverse = false;
+		int best_source = -1;
+		int best_dest = -1;
+		for (int d = 0; d < 2; d++) {
+			for (int s = 0; s < 2; s++) {
+				if (sources[s] == dests[d]) {
+					continue;
+				}
+				int cost = planners[d].cost_from(sources[s]);
+				if (cost < res.cost) {
+					res.cost = cost;
+					best_source = s;
+					best_dest = d;
+				}
+			}
+		}
+		if (best_source == -1) {
+			return;
+		}
+
+		int nodes;
+		if (planners[best_dest].walk(sources[best_source], res.path, &nodes, &res.path_len)) {
+			res.successful = true;
+			res.rev_offset = 0;
+			res.source = sources[best_source];
+			res.dest = dests[best_dest];
+		} else {
+			res.cost = INT_MAX;
+			decide_optimal_path(res, sources[best_source], dests[best_dest], banned_node);
+		}
+	};
+
 	// check all 4 branches !!!!
 	auto central_branch_safety = [&](int id) {
 		int result = -1;
@@ -473,6 +636,7 @@ void Track::track_server() {
 		Message::Receive::Receive(&from, (char*)&req, sizeof(TrackServerReq));
 		switch (req.header) {
 		case RequestHeader::TRACK_INIT: {
+			scheduled_throws.clear();
 			if (req.body.info == TRACK_A_ID) {
 				tracka_initialization_sequence();
 			} else if (req.body.info == TRACK_B_ID) {
@@ -480,7 +644,8 @@ void Track::track_server() {
 			} else {
 				_KernelCrash("trying to set the state of the track into impossible setting %d", req.body.info);
 			}
-			reply_to_switch_subs();
+			publish_switch_state();
+			publish_reserve_state();
 			Reply::EmptyReply(from);
 			break;
 		}
@@ -489,10 +654,7 @@ void Track::track_server() {
 			break;
 		}
 		case RequestHeader::TRACK_GET_RESERVE_STATE: {
-			for (int i = 0; i < TRACK_MAX; i++) {
-				reserve_state[i] = (track[i].reserved_by == RESERVED_BY_NO_ONE) ? 0 : track[i].reserved_by;
-			}
-
+			update_reserve_state();
 			Message::Reply::Reply(from, reserve_state, sizeof(reserve_state));
 			break;
 		}
@@ -510,8 +672,13 @@ void Track::track_server() {
 			char dir = req.body.command.action;
 			Reply::EmptyReply(from);
 
+			// a manual throw wins over one a train scheduled earlier
+			drop_scheduled_throw(id);
+			if (153 <= id && id <= 156) {
+				drop_scheduled_throw(get_rev_switch_id(id));
+			}
 			if (pipe_sw(id, dir)) {
-				reply_to_switch_subs();
+				publish_switch_state();
 			}
 			break;
 		}
@@ -552,6 +719,8 @@ void Track::track_server() {
 			for (int i = 0; i < len; i++) {
 				cancel_reserve(track[path[i]], id);
 			}
+			drop_lost_throws();
+			publish_reserve_state();
 			Reply::EmptyReply(from);
 			break;
 		}
@@ -571,16 +740,17 @@ void Track::track_server() {
 			// if you can reserve, then reserve
 			if (res.successful) {
 				train_wanted_nodes[Train::train_num_to_index(id)].clear();
+				bool thrown = false;
 				for (int i = 0; i < len; i++) {
 					track_node* node = &track[path[i]];
 					reserve(track[path[i]], id);
 					if (node->type == node_type::NODE_BRANCH) {
 						track_node* next_node = &track[path[i + 1]];
 						if (next_node == node->edge[DIR_STRAIGHT].dest) {
-							pipe_sw(node->num, 's');
+							thrown = throw_for_train(node, 's', id, res.res_dist, req.body.reservation) || thrown;
 							res.res_dist += node->edge[DIR_STRAIGHT].dist;
 						} else if (next_node == node->edge[DIR_CURVED].dest) {
-							pipe_sw(node->num, 'c');
+							thrown = throw_for_train(node, 'c', id, res.res_dist, req.body.reservation) || thrown;
 							res.res_dist += node->edge[DIR_CURVED].dist;
 						} else {
 							Task::_KernelCrash("impossible condition met, somehow there is no next node to inspect in track_server\r\n");
@@ -589,7 +759,11 @@ void Track::track_server() {
 						res.res_dist += node->edge[DIR_AHEAD].dist;
 					}
 				}
-				reply_to_switch_subs();
+				if (thrown) {
+					publish_switch_state();
+				}
+				publish_reserve_state();
+				start_throw_timer();
 			}
 			// return the reservation result
 			Reply::Reply(from, (const char*)&res, sizeof(res));
@@ -609,7 +783,7 @@ void Track::track_server() {
 			debug_print(addr.term_trans_tid, "\r\n");
 
 			PathRespond res;
-			try_dijkstra(res, source, dest, banned_node, true);
+			try_replanner(res, id, source, dest, banned_node);
 			Reply::Reply(from, (const char*)&res, sizeof(res));
 			break;
 		}
@@ -617,8 +791,21 @@ void Track::track_server() {
 			courier_pool.receive(from);
 			break;
 		}
+		case RequestHeader::TRACK_THROW_TICK: {
+			courier_pool.receive(from);
+			throw_timer = false;
+			if (throw_due_switches(Clock::Time(addr.clock_tid))) {
+				publish_switch_state();
+			}
+			start_throw_timer();
+			break;
+		}
 		case RequestHeader::TRACK_SWITCH_SUBSCRIBE: {
-			switch_subscriber.push(from);
+			switch_versions.subscribe(from, req.body.info);
+			break;
+		}
+		case RequestHeader::TRACK_RESERVE_SUBSCRIBE: {
+			reserve_versions.subscribe(from, req.body.info);
 			break;
 		}
 		default: {
@@ -649,6 +836,22 @@ void Track::track_courier() {
 			Send::SendNoReply(addr.track_server_tid, (const char*)&req_to_admin, sizeof(req_to_admin));
 			break;
 		}
+		case RequestHeader::TRACK_COUR_SWITCH_ALL: {
+			req_to_admin.header = RequestHeader::TRACK_COURIER_COMPLETE;
+			req_to_train.header = RequestHeader::TRAIN_SWITCH_ALL;
+			for (int i = 0; i < NUM_SWITCHES; i++) {
+				req_to_train.body.switches[i] = req.body.switches[i];
+			}
+			Send::SendNoReply(addr.train_admin_tid, reinterpret_cast<char*>(&req_to_train), sizeof(req_to_train));
+			Send::SendNoReply(addr.track_server_tid, (const char*)&req_to_admin, sizeof(req_to_admin));
+			break;
+		}
+		case RequestHeader::TRACK_COUR_THROW_TIMER: {
+			Clock::Delay(addr.clock_tid, SWITCH_THROW_SPACING_TICKS);
+			req_to_admin.header = RequestHeader::TRACK_THROW_TICK;
+			Send::SendNoReply(addr.track_server_tid, (const char*)&req_to_admin, sizeof(req_to_admin));
+			break;
+		}
 		default:
 			Task::_KernelCrash("Track Courier illegal type: [%d]\r\n", req.header);
 		} // switch
@@ -15,6 +15,11 @@ constexpr int SAFETY_DISTANCE = 400; // 40 cm or 400 mm
 
 constexpr int NUM_SWITCH_SUBS = 32;
 
+// a switch on a reserved path is thrown this long before the train is predicted to reach it
+constexpr int SWITCH_THROW_LEAD_TICKS = 30;
+// one bus cycle, scheduled throws go out at most one per cycle
+constexpr int SWITCH_THROW_SPACING_TICKS = 7;
+
 void track_server();
 void track_courier();
 
@@ -36,7 +41,20 @@ struct Reserve {
 	int path[Routing::PATH_LIMIT] = { -1 };
 	int len_until_reservation = 0;
 	int total_len = 0;
-	int train_id = 0; 
+	int train_id = 0;
+	// predicted speed (hundredths of mm/s) and the tick the train was at path[0], a speed of 0 throws every switch right away
+	int64_t velocity = 0;
+	int origin_tick = 0;
+	int now_tick = 0; // when the request was made, throws due before then go out right away
+};
+
+// switch on a reserved path, waiting for the latest moment it can be thrown
+struct ScheduledThrow {
+	int due; // tick
+	int node;
+	char id;
+	char dir;
+	int train_id;
 };
 
 union RequestBody
@@ -45,6 +63,7 @@ union RequestBody
 	Command command;
 	StartAndDest start_and_end;
 	Reserve reservation;
+	char switches[NUM_SWITCHES]; // TRACK_COUR_SWITCH_ALL, by switch index
 
 	RequestBody() {
 		this->info = 0;
@@ -1,5 +1,8 @@
 #include "train_admin.h"
+#include "bus_scheduler.h"
 #include "courier_pool.h"
+#include "recorder.h"
+#include "state_subscription.h"
 
 using namespace Train;
 using namespace Message;
@@ -30,32 +33,142 @@ void get_clear_track_byte(char code[]) {
 	code[0] = '\0' + 32;
 }
 
-struct SwitchDelayMessage {
-	int from;
-	char track_id;
-	char dir;
-};
-
 void Train::train_admin() {
 	Name::RegisterAs(TRAIN_SERVER_NAME);
-	const uint64_t POOL_SIZE = 64;
 	Courier::CourierPool<TrainCourierReq> courier_pool = Courier::CourierPool<TrainCourierReq>(&train_courier, Priority::HIGH_PRIORITY);
 	AddressBook addr = getAddressBook();
 	int uart_tid = addr.train_trans_tid;
 
-	etl::queue<Command, 128> train_command_queue;
-	etl::queue<Command, 128> track_command_queue;
-
+	BusScheduler bus;
+	PollPacer pacer;
 	char command[2];
+	char window[BUS_MAX_BYTES_PER_POLL];
+	int last_window = 0; // bytes written in front of the poll in flight
 	int from;
 	TrainAdminReq req;
 	TrainRaw trains[NUM_TRAINS];
+	Subscription::VersionedState<TrainRaw, NUM_TRAINS> train_versions;
+	Subscription::VersionedState<uint64_t, NUM_TRAINS> egress_versions;
+
+	/**
+	 * Speed commands are written with a tag, and the uart server reports when the last byte of each tagged write has
+	 * left the THR, see train_egress_courier. That time is published to egress subscribers, it is when the train
+	 * actually got the command rather than when it was decided. TrainRaw subscribers don't see it, a view of the
+	 * speeds has no use for a delta on every write.
+	 */
+	struct TaggedWrite {
+		uint32_t tag;
+		uint8_t trains;		 // bit per train index
+		uint64_t decided_at; // express stops, when the stop was decided, 0 for everything else
+	};
+	etl::queue<TaggedWrite, UART::EGRESS_QUEUE_SIZE> in_flight;
+	etl::vector<TaggedWrite, UART::DEADLINE_SLOTS> scheduled; // held for a deadline, they leave out of order
+	uint32_t next_tag = 1;
+	Task::Create(Priority::HIGH_PRIORITY, &train_egress_courier);
+	Recorder::Mode recorder_mode = Recorder::MODE_IDLE; // from the recorder's last reply, or the terminal
+
+	auto tagged_write = [&](const char* bytes, int len, uint8_t train_mask, uint64_t due = 0, uint64_t decided_at = 0) {
+		uint64_t now = (due == 0) ? Clock::system_time() : due;
+		if (recorder_mode == Recorder::MODE_REPLAYING) {
+			recorder_mode = Recorder::Append(addr.recorder_tid, Recorder::RECORD_TRAIN_OUT, bytes, len, now);
+		}
+		if (recorder_mode == Recorder::MODE_REPLAYING) {
+			// a replay is driving the trains, the write is kept by the recorder and the Marklin never sees it
+			for (int i = 0; i < NUM_TRAINS; i++) {
+				if (train_mask & (1 << i)) {
+					egress_versions.set(i, now);
+				}
+			}
+			egress_versions.publish();
+			return;
+		}
+		if (train_mask == 0) {
+			UART::Puts(uart_tid, TRAIN_UART_CHANNEL, bytes, len);
+		} else {
+			if (due != 0) {
+				if (scheduled.full()) {
+					Task::_KernelCrash("Train Admin: too many writes waiting for a deadline\r\n");
+				}
+				scheduled.push_back(TaggedWrite { next_tag, train_mask, decided_at });
+			} else if (in_flight.full()) {
+				Task::_KernelCrash("Train Admin: too many writes waiting for egress\r\n");
+			} else {
+				in_flight.push(TaggedWrite { next_tag, train_mask, decided_at });
+			}
+			UART::PutsTagged(uart_tid, TRAIN_UART_CHANNEL, bytes, len, next_tag, due);
+			next_tag = (next_tag == UINT32_MAX) ? 1 : next_tag + 1; // 0 means untagged
+		}
+		// recorded once the uart has the bytes, so a recording doesn't slow down what it records
+		if (recorder_mode == Recorder::MODE_RECORDING) {
+			recorder_mode = Recorder::Append(addr.recorder_tid, Recorder::RECORD_TRAIN_OUT, bytes, len, now);
+		}
+	};
 
-	etl::queue<SwitchDelayMessage, POOL_SIZE> switch_queue;
+	/**
+	 * Switch requests that arrive within SWITCH_COALESCE_TICKS of each other go out as one burst, followed by a single
+	 * solenoid off once the last of them is on the wire. Switches already in the requested state are dropped.
+	 */
+	char commanded_switch[NUM_SWITCHES] = { 0 }; // last direction sent to the bus, 0 if unknown
+	char wanted_switch[NUM_SWITCHES] = { 0 };	 // waiting for the current burst, 0 if nothing
+	bool coalescing = false;					 // coalesce timer running
+	bool solenoid_on = false;					 // a burst went out without its solenoid off yet
+	bool solenoid_timer = false;				 // solenoid off timer running
+	bool solenoid_rearm = false;				 // a burst was queued after the running timer started
 	TrainCourierReq req_to_courier;
 	req_to_courier.header = RequestHeader::TRAIN_COUR_SENSOR_START;
+	req_to_courier.body.poll_gap = 0;
 	courier_pool.request(&req_to_courier);
 
+	auto push_switch = [&](Command info) {
+		if (info.id == 0) { // since there is no swtich number 0, this means clear switch
+			get_clear_track_byte(command);
+			bus.push_switch(command, 1, Clock::system_time());
+		} else {
+			bool s = info.action == 's'; // if true, then straight, else, curved
+			if (s) {
+				get_straight_byte(command, info.id);
+			} else {
+				get_curved_byte(command, info.id);
+			}
+			bus.push_switch(command, 2, Clock::system_time());
+		}
+	};
+
+	auto start_coalescing = [&]() {
+		if (!coalescing) {
+			coalescing = true;
+			req_to_courier.header = RequestHeader::TRAIN_COUR_SWITCH_COALESCE;
+			courier_pool.request(&req_to_courier);
+		}
+	};
+
+	// the coalesce window closed, the switch goes on the bus if it is wanted somewhere it isn't yet
+	auto flush_switch = [&](char id) {
+		int i = get_switch_id(id);
+		if (wanted_switch[i] != 0 && wanted_switch[i] != commanded_switch[i]) {
+			commanded_switch[i] = wanted_switch[i];
+			push_switch(Command { id, wanted_switch[i] });
+			solenoid_on = true;
+			solenoid_rearm = solenoid_timer;
+		}
+		wanted_switch[i] = 0;
+	};
+
+	/**
+	 * Stops don't wait for the next window. The uart server sends a Puts as one block and the sensor poll is the single
+	 * 0x85 byte, so a stop can go out in the middle of a poll, while the sensor bytes are still coming back, without
+	 * splitting any command.
+	 */
+	auto express_stop = [&](char train_id, uint64_t decided_at) {
+		int train_index = train_num_to_index(train_id);
+		trains[train_index].speed = STOP_COMMAND;
+		train_versions.set(train_index, trains[train_index]);
+		train_versions.publish();
+		char stop[2] = { STOP_COMMAND, train_id };
+		tagged_write(stop, 2, 1 << train_index, 0, decided_at);
+		bus.express_stop(train_id);
+	};
+
 	// once we pushed all jobs, initialize a job that just setup all the switches
 
 	/**
@@ -73,9 +186,33 @@ void Train::train_admin() {
 				req.body.command.action += 16;
 			}
 			char desire_speed = req.body.command.action; // should be an integer within 0 - 31
+			if (desire_speed % 16 == 0) {
+				express_stop(train_id, Clock::system_time());
+				break;
+			}
 			int train_index = train_num_to_index(train_id);
 			trains[train_index].speed = desire_speed;
-			train_command_queue.push(req.body.command);
+			train_versions.set(train_index, trains[train_index]);
+			train_versions.publish();
+			bus.push_train(CLASS_SPEED, train_id, desire_speed, Clock::system_time());
+			break;
+		}
+		case RequestHeader::TRAIN_EXPRESS_STOP: {
+			Message::Reply::EmptyReply(from);
+			express_stop(req.body.express.id, req.body.express.decided_at);
+			break;
+		}
+		case RequestHeader::TRAIN_SPEED_AT: {
+			Message::Reply::EmptyReply(from);
+			char train_id = req.body.timed.id;
+			char speed = (req.body.timed.action < 16) ? req.body.timed.action + 16 : req.body.timed.action;
+			int train_index = train_num_to_index(train_id);
+			trains[train_index].speed = speed;
+			train_versions.set(train_index, trains[train_index]);
+			train_versions.publish();
+			bus.cancel_speed(train_id);
+			char timed[2] = { speed, train_id };
+			tagged_write(timed, 2, 1 << train_index, req.body.timed.due);
 			break;
 		}
 		case RequestHeader::TRAIN_REV: {
@@ -84,70 +221,89 @@ void Train::train_admin() {
 			char train_id = req.body.command.id;
 			int train_index = train_num_to_index(train_id);
 			trains[train_index].direction = !trains[train_index].direction;
-			req.body.command.action = REV_COMMAND;
-			train_command_queue.push(req.body.command);
+			train_versions.set(train_index, trains[train_index]);
+			train_versions.publish();
+			bus.push_train(CLASS_REVERSE, train_id, REV_COMMAND, Clock::system_time());
 
 			break;
 		}
 		case RequestHeader::TRAIN_SWITCH: {
 			Message::Reply::EmptyReply(from);
+			int index = get_switch_id(req.body.command.id);
+			if (index == NO_SWITCH) {
+				Task::_KernelCrash("Train Admin: invalid switch %d\r\n", req.body.command.id);
+			}
 
-			char track_id = req.body.command.id;
-			if (switch_queue.empty()) {
-				track_command_queue.push(req.body.command);
-				req_to_courier.header = RequestHeader::TRAIN_COUR_SWITCH_DELAY;
-				courier_pool.request(&req_to_courier);
+			if (wanted_switch[index] == 0 && commanded_switch[index] == req.body.command.action) {
+				break; // already there
+			}
+			wanted_switch[index] = req.body.command.action;
+			start_coalescing();
+			break;
+		}
+		case RequestHeader::TRAIN_SWITCH_ALL: {
+			Message::Reply::EmptyReply(from);
+			for (int i = 0; i < NUM_SWITCHES; i++) {
+				if (req.body.switches[i] != 0) {
+					wanted_switch[i] = req.body.switches[i];
+				}
+			}
+			start_coalescing();
+			break;
+		}
+		case RequestHeader::TRAIN_SWITCH_COALESCE_COMPLETE: {
+			courier_pool.receive(from);
+			coalescing = false;
+			for (char id = 1; id <= 18; id++) {
+				flush_switch(id);
+			}
+			for (char id : extra_switch) {
+				flush_switch(id);
 			}
-			switch_queue.push({ from, track_id, req.body.command.action });
 			break;
 		}
 		case RequestHeader::TRAIN_SWITCH_DELAY_COMPLETE: {
 			// unblock and place the courier back into the pool
 			courier_pool.receive(from);
-
-			if (switch_queue.empty()) {
-				Task::_KernelCrash("Train Admin: Switch queue is empty");
-			}
-
-			SwitchDelayMessage info = switch_queue.front();
-			switch_queue.pop();
-			// if there is another swtich request queued up
-			if (!switch_queue.empty()) {
-				info = switch_queue.front();
-				track_command_queue.push(Command { info.track_id, info.dir });
-				req_to_courier.header = RequestHeader::TRAIN_COUR_SWITCH_DELAY;
-				courier_pool.request(&req_to_courier);
-			} else {
-				track_command_queue.push(Command { 0, 0 });
+			solenoid_timer = false;
+			// a newer burst gets its own timer once it is out
+			if (solenoid_rearm) {
+				solenoid_rearm = false;
+			} else if (solenoid_on && !bus.has_pending(CLASS_SWITCH)) {
+				solenoid_on = false;
+				push_switch(Command { 0, 0 });
 			}
 			break;
 		}
 		case RequestHeader::TRAIN_SENSOR_READING_COMPLETE: {
 			// unblock and place the courier back into the pool
 			courier_pool.receive(from);
-			if (!train_command_queue.empty()) {
-				command[0] = train_command_queue.front().action;
-				command[1] = train_command_queue.front().id;
-				UART::Puts(uart_tid, TRAIN_UART_CHANNEL, command, 2);
-				train_command_queue.pop();
-			} else if (!track_command_queue.empty()) {
-				Command info = track_command_queue.front();
-				if (info.id == 0) // since there is no swtich number 0, this means clear switch
-				{
-					get_clear_track_byte(command);
-					UART::Putc(uart_tid, TRAIN_UART_CHANNEL, command[0]);
-				} else {
-					bool s = info.action == 's'; // if true, then straight, else, curved
-					if (s) {
-						get_straight_byte(command, info.id);
-					} else {
-						get_curved_byte(command, info.id);
-					}
-					UART::Puts(uart_tid, TRAIN_UART_CHANNEL, command, 2);
+			pacer.record(req.body.poll_latency_us, last_window, bus.pending_bytes());
+			// everything that fits before the next poll goes out in one write
+			int len = bus.fill_window(window, pacer.budget(), Clock::system_time());
+			if (len > 0) {
+				uint8_t train_mask = 0;
+				for (char train_id : bus.speed_trains()) {
+					train_mask |= 1 << train_num_to_index(train_id);
+				}
+				// one message per command so a deadline command can go out between two of them, the window's trains
+				// hear about their egress with the last one
+				const auto& lens = bus.command_lens();
+				int start = 0;
+				for (unsigned i = 0; i < lens.size(); i++) {
+					tagged_write(window + start, lens[i], (i + 1 == lens.size()) ? train_mask : 0);
+					start += lens[i];
 				}
-				track_command_queue.pop();
+			}
+			last_window = len;
+			// the last switch of a burst is out, give its solenoid time to throw before turning them off
+			if (solenoid_on && !solenoid_timer && !bus.has_pending(CLASS_SWITCH)) {
+				solenoid_timer = true;
+				req_to_courier.header = RequestHeader::TRAIN_COUR_SWITCH_DELAY;
+				courier_pool.request(&req_to_courier);
 			}
 			req_to_courier.header = RequestHeader::TRAIN_COUR_SENSOR_START;
+			req_to_courier.body.poll_gap = pacer.gap_ticks();
 			courier_pool.request(&req_to_courier);
 			break;
 		}
@@ -155,10 +311,65 @@ void Train::train_admin() {
 			courier_pool.receive(from);
 			break;
 		}
+		case RequestHeader::TRAIN_EGRESS: {
+			Message::Reply::EmptyReply(from);
+			// writes held for a deadline leave whenever it comes, they are looked up by their tag
+			uint8_t egress_trains = 0;
+			uint64_t decided_at = 0;
+			for (auto it = scheduled.begin(); it != scheduled.end(); ++it) {
+				if (it->tag == req.body.egress.tag) {
+					egress_trains = it->trains;
+					decided_at = it->decided_at;
+					scheduled.erase(it);
+					break;
+				}
+			}
+			// the rest come in the order the writes were queued, older tags without one were lost to a full egress queue
+			if (egress_trains == 0) {
+				while (!in_flight.empty() && in_flight.front().tag != req.body.egress.tag) {
+					in_flight.pop();
+				}
+				if (in_flight.empty()) {
+					break;
+				}
+				egress_trains = in_flight.front().trains;
+				decided_at = in_flight.front().decided_at;
+				in_flight.pop();
+			}
+			if (decided_at != 0) {
+				bus.express_egress(decided_at, req.body.egress.at);
+			}
+			for (int i = 0; i < NUM_TRAINS; i++) {
+				if (egress_trains & (1 << i)) {
+					egress_versions.set(i, req.body.egress.at);
+				}
+			}
+			egress_versions.publish();
+			break;
+		}
 		case RequestHeader::TRAIN_OBSERVE: {
 			Message::Reply::Reply(from, reinterpret_cast<char*>(trains), sizeof(trains));
 			break;
 		}
+		case RequestHeader::TRAIN_RECORDER_MODE: {
+			Message::Reply::EmptyReply(from);
+			recorder_mode = req.body.recorder_mode;
+			break;
+		}
+		case RequestHeader::TRAIN_BUS_STATS: {
+			BusStats stats = bus.stats();
+			stats.poll = pacer.stats();
+			Message::Reply::Reply(from, reinterpret_cast<char*>(&stats), sizeof(stats));
+			break;
+		}
+		case RequestHeader::TRAIN_SUBSCRIBE: {
+			train_versions.subscribe(from, req.body.seen_version);
+			break;
+		}
+		case RequestHeader::TRAIN_SUBSCRIBE_EGRESS: {
+			egress_versions.subscribe(from, req.body.seen_version);
+			break;
+		}
 		default: {
 			Task::_KernelCrash("Train Admin illegal type: [%d]\r\n", req.header);
 		}
@@ -173,6 +384,7 @@ void Train::train_courier() {
 	TrainCourierReq req;
 	TrainAdminReq req_to_admin;
 	SensorAdminReq req_to_sensor;
+	SensorReading reading;
 
 	// worker only has few types
 	while (true) {
@@ -180,15 +392,27 @@ void Train::train_courier() {
 		Message::Reply::EmptyReply(from); // unblock caller right away
 		switch (req.header) {
 		case RequestHeader::TRAIN_COUR_SWITCH_DELAY: {
-			Clock::DelayUntil(addr.clock_tid, 15);
+			Clock::Delay(addr.clock_tid, SOLENOID_OFF_TICKS);
 			req_to_admin = { RequestHeader::TRAIN_SWITCH_DELAY_COMPLETE, RequestBody { 0x0, 0x0 } };
 			Message::Send::SendNoReply(addr.train_admin_tid, (const char*)&req_to_admin, sizeof(TrainAdminReq));
 			break;
 		}
+		case RequestHeader::TRAIN_COUR_SWITCH_COALESCE: {
+			Clock::Delay(addr.clock_tid, SWITCH_COALESCE_TICKS);
+			req_to_admin = { RequestHeader::TRAIN_SWITCH_COALESCE_COMPLETE, RequestBody { 0x0, 0x0 } };
+			Message::Send::SendNoReply(addr.train_admin_tid, (const char*)&req_to_admin, sizeof(TrainAdminReq));
+			break;
+		}
 		case RequestHeader::TRAIN_COUR_SENSOR_START: {
 			req_to_sensor.header = Message::RequestHeader::SENSOR_START_UPDATE;
-			Message::Send::SendNoReply(addr.sensor_admin_tid, (const char*)&req_to_sensor, sizeof(SensorAdminReq));
-			req_to_admin = { RequestHeader::TRAIN_SENSOR_READING_COMPLETE, RequestBody { 0x0, 0x0 } };
+			req_to_sensor.body.poll_gap = req.body.poll_gap;
+			Message::Send::Send(addr.sensor_admin_tid,
+								(const char*)&req_to_sensor,
+								sizeof(SensorAdminReq),
+								reinterpret_cast<char*>(&reading),
+								sizeof(SensorReading));
+			req_to_admin.header = RequestHeader::TRAIN_SENSOR_READING_COMPLETE;
+			req_to_admin.body.poll_latency_us = reading.latency_us;
 			Message::Send::SendNoReply(addr.train_admin_tid, (const char*)&req_to_admin, sizeof(TrainAdminReq));
 			break;
 		}
@@ -199,6 +423,21 @@ void Train::train_courier() {
 	}
 }
 
+void Train::train_egress_courier() {
+	AddressBook addr = getAddressBook();
+	UART::EgressReport report;
+	TrainAdminReq req_to_admin;
+	req_to_admin.header = RequestHeader::TRAIN_EGRESS;
+
+	while (true) {
+		UART::AwaitEgress(addr.train_trans_tid, &report);
+		for (uint32_t i = 0; i < report.count; i++) {
+			req_to_admin.body.egress = { report.entries[i].tag, report.entries[i].at };
+			Message::Send::SendNoReply(addr.train_admin_tid, (const char*)&req_to_admin, sizeof(TrainAdminReq));
+		}
+	}
+}
+
 bool operator==(const Train::TrainRaw& lhs, const Train::TrainRaw& rhs) {
 	return lhs.speed == rhs.speed && lhs.direction == rhs.direction;
 }
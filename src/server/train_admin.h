@@ -2,6 +2,7 @@
 
 #include "../etl/queue.h"
 #include "../rpi.h"
+#include "recorder.h"
 #include "request_header.h"
 namespace Train
 {
@@ -9,9 +10,12 @@ namespace Train
 constexpr char TRAIN_SERVER_NAME[] = "TRAIN_ADMIN";
 constexpr int TRAIN_UART_CHANNEL = 1;
 constexpr char REV_COMMAND = 15 + 16;
+constexpr char STOP_COMMAND = 0 + 16;
 constexpr int NUM_TRAINS = 6;
 constexpr int NUM_SWITCHES = 22;
 constexpr int TRAIN_NUMBERS[NUM_TRAINS] = { 1, 2, 24, 58, 74, 78 };
+constexpr int SWITCH_COALESCE_TICKS = 2; // switch requests closer than this go out in one burst
+constexpr int SOLENOID_OFF_TICKS = 15;	 // after the last switch of a burst is sent
 int get_switch_id(int id);
 struct TrainRaw {
 public:
@@ -36,15 +40,44 @@ constexpr int train_num_to_index(int train_num) {
 
 void train_admin();
 void train_courier();
+void train_egress_courier();
 
 struct Command {
 	char id;
 	char action;
 };
+
+// TRAIN_EXPRESS_STOP, decided_at is the system time (us) the sender decided to stop
+struct ExpressCommand {
+	char id;
+	uint64_t decided_at;
+};
+
+// TRAIN_SPEED_AT, due is the system time (us) the command should be on the wire
+struct TimedCommand {
+	char id;
+	char action;
+	uint64_t due;
+};
+
+// TRAIN_EGRESS, a tagged write has left the uart
+struct EgressTime {
+	uint32_t tag;
+	uint64_t at; // system time (us)
+};
+
 union RequestBody
 {
 	Command command;
+	ExpressCommand express;
+	TimedCommand timed;
+	EgressTime egress;
 	uint64_t next_delay;
+	uint32_t seen_version;		  // TRAIN_SUBSCRIBE, TRAIN_SUBSCRIBE_EGRESS
+	uint32_t poll_latency_us;	  // TRAIN_SENSOR_READING_COMPLETE
+	uint32_t poll_gap;			  // TRAIN_COUR_SENSOR_START, ticks to wait before polling
+	Recorder::Mode recorder_mode; // TRAIN_RECORDER_MODE
+	char switches[NUM_SWITCHES];  // TRAIN_SWITCH_ALL, 0 leaves the switch as it is
 };
 
 struct TrainAdminReq {
@@ -1,5 +1,7 @@
 #include "uart_server.h"
+#include "../etl/deque.h"
 #include "../etl/queue.h"
+#include "../interrupt/clock.h"
 #include "../rpi.h"
 #include "../utils/printf.h"
 
@@ -8,58 +10,122 @@ using namespace Message;
 
 void UART::uart_0_server_transmit() {
 	const int uart_channel = 0;
+	const int NO_LANE = -1;
 	Name::RegisterAs(UART_0_TRANSMITTER);
 	// create it's worker
 	Task::Create(Priority::CRITICAL_PRIORITY, &uart_0_transmission_notifier);
-	etl::queue<char, CHAR_QUEUE_SIZE> transmit_queue;
 	int from;
 	UARTServerReq req;
 	bool transmit_interrupt_enable = false;
 
+	/**
+	 * Output is split into lanes, echo > ui > debug. Each lane remembers the length of every message it holds, so we only
+	 * switch lane on a message boundary and an escape sequence is never cut in half by another lane.
+	 * A lane that used up its budget for the current tick only gets the line when every lane still within budget is empty,
+	 * thus a burst of route debugging can no longer hold the clock and sensor display for seconds.
+	 */
+	struct LaneState {
+		etl::queue<char, CHAR_QUEUE_SIZE> bytes;
+		etl::queue<uint16_t, LANE_MSG_QUEUE_SIZE> msg_lens; // front is the number of bytes left of the oldest message
+		int budget_used = 0;
+		uint64_t dropped_msgs = 0;
+		uint64_t dropped_bytes = 0;
+		uint64_t reported_msgs = 0;
+		uint64_t reported_bytes = 0;
+	};
+	LaneState lanes[NUM_OUTPUT_LANES];
+	int active_lane = NO_LANE; // lane that is halfway through a message
+	uint64_t budget_tick = 0;
+
 	auto enable_interrupt = [&]() {
 		transmit_interrupt_enable = true;
 		UART::TransInterrupt(uart_channel, true);
 	};
 
-	auto tryPutC = [&](char c) {
-		int put_successful = UART::UartWriteRegister(uart_channel, UART_THR, c);
-		if (put_successful != UART::SUCCESSFUL) {
-			transmit_queue.push(c);
-			// enable the interrupt
-			enable_interrupt();
+	auto enqueue = [&](int lane, const char* s, int len) {
+		LaneState& l = lanes[lane];
+		if (len <= 0) {
+			return;
 		}
+		if ((int)l.bytes.size() + len > LANE_BYTE_LIMIT[lane] || l.msg_lens.full()) {
+			// drop the whole message, half an escape sequence is worse than nothing
+			l.dropped_msgs += 1;
+			l.dropped_bytes += len;
+			return;
+		}
+		for (int i = 0; i < len; i++) {
+			l.bytes.push(s[i]);
+		}
+		l.msg_lens.push(len);
 	};
 
-	auto tryPutS = [&](const char* s, int len) {
-		int i = 0;
-		int put_successful = UART::SUCCESSFUL;
-		while (i < len && put_successful == UART::SUCCESSFUL) {
-			put_successful = UART::UartWriteRegister(uart_channel, UART_THR, s[i]);
-			i++;
+	auto report_drops = [&]() {
+		LaneState& l = lanes[LANE_DEBUG];
+		if (l.dropped_msgs != l.reported_msgs) {
+			char summary[96];
+			int len = snprintf(summary,
+							   sizeof(summary),
+							   "\r\n[uart0] dropped %llu debug messages (%llu bytes)\r\n",
+							   l.dropped_msgs - l.reported_msgs,
+							   l.dropped_bytes - l.reported_bytes);
+			l.reported_msgs = l.dropped_msgs;
+			l.reported_bytes = l.dropped_bytes;
+			enqueue(LANE_DEBUG, summary, len);
 		}
-		if (put_successful != UART::SUCCESSFUL) { // we couldn't push everything
-			for (i = i - 1; i < len; i++) {
-				transmit_queue.push(s[i]);
+	};
+
+	auto refresh_budget = [&]() {
+		uint64_t now = Clock::system_time() / Clock::MICROS_PER_TICK;
+		if (now != budget_tick) {
+			budget_tick = now;
+			for (int i = 0; i < NUM_OUTPUT_LANES; i++) {
+				lanes[i].budget_used = 0;
 			}
-			// enable the interrupt
-			enable_interrupt();
 		}
 	};
 
-	auto tryClearTransmit = [&]() {
-		int put_successful = UART::SUCCESSFUL;
-		while (!transmit_queue.empty() && put_successful == UART::SUCCESSFUL) {
-			put_successful = UART::UartWriteRegister(uart_channel, UART_THR, transmit_queue.front());
-			if (put_successful == UART::SUCCESSFUL) {
-				transmit_queue.pop();
+	auto pick_lane = [&]() {
+		if (active_lane != NO_LANE) {
+			return active_lane;
+		}
+		for (int i = 0; i < NUM_OUTPUT_LANES; i++) {
+			if (!lanes[i].msg_lens.empty() && lanes[i].budget_used < LANE_BUDGET_PER_TICK[i]) {
+				return i;
 			}
 		}
-		if (!transmit_queue.empty()) { // we couldn't push everything
-			enable_interrupt();
-			return false; // could not clear
-		} else {
-			return true; // cleared
+		// everyone is over budget, still don't leave the line idle
+		for (int i = 0; i < NUM_OUTPUT_LANES; i++) {
+			if (!lanes[i].msg_lens.empty()) {
+				return i;
+			}
+		}
+		return NO_LANE;
+	};
+
+	auto tryClearTransmit = [&]() {
+		refresh_budget();
+		int lane = pick_lane();
+		while (lane != NO_LANE) {
+			LaneState& l = lanes[lane];
+			if (UART::UartWriteRegister(uart_channel, UART_THR, l.bytes.front()) != UART::SUCCESSFUL) {
+				enable_interrupt();
+				return false; // could not clear
+			}
+			l.bytes.pop();
+			l.budget_used += 1;
+			l.msg_lens.front() -= 1;
+			if (l.msg_lens.front() == 0) {
+				l.msg_lens.pop();
+				active_lane = NO_LANE;
+				if (lane == LANE_DEBUG && l.msg_lens.empty()) {
+					report_drops();
+				}
+			} else {
+				active_lane = lane;
+			}
+			lane = pick_lane();
 		}
+		return true; // cleared
 	};
 
 	while (true) {
@@ -73,43 +139,23 @@ void UART::uart_0_server_transmit() {
 		}
 		case RequestHeader::UART_PUTC: {
 			Message::Reply::EmptyReply(from); // unblock putc guy right away
-			// the default behaviour is putc, but if we are full, then we wait for interrupt
-			char c = req.body.regular_msg;
-
-			if (transmit_interrupt_enable) {
-				transmit_queue.push(c);
-			} else {
-				if (tryClearTransmit()) {
-					tryPutC(c);
-				} else {
-					transmit_queue.push(c);
-					enable_interrupt();
-				}
+			// single characters are echo from the prompt, they go first
+			enqueue(LANE_ECHO, &req.body.regular_msg, 1);
+			if (!transmit_interrupt_enable) {
+				tryClearTransmit();
 			}
 			break;
 		}
 		case RequestHeader::UART_PUTS: {
 			Message::Reply::EmptyReply(from); // unblock putc guy right away right away
-			// the default behaviour is putc, but if we are full, then we wait for interrupt
-			const char* s = req.body.worker_msg.msg;
-			int len = req.body.worker_msg.msg_len;
-
-			if (len > 0) {
-				if (transmit_interrupt_enable) {
-					for (int i = 0; i < len; i++) {
-						transmit_queue.push(s[i]);
-					}
-				} else {
-					if (tryClearTransmit()) {
-						tryPutS(s, len);
-					} else {
-						for (int i = 0; i < len; i++) {
-							transmit_queue.push(s[i]);
-						}
-						// enable the interrupt
-						enable_interrupt();
-					}
-				}
+			// if the fifo is full, then we wait for interrupt
+			OutputLane lane = req.body.worker_msg.lane;
+			if (lane < LANE_ECHO || lane >= NUM_OUTPUT_LANES) {
+				lane = LANE_UI;
+			}
+			enqueue(lane, req.body.worker_msg.msg, req.body.worker_msg.msg_len);
+			if (!transmit_interrupt_enable) {
+				tryClearTransmit();
 			}
 			break;
 		}
@@ -124,52 +170,40 @@ void UART::uart_0_server_receive() {
 	const int uart_channel = 0;
 	Name::RegisterAs(UART_0_RECEIVER);
 
+	// the kernel puts every byte in here as it comes in, and the notifier wakes us when it stops being empty
+	Uart0RxRing ring;
+	UART::RegisterRxRing(uart_channel, &ring);
+
 	// create it's worker
 	Task::Create(Priority::CRITICAL_PRIORITY, &uart_0_receive_notifier);
 
-	etl::queue<char, CHAR_QUEUE_SIZE> receive_queue;
 	etl::queue<int, TASK_QUEUE_SIZE> await_c;
-	char receive_buffer[UART_FIFO_MAX_SIZE];
+	uint32_t reported_lost = 0;
 
 	int from;
 	UARTServerReq req;
+	char c;
 
 	while (true) {
 		Message::Receive::Receive(&from, (char*)&req, sizeof(UARTServerReq));
 		switch (req.header) {
 		case RequestHeader::UART_NOTIFY_RECEIVE: {
 			Message::Reply::EmptyReply(from); // unblock receiver right away right away
-
-			WorkerRequestBody body = req.body.worker_msg;
-			int length = body.msg_len;
-			int i = 0;
-			for (; !await_c.empty() && i < length; i++) {
-				Message::Reply::Reply(await_c.front(), &body.msg[i], 1);
+			while (!await_c.empty() && ring.pop(&c)) {
+				Message::Reply::Reply(await_c.front(), &c, 1);
 				await_c.pop();
 			}
-			for (; i < length; i++) {
-				receive_queue.push(body.msg[i]);
+			if (ring.lost() != reported_lost) {
+				debug_print(UART_0_TRANSMITTER_TID, "\r\n[uart0] rx ring dropped %u bytes\r\n", ring.lost() - reported_lost);
+				reported_lost = ring.lost();
 			}
 			break;
 		}
 		case RequestHeader::UART_GETC: {
-			// you first need to exhaust the existing queue
-			if (!receive_queue.empty()) {
-				Message::Reply::Reply(from, &receive_queue.front(), 1); // unblock receiver right away right away
-				receive_queue.pop();
+			if (ring.pop(&c)) {
+				Message::Reply::Reply(from, &c, 1); // unblock receiver right away right away
 			} else {
-				// we now have an empty queue, try to see if there is any uart event
-				int length = UartReadAll(uart_channel, receive_buffer);
-				if (length == 0) {
-					// we now have an empty receive queue as well, meaning we need interrupt
-					UART::ReceiveInterrupt(uart_channel, true);
-					await_c.push(from); // block until we receive some uart in future
-				} else {
-					Message::Reply::Reply(from, receive_buffer, 1); // unblock receiver right away right away
-					for (int i = 1; i < length; i++) {
-						receive_queue.push(receive_buffer[i]);
-					}
-				}
+				await_c.push(from); // block until we receive some uart in future
 			}
 			break;
 		}
@@ -182,15 +216,14 @@ void UART::uart_0_server_receive() {
 
 /**
  * For uart0, you will receive interrupt in the form of timeout, since the terminal does not obey the 4 byte rule and is
- * incredibly fast thus, we listen to timeout event, and decide who to queue next
+ * incredibly fast. The kernel puts the bytes in the ring of the server, we only tell it the ring has something again.
  */
 void UART::uart_0_receive_notifier() {
 	int uart_tid = Name::WhoIs(UART_0_RECEIVER);
-	UARTServerReq req = { RequestHeader::UART_NOTIFY_RECEIVE, WorkerRequestBody { 0x0, 0x0 } };
+	UARTServerReq req = { RequestHeader::UART_NOTIFY_RECEIVE, { 0 } };
 	while (true) {
-		req.body.worker_msg.msg_len = Interrupt::AwaitEventWithBuffer(UART_0_RX_TIMEOUT, req.body.worker_msg.msg);
-		Message::Send::Send(uart_tid, reinterpret_cast<const char*>(&req), sizeof(UARTServerReq), nullptr,
-							0); // we don't worry about response
+		Interrupt::AwaitEvent(UART_0_RX_TIMEOUT);
+		Message::Send::SendNoReply(uart_tid, reinterpret_cast<const char*>(&req), sizeof(UARTServerReq));
 	}
 }
 
@@ -208,113 +241,214 @@ void UART::uart_0_transmission_notifier() {
 }
 
 /**
- * Unlike uart0, uart1 has fifo and CTS on transmitter
+ * Unlike uart0, uart1 has CTS on transmitter. The kernel does the flow control, it writes a byte once both the CTS rise
+ * and the THR empty interrupt after the previous byte came in. We keep the queue, and the notifier hands the kernel one
+ * message at a time (a long one in TRANSMIT_CHUNK_SIZE pieces), so a deadline message can still go between two
+ * messages, and every handover comes back with when its first byte went in and its last byte moved on.
  */
 void UART::uart_1_server_transmit() {
-	const int uart_channel = 1;
 	Name::RegisterAs(UART_1_TRANSMITTER);
 	// create it's worker
 	Task::Create(Priority::CRITICAL_PRIORITY, &uart_1_transmission_notifier);
-	Task::Create(Priority::CRITICAL_PRIORITY, &uart_1_CTS_notifier);
 
-	etl::queue<char, CHAR_QUEUE_SIZE> transmit_queue;
+	struct QueuedMessage {
+		uint16_t left; // bytes not handed to the kernel yet
+		bool started;  // the kernel has some of it already
+		uint32_t tag;
+		uint64_t due; // nonzero for a deadline message
+	};
+	etl::deque<char, CHAR_QUEUE_SIZE> transmit_queue;
+	etl::deque<QueuedMessage, MESSAGE_QUEUE_SIZE> messages;
 	int from;
 	UARTServerReq req;
 
+	// what the chunk in the kernel has to report once it is out, the tag only on the last chunk of a message
+	struct Handover {
+		uint32_t tag;
+		uint64_t due;
+	};
+	Handover in_kernel = { 0, 0 };
+	int notifier = Task::MAIDENLESS; // waiting for a chunk
+
 	/**
-	 * Idea, putc keep accept input, yet the input is either fired right away, or wait until all interrupt came back.
-	 * it needs to wait for both CTS and the interrput come back being ready. if you don't
+	 * Egress times: the kernel stamps the THR empty interrupt after the last byte of a chunk, and a tagged Puts is
+	 * reported with the stamp of its last chunk.
 	 */
+	etl::queue<Egress, EGRESS_QUEUE_SIZE> egress;
+	int egress_waiter = Task::MAIDENLESS;
+
+	auto report_egress = [&]() {
+		if (egress_waiter == Task::MAIDENLESS || egress.empty()) {
+			return;
+		}
+		EgressReport report;
+		report.count = 0;
+		while (!egress.empty() && report.count < EGRESS_REPORT_SIZE) {
+			report.entries[report.count++] = egress.front();
+			egress.pop();
+		}
+		int len = sizeof(report) - (EGRESS_REPORT_SIZE - report.count) * sizeof(Egress);
+		Message::Reply::Reply(egress_waiter, reinterpret_cast<const char*>(&report), len);
+		egress_waiter = Task::MAIDENLESS;
+	};
+
+	/**
+	 * Deadlines: a message with a due time waits in a slot, and the slot's notifier waits in the kernel until then.
+	 * Once it is woken, the message is queued right after the one the kernel is halfway through, so it is the next thing
+	 * written. How late its first byte made it into the THR goes into the histogram.
+	 */
+	struct DeadlineSlot {
+		int notifier = Task::MAIDENLESS;
+		bool parked = false; // the notifier waits for a due time
+		bool armed = false;	 // the notifier waits in the kernel
+		WorkerRequestBody msg;
+	};
+	DeadlineSlot slots[DEADLINE_SLOTS];
+	for (DeadlineSlot& slot : slots) {
+		slot.notifier = Task::Create(Priority::CRITICAL_PRIORITY, &uart_1_deadline_notifier);
+	}
+	DeadlineHistogram histogram = {};
+
+	auto record_deadline = [&](uint64_t first_at, uint64_t due) {
+		uint32_t late = (first_at > due) ? first_at - due : 0;
+		int bucket = 0;
+		while (bucket < DEADLINE_BUCKETS - 1 && late > DEADLINE_BUCKET_US[bucket]) {
+			bucket += 1;
+		}
+		histogram.buckets[bucket] += 1;
+		histogram.sent += 1;
+		histogram.total_late_us += late;
+		histogram.max_late_us = (late > histogram.max_late_us) ? late : histogram.max_late_us;
+	};
+
+	auto hand_over = [&]() {
+		if (notifier == Task::MAIDENLESS || messages.empty()) {
+			return;
+		}
+		QueuedMessage& m = messages.front();
+		TransmitChunk chunk;
+		chunk.len = (m.left > TRANSMIT_CHUNK_SIZE) ? TRANSMIT_CHUNK_SIZE : m.left;
+		for (uint32_t i = 0; i < chunk.len; i++) {
+			chunk.bytes[i] = transmit_queue.front();
+			transmit_queue.pop_front();
+		}
+		in_kernel.due = m.started ? 0 : m.due;
+		m.left -= chunk.len;
+		m.started = true;
+		in_kernel.tag = (m.left == 0) ? m.tag : 0;
+		if (m.left == 0) {
+			messages.pop_front();
+		}
+		Message::Reply::Reply(notifier, reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+		notifier = Task::MAIDENLESS;
+	};
 
-	int CTS_await = 1; // wait for it to go up
-	bool TX_await = false;
-
-	auto send_if_possible = [&](char c) {
-
-#ifdef SIMULATED_UART_1
-		if (!TX_await) {
-#else
-		if (CTS_await == 1 && !TX_await) {
-#endif
-			UART::UartWriteRegister(uart_channel, UART_THR, c);
-			// enable the interrupt
-			CTS_await = 0;
-			TX_await = true;
-			UART::TransInterrupt(uart_channel, true); // turn on the fifo interrupt.
-			// MSR (another way to detect CTS) interrupt is turned on by default
-			return true;
-		} else {
-			return false;
+	auto enqueue = [&](const char* s, int len, uint32_t tag) {
+		if (len <= 0) {
+			return;
+		}
+		if (messages.full()) {
+			Task::_KernelCrash("UART1 trans: too many messages queued\r\n");
+		}
+		for (int i = 0; i < len; i++) {
+			transmit_queue.push_back(s[i]);
 		}
+		messages.push_back(QueuedMessage { (uint16_t)len, false, tag, 0 });
+		hand_over();
+	};
+
+	// after the message the kernel is halfway through, and after the deadlines that fired before this one
+	auto enqueue_deadline = [&](const WorkerRequestBody& msg) {
+		if (messages.full()) {
+			Task::_KernelCrash("UART1 trans: too many messages queued\r\n");
+		}
+		auto it = messages.begin();
+		int offset = 0;
+		if (it != messages.end() && it->started) {
+			offset += it->left;
+			++it;
+		}
+		while (it != messages.end() && it->due != 0) {
+			offset += it->left;
+			++it;
+		}
+		messages.insert(it, QueuedMessage { (uint16_t)msg.msg_len, false, msg.tag, msg.due });
+		transmit_queue.insert(transmit_queue.begin() + offset, msg.msg, msg.msg + msg.msg_len);
+		hand_over();
 	};
 
 	while (true) {
 		Message::Receive::Receive(&from, (char*)&req, sizeof(UARTServerReq));
 		switch (req.header) {
 		case RequestHeader::UART_NOTIFY_TRANSMISSION: {
-			Message::Reply::EmptyReply(from); // unblock receiver right away right away
-			TX_await = false;
-
-			if (!transmit_queue.empty()) {
-				if (send_if_possible(transmit_queue.front())) {
-					transmit_queue.pop();
-				}
+			// the chunk handed over last time is out, the notifier waits for the next one
+			const TransmitDone& done = req.body.transmit_done;
+			if (in_kernel.due != 0) {
+				record_deadline(done.first_at, in_kernel.due);
 			}
-			break;
-		}
-		case RequestHeader::UART_NOTIFY_CTS: {
-			Message::Reply::EmptyReply(from); // unblock receiver right away right away
-			CTS_await += 1;
-
-			if (!transmit_queue.empty()) {
-				if (send_if_possible(transmit_queue.front())) {
-					transmit_queue.pop();
+			if (in_kernel.tag != 0) {
+				if (egress.full()) {
+					egress.pop(); // nobody is reading them, keep the newest
 				}
+				egress.push(Egress { in_kernel.tag, done.done_at });
+				report_egress();
 			}
+			in_kernel = { 0, 0 };
+			notifier = from;
+			hand_over();
 			break;
 		}
 		case RequestHeader::UART_PUTC: {
-
 			Message::Reply::EmptyReply(from); // unblock putc guy right away right away
-			// the default behaviour is putc, but if we are full, then we wait for interrupt
-			char c = req.body.regular_msg;
-			if (transmit_queue.empty()) {
-				if (!send_if_possible(c)) {
-					transmit_queue.push(c);
-				}
-			} else {
-				if (send_if_possible(transmit_queue.front())) {
-					transmit_queue.pop();
-				}
-				transmit_queue.push(c);
-			}
-
+			enqueue(&req.body.regular_msg, 1, 0);
 			break;
 		}
 		case RequestHeader::UART_PUTS: {
 			Message::Reply::EmptyReply(from); // unblock putc guy right away right away
-			// the default behaviour is putc, but if we are full, then we wait for interrupt
-			const char* s = req.body.worker_msg.msg;
-			int len = req.body.worker_msg.msg_len;
-			if (transmit_queue.empty()) {
-				if (!send_if_possible(s[0])) {
-					for (int i = 0; i < len; i++) {
-						transmit_queue.push(s[i]);
-					}
-				} else {
-					for (int i = 1; i < len; i++) {
-						transmit_queue.push(s[i]);
+			if (req.body.worker_msg.due != 0) {
+				DeadlineSlot* slot = nullptr;
+				for (DeadlineSlot& candidate : slots) {
+					if (candidate.parked && !candidate.armed) {
+						slot = &candidate;
+						break;
 					}
 				}
-			} else {
-				if (send_if_possible(transmit_queue.front())) {
-					transmit_queue.pop();
+				if (slot == nullptr) {
+					Task::_KernelCrash("UART1 trans: too many deadlines\r\n");
 				}
-				for (int i = 0; i < len; i++) {
-					transmit_queue.push(s[i]);
+				slot->msg = req.body.worker_msg;
+				slot->parked = false;
+				slot->armed = true;
+				Message::Reply::Reply(slot->notifier, reinterpret_cast<const char*>(&slot->msg.due), sizeof(uint64_t));
+				break;
+			}
+			enqueue(req.body.worker_msg.msg, req.body.worker_msg.msg_len, req.body.worker_msg.tag);
+			break;
+		}
+		case RequestHeader::UART_NOTIFY_DEADLINE: {
+			// parked until its slot gets a message
+			for (DeadlineSlot& slot : slots) {
+				if (slot.notifier != from) {
+					continue;
+				}
+				slot.parked = true;
+				if (slot.armed) {
+					slot.armed = false;
+					enqueue_deadline(slot.msg);
 				}
 			}
-
+			break;
+		}
+		case RequestHeader::UART_DEADLINE_STATS: {
+			Message::Reply::Reply(from, reinterpret_cast<const char*>(&histogram), sizeof(histogram));
+			break;
+		}
+		case RequestHeader::UART_AWAIT_EGRESS: {
+			if (egress_waiter != Task::MAIDENLESS) {
+				Task::_KernelCrash("UART1 trans: only one egress waiter is supported\r\n");
+			}
+			egress_waiter = from;
+			report_egress();
 			break;
 		}
 		default: {
@@ -328,58 +462,44 @@ void UART::uart_1_server_receive() {
 	const int uart_channel = 1;
 	Name::RegisterAs(UART_1_RECEIVER);
 
+	// every byte keeps the time it came in, a Getc only receives the char at the front of the reply
+	Uart1RxRing ring;
+	UART::RegisterRxRing(uart_channel, &ring);
+
 	// create it's worker
 	Task::Create(Priority::CRITICAL_PRIORITY, &uart_1_receive_notifier);
-	Task::Create(Priority::CRITICAL_PRIORITY, &uart_1_receive_timeout_notifier);
 
-	etl::queue<char, CHAR_QUEUE_SIZE> receive_queue;
 	etl::queue<int, TASK_QUEUE_SIZE> await_c;
+	uint32_t reported_lost = 0;
 
 	int from;
 	UARTServerReq req;
+	TimedByte byte;
+
+	auto reply_byte = [&](int tid, const TimedByte& byte) {
+		Message::Reply::Reply(tid, reinterpret_cast<const char*>(&byte), sizeof(TimedByte));
+	};
 
 	while (true) {
 		Message::Receive::Receive(&from, (char*)&req, sizeof(UARTServerReq));
 		switch (req.header) {
 		case RequestHeader::UART_NOTIFY_RECEIVE: {
 			Message::Reply::EmptyReply(from); // unblock receiver right away right away
-			// body is irrlevant, we simply try to read until we
-			// this call ideally should never happen, if it does, then we have issue with sensor not coming back fast
-			// enough.
-			int c = UartReadRegister(uart_channel, UART_RHR);
-			while (c != UART::Exception::FAILED_TO_READ) { // until there is nothing to read
-				char reply = (char)c;
-				if (!await_c.empty()) {
-					Message::Reply::Reply(await_c.front(), &reply, 1);
-					await_c.pop();
-				} else {
-					receive_queue.push(reply);
-				}
-				c = UartReadRegister(uart_channel, UART_RHR);
+			while (!await_c.empty() && ring.pop(&byte)) {
+				reply_byte(await_c.front(), byte);
+				await_c.pop();
+			}
+			if (ring.lost() != reported_lost) {
+				debug_print(UART_0_TRANSMITTER_TID, "\r\n[uart1] rx ring dropped %u bytes\r\n", ring.lost() - reported_lost);
+				reported_lost = ring.lost();
 			}
 			break;
 		}
 		case RequestHeader::UART_GETC: {
-			// you first need to exhaust the existing queue
-			if (!receive_queue.empty()) {
-				Message::Reply::Reply(from, &receive_queue.front(), 1); // unblock receiver right away right away
-				receive_queue.pop();
+			if (ring.pop(&byte)) {
+				reply_byte(from, byte); // unblock receiver right away right away
 			} else {
-				// we now have an empty queue, try to see if there is any uart event
-				int output = UartReadRegister(uart_channel, UART_RHR);
-				if (output == UART::Exception::FAILED_TO_READ) {
-					// we now have an empty receive queue as well, meaning we need interrupt
-					UART::ReceiveInterrupt(uart_channel, true);
-					await_c.push(from); // block until we receive some uart in future
-				} else {
-					char real_value = (char)output;
-					Message::Reply::Reply(from, (const char*)&real_value, 1);
-					output = UartReadRegister(uart_channel, UART_RHR);
-					while (output != UART::Exception::FAILED_TO_READ) {
-						receive_queue.push((char)output);
-						output = UartReadRegister(uart_channel, UART_RHR);
-					}
-				}
+				await_c.push(from); // block until we receive some uart in future
 			}
 			break;
 		}
@@ -393,18 +513,22 @@ void UART::uart_1_server_receive() {
 void UART::uart_1_transmission_notifier() {
 	int uart_tid = Name::WhoIs(UART_1_TRANSMITTER);
 	UARTServerReq req = { RequestHeader::UART_NOTIFY_TRANSMISSION, { 0 } };
+	req.body.transmit_done = { 0, 0 };
+	TransmitChunk chunk;
 	while (true) {
-		Interrupt::AwaitEvent(UART_1_TXR_INTERRUPT);
-		Message::Send::SendNoReply(uart_tid, reinterpret_cast<const char*>(&req), sizeof(UARTServerReq));
+		// the reply is the next chunk, held until there is something to send
+		Message::Send::Send(uart_tid, reinterpret_cast<const char*>(&req), sizeof(UARTServerReq), reinterpret_cast<char*>(&chunk), sizeof(chunk));
+		UART::Transmit(chunk.bytes, chunk.len, &req.body.transmit_done);
 	}
 }
 
-void UART::uart_1_CTS_notifier() {
+void UART::uart_1_deadline_notifier() {
 	int uart_tid = Name::WhoIs(UART_1_TRANSMITTER);
-	UARTServerReq req = { RequestHeader::UART_NOTIFY_CTS, { 0 } };
+	UARTServerReq req = { RequestHeader::UART_NOTIFY_DEADLINE, { 0 } };
 	while (true) {
-		Interrupt::AwaitEvent(UART_1_MSR_INTERRUPT);
-		Message::Send::SendNoReply(uart_tid, reinterpret_cast<const char*>(&req), sizeof(UARTServerReq));
+		// the reply is the due time, the kernel overwrites it with the time it woke us up
+		Message::Send::Send(uart_tid, reinterpret_cast<const char*>(&req), sizeof(UARTServerReq), reinterpret_cast<char*>(&req.body.event_time), sizeof(uint64_t));
+		Interrupt::AwaitEventWithBuffer(Clock::DEADLINE_INTERRUPT_ID, reinterpret_cast<char*>(&req.body.event_time), sizeof(uint64_t));
 	}
 }
 
@@ -415,13 +539,4 @@ void UART::uart_1_receive_notifier() {
 		Interrupt::AwaitEvent(UART_1_RX_INTERRUPT);
 		Message::Send::SendNoReply(uart_tid, reinterpret_cast<const char*>(&req), sizeof(UARTServerReq));
 	}
-}
-
-void UART::uart_1_receive_timeout_notifier() {
-	int uart_tid = Name::WhoIs(UART_1_RECEIVER);
-	UARTServerReq req = { RequestHeader::UART_NOTIFY_RECEIVE, { 0 } };
-	while (true) {
-		Interrupt::AwaitEvent(UART_1_RX_TIMEOUT);
-		Message::Send::SendNoReply(uart_tid, reinterpret_cast<const char*>(&req), sizeof(UARTServerReq));
-	}
 }
\ No newline at end of file
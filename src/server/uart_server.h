@@ -25,6 +25,13 @@ constexpr int TASK_QUEUE_SIZE = 64;
 constexpr int UART_FIFO_MAX_SIZE = 64;
 constexpr int UART_MESSAGE_LIMIT = 512;
 
+// terminal output lanes, see uart_0_server_transmit
+constexpr int LANE_MSG_QUEUE_SIZE = 2048;
+// bytes a lane may queue before new messages are dropped, debug is kept short so it can't build up seconds of backlog
+constexpr int LANE_BYTE_LIMIT[NUM_OUTPUT_LANES] = { 4096, CHAR_QUEUE_SIZE, 4096 };
+// bytes per tick a lane is guaranteed before lower lanes get a turn, 115200 baud is roughly 115 bytes per tick
+constexpr int LANE_BUDGET_PER_TICK[NUM_OUTPUT_LANES] = { 32, 64, 24 };
+
 // broken down version of uart_server
 void uart_0_server_transmit();
 void uart_0_server_receive();
@@ -33,19 +40,58 @@ void uart_0_transmission_notifier();
 void uart_1_server_transmit();
 void uart_1_server_receive();
 void uart_1_transmission_notifier();
-void uart_1_CTS_notifier();
+void uart_1_deadline_notifier();
 void uart_1_receive_notifier();
-void uart_1_receive_timeout_notifier();
+
+// bytes queued on uart 1 with a tag, see UART_AWAIT_EGRESS
+constexpr int EGRESS_QUEUE_SIZE = 64;
+constexpr int EGRESS_REPORT_SIZE = 8;
 
 struct WorkerRequestBody {
 	uint64_t msg_len = 0;
 	char msg[UART_MESSAGE_LIMIT];
+	OutputLane lane = LANE_UI;
+	uint32_t tag = 0; // uart 1 only, nonzero asks for the time the last byte leaves the THR
+	uint64_t due = 0; // uart 1 only, nonzero holds the message until this system time (us)
 };
 
 union RequestBody
 {
 	char regular_msg;
 	WorkerRequestBody worker_msg;
+	uint64_t event_time;		// UART_NOTIFY_*, from the kernel, us
+	TransmitDone transmit_done; // UART_NOTIFY_TRANSMISSION on uart 1, how the last chunk went out
+};
+
+// what uart 1 transmit replies to its notifier, the next chunk for the kernel
+struct TransmitChunk {
+	uint32_t len;
+	char bytes[TRANSMIT_CHUNK_SIZE];
+};
+
+struct Egress {
+	uint32_t tag;
+	uint64_t at; // us, the THR empty interrupt after the last byte of the tagged message
+};
+
+struct EgressReport {
+	uint32_t count;
+	Egress entries[EGRESS_REPORT_SIZE];
+};
+
+// uart 1 messages held until a system time, a notifier per slot waits on it in the kernel
+constexpr int DEADLINE_SLOTS = 4;
+constexpr int DEADLINE_MESSAGE_LIMIT = 8;
+constexpr int MESSAGE_QUEUE_SIZE = 1024;
+constexpr int DEADLINE_BUCKETS = 8;
+// upper bounds (us) of the first buckets of how late the first byte hit the THR, the last one takes the rest
+constexpr uint32_t DEADLINE_BUCKET_US[DEADLINE_BUCKETS - 1] = { 50, 100, 250, 500, 1000, 2500, 5000 };
+
+struct DeadlineHistogram {
+	uint32_t sent;
+	uint32_t max_late_us;
+	uint64_t total_late_us;
+	uint32_t buckets[DEADLINE_BUCKETS];
 };
 
 struct UARTServerReq {
@@ -5,6 +5,7 @@
 #include "../rpi.h"
 #include "../server/global_pathing_server.h"
 #include "../server/local_pathing_server.h"
+#include "../server/recorder.h"
 #include "../server/train_admin.h"
 #include "../server/uart_server.h"
 #include "../server/track_server.h"
@@ -35,6 +36,7 @@ void UserTask::launch() {
 		Task::Create(Priority::CRITICAL_PRIORITY, &UART::uart_1_server_transmit);
 		Task::Create(Priority::CRITICAL_PRIORITY, &UART::uart_1_server_receive);
 
+		Task::Create(Priority::HIGH_PRIORITY, &Recorder::recorder);
 		Task::Create(Priority::HIGH_PRIORITY, &Planning::global_pathing_server);
 		Task::Create(Priority::HIGH_PRIORITY, &Track::track_server);
 		Task::Create(Priority::HIGH_PRIORITY, &Train::train_admin);
@@ -0,0 +1,165 @@
+#include "format.h"
+
+using namespace Format;
+
+namespace
+{
+// "00" "01" ... "99", two digits per division instead of one
+constexpr char DIGIT_PAIRS[] = "00010203040506070809"
+							   "10111213141516171819"
+							   "20212223242526272829"
+							   "30313233343536373839"
+							   "40414243444546474849"
+							   "50515253545556575859"
+							   "60616263646566676869"
+							   "70717273747576777879"
+							   "80818283848586878889"
+							   "90919293949596979899";
+
+constexpr char HEX_LOWER[] = "0123456789abcdef";
+constexpr char HEX_UPPER[] = "0123456789ABCDEF";
+
+constexpr int MAX_DEC_DIGITS = 20;
+
+int dec_digits(uint64_t value) {
+	int digits = 1;
+	for (uint64_t bound = 10; digits < MAX_DEC_DIGITS && value >= bound; bound *= 10) {
+		digits++;
+	}
+	return digits;
+}
+
+int fill(char* out, char c, int count) {
+	for (int i = 0; i < count; i++) {
+		out[i] = c;
+	}
+	return count > 0 ? count : 0;
+}
+}
+
+int Format::u64_to_dec(char* out, uint64_t value) {
+	int len = dec_digits(value);
+	char* p = out + len;
+	while (value >= 100) {
+		int pair = (value % 100) * 2;
+		value /= 100;
+		*--p = DIGIT_PAIRS[pair + 1];
+		*--p = DIGIT_PAIRS[pair];
+	}
+	if (value >= 10) {
+		*--p = DIGIT_PAIRS[value * 2 + 1];
+		*--p = DIGIT_PAIRS[value * 2];
+	} else {
+		*--p = '0' + value;
+	}
+	return len;
+}
+
+int Format::u64_to_hex(char* out, uint64_t value, bool upper) {
+	const char* digits = upper ? HEX_UPPER : HEX_LOWER;
+	int len = 1;
+	while (len < 16 && (value >> (4 * len)) != 0) {
+		len++;
+	}
+	for (int i = len - 1; i >= 0; i--) {
+		out[i] = digits[value & 0xf];
+		value >>= 4;
+	}
+	return len;
+}
+
+int Format::put_unsigned(char* out, uint64_t value, const Spec& s, bool negative) {
+	bool hex = s.conv == 'x' || s.conv == 'X';
+	char hex_digits[16];
+	int ndigits = hex ? u64_to_hex(hex_digits, value, s.conv == 'X') : dec_digits(value);
+	int pad = s.width - ndigits - (negative ? 1 : 0);
+
+	int len = 0;
+	if (!s.left && !s.zero_pad) {
+		len += fill(out + len, ' ', pad);
+	}
+	if (negative) {
+		out[len++] = '-';
+	}
+	if (!s.left && s.zero_pad) {
+		len += fill(out + len, '0', pad);
+	}
+	if (hex) {
+		for (int i = 0; i < ndigits; i++) {
+			out[len + i] = hex_digits[i];
+		}
+		len += ndigits;
+	} else {
+		len += u64_to_dec(out + len, value); // straight into place, no copy
+	}
+	if (s.left) {
+		len += fill(out + len, ' ', pad);
+	}
+	return len;
+}
+
+int Format::put_fixed2(char* out, long raw, const Spec& s) {
+	bool negative = raw < 0;
+	uint64_t magnitude = negative ? -static_cast<uint64_t>(raw) : raw;
+
+	// the width covers the whole thing like printf, so the integer part gets what is left after ".dd"
+	Spec whole = s;
+	whole.conv = 'u';
+	whole.width = s.left ? 0 : s.width - 3;
+	int len = put_unsigned(out, magnitude / 100, whole, negative);
+	int hundredths = (magnitude % 100) * 2;
+	out[len++] = '.';
+	out[len++] = DIGIT_PAIRS[hundredths];
+	out[len++] = DIGIT_PAIRS[hundredths + 1];
+	if (s.left) {
+		len += fill(out + len, ' ', s.width - len);
+	}
+	return len;
+}
+
+int Format::put_string(char* out, const char* str, const Spec& s) {
+	int slen = 0;
+	while (str[slen] != '\0') {
+		slen++;
+	}
+	int len = 0;
+	if (!s.left) {
+		len += fill(out + len, ' ', s.width - slen);
+	}
+	for (int i = 0; i < slen; i++) {
+		out[len++] = str[i];
+	}
+	if (s.left) {
+		len += fill(out + len, ' ', s.width - slen);
+	}
+	return len;
+}
+
+int Format::put_char(char* out, char c, const Spec& s) {
+	int len = 0;
+	if (!s.left) {
+		len += fill(out + len, ' ', s.width - 1);
+	}
+	out[len++] = c;
+	if (s.left) {
+		len += fill(out + len, ' ', s.width - 1);
+	}
+	return len;
+}
+
+int Format::put_literal(char* out, const char* lit, int len, bool escaped) {
+	if (!escaped) {
+		for (int i = 0; i < len; i++) {
+			out[i] = lit[i];
+		}
+		return len;
+	}
+	int written = 0;
+	for (int i = 0; i < len; i++) {
+		out[written++] = lit[i];
+		if (lit[i] == '%') {
+			i++; // "%%"
+		}
+	}
+	return written;
+}
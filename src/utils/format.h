@@ -0,0 +1,245 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * Type safe replacement for sprintf on hot paths, the format string is parsed at compile time.
+ *
+ * 		constexpr char FMT[] = "T: %04dt P: %04dmm";
+ * 		int len = Format::format<FMT>(buf, t, d);
+ *
+ * The format has to be a constexpr char array, so it can be a template argument.
+ * Supported: flags '0' and '-', a width, length modifiers (ignored, the argument type is used instead), and
+ * %d %i %u %x %X %c %s %%, plus %.2f for Fixed2 values. A wrong argument count or type is a compile error.
+ */
+namespace Format
+{
+
+// values kept as hundredths, like the velocities in global pathing (see TWO_DECIMAL_PLACE)
+struct Fixed2 {
+	long raw;
+};
+
+constexpr int MAX_SPECS = 12;
+
+struct Spec {
+	char conv = 0;
+	bool zero_pad = false;
+	bool left = false;
+	int width = 0;
+	int precision = -1;
+	int lit_begin = 0; // literal text in front of this conversion
+	int lit_len = 0;
+	bool lit_escaped = false; // literal contains a %%
+};
+
+struct Parsed {
+	Spec specs[MAX_SPECS] = {};
+	int count = 0;
+	int tail_begin = 0;
+	int tail_len = 0;
+	bool tail_escaped = false;
+	bool ok = true;
+};
+
+constexpr bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+constexpr Parsed parse(const char* fmt) {
+	Parsed p;
+	int lit_begin = 0;
+	bool escaped = false;
+	int i = 0;
+	while (fmt[i] != '\0') {
+		if (fmt[i] != '%') {
+			i++;
+			continue;
+		}
+		if (fmt[i + 1] == '%') {
+			escaped = true;
+			i += 2;
+			continue;
+		}
+		if (p.count == MAX_SPECS) {
+			p.ok = false;
+			return p;
+		}
+
+		Spec& s = p.specs[p.count];
+		s.lit_begin = lit_begin;
+		s.lit_len = i - lit_begin;
+		s.lit_escaped = escaped;
+		i++;
+		for (; fmt[i] == '0' || fmt[i] == '-'; i++) {
+			s.zero_pad = s.zero_pad || fmt[i] == '0';
+			s.left = s.left || fmt[i] == '-';
+		}
+		for (; is_digit(fmt[i]); i++) {
+			s.width = s.width * 10 + (fmt[i] - '0');
+		}
+		if (fmt[i] == '.') {
+			s.precision = 0;
+			for (i++; is_digit(fmt[i]); i++) {
+				s.precision = s.precision * 10 + (fmt[i] - '0');
+			}
+		}
+		for (; fmt[i] == 'l' || fmt[i] == 'h' || fmt[i] == 'z'; i++) { }
+
+		s.conv = fmt[i];
+		switch (s.conv) {
+		case 'd':
+		case 'i':
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'c':
+		case 's':
+			break;
+		case 'f':
+			p.ok = p.ok && s.precision == 2;
+			break;
+		default:
+			p.ok = false;
+			return p;
+		}
+		i++;
+		p.count += 1;
+		lit_begin = i;
+		escaped = false;
+	}
+	p.tail_begin = lit_begin;
+	p.tail_len = i - lit_begin;
+	p.tail_escaped = escaped;
+	return p;
+}
+
+template <typename T>
+struct is_integer {
+	static constexpr bool value = false;
+};
+#define FORMAT_INTEGER(T)                     \
+	template <>                               \
+	struct is_integer<T> {                    \
+		static constexpr bool value = true; \
+	};
+FORMAT_INTEGER(char)
+FORMAT_INTEGER(signed char)
+FORMAT_INTEGER(unsigned char)
+FORMAT_INTEGER(short)
+FORMAT_INTEGER(unsigned short)
+FORMAT_INTEGER(int)
+FORMAT_INTEGER(unsigned int)
+FORMAT_INTEGER(long)
+FORMAT_INTEGER(unsigned long)
+FORMAT_INTEGER(long long)
+FORMAT_INTEGER(unsigned long long)
+FORMAT_INTEGER(bool)
+#undef FORMAT_INTEGER
+
+template <typename T>
+struct is_string {
+	static constexpr bool value = false;
+};
+template <>
+struct is_string<const char*> {
+	static constexpr bool value = true;
+};
+template <>
+struct is_string<char*> {
+	static constexpr bool value = true;
+};
+
+template <typename T>
+constexpr bool accepts(char conv) {
+	if (conv == 's') {
+		return is_string<T>::value;
+	} else if (conv == 'f') {
+		return false;
+	}
+	return is_integer<T>::value;
+}
+
+template <>
+constexpr bool accepts<Fixed2>(char conv) {
+	return conv == 'f';
+}
+
+template <typename... Args>
+struct ArgTypes {
+	static constexpr bool match(const Parsed&, int) {
+		return true;
+	}
+};
+
+template <typename T, typename... Rest>
+struct ArgTypes<T, Rest...> {
+	static constexpr bool match(const Parsed& p, int i) {
+		return accepts<T>(p.specs[i].conv) && ArgTypes<Rest...>::match(p, i + 1);
+	}
+};
+
+// conversion routines, each writes into out and returns the number of characters written, no null terminator
+int u64_to_dec(char* out, uint64_t value);
+int u64_to_hex(char* out, uint64_t value, bool upper);
+int put_unsigned(char* out, uint64_t value, const Spec& s, bool negative = false);
+int put_fixed2(char* out, long raw, const Spec& s);
+int put_string(char* out, const char* str, const Spec& s);
+int put_char(char* out, char c, const Spec& s);
+int put_literal(char* out, const char* lit, int len, bool escaped);
+
+template <typename T>
+int put_arg(char* out, const Spec& s, T value) {
+	if (s.conv == 'c') {
+		return put_char(out, static_cast<char>(value), s);
+	}
+	if constexpr (static_cast<T>(-1) < static_cast<T>(0)) {
+		if (s.conv == 'x' || s.conv == 'X' || s.conv == 'u') {
+			// two's complement at the width of the argument, like printf
+			return put_unsigned(out, static_cast<uint64_t>(value) & (~0ULL >> (64 - 8 * sizeof(T))), s);
+		} else if (value < 0) {
+			return put_unsigned(out, -static_cast<uint64_t>(value), s, true);
+		}
+	}
+	return put_unsigned(out, static_cast<uint64_t>(value), s);
+}
+
+inline int put_arg(char* out, const Spec& s, const char* value) {
+	return put_string(out, value, s);
+}
+
+inline int put_arg(char* out, const Spec& s, char* value) {
+	return put_string(out, value, s);
+}
+
+inline int put_arg(char* out, const Spec& s, Fixed2 value) {
+	return put_fixed2(out, value.raw, s);
+}
+
+// one argument at a time, so every spec is a constant and put_arg folds down to a single conversion
+template <const char* FMT, int I>
+int format_args(char* out) {
+	constexpr Parsed p = parse(FMT);
+	int len = put_literal(out, FMT + p.tail_begin, p.tail_len, p.tail_escaped);
+	out[len] = '\0';
+	return len;
+}
+
+template <const char* FMT, int I, typename T, typename... Rest>
+int format_args(char* out, T value, Rest... rest) {
+	constexpr Spec s = parse(FMT).specs[I];
+	int len = put_literal(out, FMT + s.lit_begin, s.lit_len, s.lit_escaped);
+	len += put_arg(out + len, s, value);
+	return len + format_args<FMT, I + 1>(out + len, rest...);
+}
+
+// same contract as sprintf: null terminated, returns the length without the terminator
+template <const char* FMT, typename... Args>
+int format(char* out, Args... args) {
+	constexpr Parsed p = parse(FMT);
+	static_assert(p.ok, "unsupported format string");
+	static_assert(p.count == sizeof...(Args), "format string and argument count don't match");
+	static_assert(ArgTypes<Args...>::match(p, 0), "argument type doesn't match its conversion");
+	return format_args<FMT, 0>(out, args...);
+}
+
+}
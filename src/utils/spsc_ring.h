@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * Single producer single consumer ring, meant to live in the memory of the task that reads it while the kernel fills it
+ * from an interrupt handler. Each side only ever writes its own index, and publishes it after the slot is written or
+ * read, so neither side has to lock the other out. A push into a full ring is dropped and counted in lost.
+ */
+template <typename T, uint32_t N>
+class SpscRing {
+	static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+	// producer side
+	bool push(const T& item);
+	// consumer side
+	bool pop(T* out);
+	bool empty() const;
+	uint32_t size() const;
+	uint32_t lost() const;
+
+private:
+	T items[N];
+	uint32_t head = 0;	 // next slot to write, only the producer stores it
+	uint32_t tail = 0;	 // next slot to read, only the consumer stores it
+	uint32_t dropped = 0; // only the producer stores it
+};
+
+template <typename T, uint32_t N>
+bool SpscRing<T, N>::push(const T& item) {
+	uint32_t h = head;
+	if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == N) {
+		__atomic_store_n(&dropped, dropped + 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	items[h & (N - 1)] = item;
+	__atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+template <typename T, uint32_t N>
+bool SpscRing<T, N>::pop(T* out) {
+	uint32_t t = tail;
+	if (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t) {
+		return false;
+	}
+	*out = items[t & (N - 1)];
+	__atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+template <typename T, uint32_t N>
+bool SpscRing<T, N>::empty() const {
+	return __atomic_load_n(&head, __ATOMIC_ACQUIRE) == __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+}
+
+template <typename T, uint32_t N>
+uint32_t SpscRing<T, N>::size() const {
+	return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+}
+
+template <typename T, uint32_t N>
+uint32_t SpscRing<T, N>::lost() const {
+	return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,44 @@
+#include "telemetry.h"
+#include "../etl/crc16_ccitt.h"
+
+using namespace Telemetry;
+
+FrameWriter::FrameWriter(char* buffer, FrameType type)
+	: buffer(buffer) {
+	buffer[0] = FRAME_SYNC;
+	buffer[3] = (char)type;
+}
+
+void FrameWriter::put_u8(uint8_t val) {
+	if (payload_len < FRAME_PAYLOAD_LIMIT) { // anything past the limit is silently cut off
+		buffer[FRAME_HEADER_LEN + payload_len] = (char)val;
+		payload_len++;
+	}
+}
+
+void FrameWriter::put_u16(uint16_t val) {
+	put_u8(val & 0xff);
+	put_u8(val >> 8);
+}
+
+void FrameWriter::put_u32(uint32_t val) {
+	put_u16(val & 0xffff);
+	put_u16(val >> 16);
+}
+
+void FrameWriter::put_bytes(const char* s, int len) {
+	for (int i = 0; i < len; i++) {
+		put_u8(s[i]);
+	}
+}
+
+int FrameWriter::finish() {
+	buffer[1] = (char)(payload_len & 0xff);
+	buffer[2] = (char)(payload_len >> 8);
+	// sync byte is not covered, so a resynchronizing decoder can check a candidate frame on its own
+	etl::crc16_ccitt crc(buffer + 1, buffer + FRAME_HEADER_LEN + payload_len);
+	uint16_t value = crc.value();
+	buffer[FRAME_HEADER_LEN + payload_len] = (char)(value & 0xff);
+	buffer[FRAME_HEADER_LEN + payload_len + 1] = (char)(value >> 8);
+	return FRAME_OVERHEAD + payload_len;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * Binary telemetry over the terminal line, decoded on the host by tools/telemetry_decode.py
+ *
+ * frame := SYNC | len (u16) | type (u8) | payload (len bytes) | crc (u16)
+ * every integer is little endian, crc is CRC-16/CCITT-FALSE over len, type and payload.
+ * Anything on the line that isn't a valid frame (prompt echo, debug_print) is shown as plain text by the decoder.
+ */
+namespace Telemetry
+{
+constexpr char FRAME_SYNC = 0x7e;
+constexpr int FRAME_HEADER_LEN = 4; // sync, len, type
+constexpr int FRAME_CRC_LEN = 2;
+constexpr int FRAME_OVERHEAD = FRAME_HEADER_LEN + FRAME_CRC_LEN;
+constexpr int FRAME_PAYLOAD_LIMIT = 400;
+constexpr int FRAME_BUFFER_SIZE = FRAME_PAYLOAD_LIMIT + FRAME_OVERHEAD;
+
+/**
+ * payload layouts
+ * SENSORS:			u32 tick, 10 raw sensor bytes
+ * SWITCHES:		22 switch states, as the terminal keeps them ('s' / 'c')
+ * RESERVATIONS:	TRACK_MAX bytes, number of the train holding the node or 0
+ * TRAINS:			u8 count, then per train u8 number, u8 speed, u8 direction, i32 velocity (x100 mm/s),
+ * 					i16 next sensor, i16 prev sensor, i32 ticks to next, i32 mm to next, i16 path src, i16 path dest
+ * COUNTERS:		u32 tick, u16 idle (x100 %), u32 frames sent, u32 sensor updates
+ * RECORD:			u8 ring (0 recorded, 1 replay output), u8 kind, u32 us since the first record of the ring, data bytes
+ * 					kind 0 ends the dump
+ */
+enum FrameType { FRAME_SENSORS = 1, FRAME_SWITCHES = 2, FRAME_RESERVATIONS = 3, FRAME_TRAINS = 4, FRAME_COUNTERS = 5, FRAME_RECORD = 6 };
+
+class FrameWriter {
+public:
+	// buffer has to hold at least FRAME_BUFFER_SIZE bytes
+	FrameWriter(char* buffer, FrameType type);
+	void put_u8(uint8_t val);
+	void put_u16(uint16_t val);
+	void put_u32(uint32_t val);
+	void put_bytes(const char* s, int len);
+	// seals the frame with its length and crc, returns the total number of bytes to send
+	int finish();
+
+private:
+	char* buffer;
+	int payload_len = 0;
+};
+}
@@ -0,0 +1,245 @@
+"""
+Host side decoder for the binary telemetry stream (see src/utils/telemetry.h).
+
+Turn the stream on with `telem 1` at the prompt, then either
+    python3 telemetry_decode.py /dev/ttyUSB0 --record run.bin    (needs pyserial)
+or replay a recording offline with
+    python3 telemetry_decode.py run.bin --dump
+
+`recdump` at the prompt sends the recorder ring as RECORD frames, --dump prints them one event per line.
+"""
+
+import argparse
+import struct
+import sys
+import time
+from typing import BinaryIO, Dict, Iterator, List, Optional, Tuple
+
+FRAME_SYNC = 0x7E
+FRAME_HEADER_LEN = 4
+FRAME_CRC_LEN = 2
+FRAME_PAYLOAD_LIMIT = 400
+
+FRAME_SENSORS = 1
+FRAME_SWITCHES = 2
+FRAME_RESERVATIONS = 3
+FRAME_TRAINS = 4
+FRAME_COUNTERS = 5
+FRAME_RECORD = 6
+
+RECORD_KINDS = {0: "end", 1: "sensor", 2: "command", 3: "train_out"}
+RECORD_RINGS = {0: "recorded", 1: "replay_out"}
+
+TRAIN_RECORD = struct.Struct("<BBBihhiihh")
+SENSOR_LETTERS = "ABCDE"
+NO_SENSOR = -1
+
+
+def crc16_ccitt(data: bytes) -> int:
+    """
+    CRC-16/CCITT-FALSE, same as etl::crc16_ccitt on the kernel side.
+    """
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def sensor_name(index: int) -> str:
+    """
+    Convert a 0-based sensor index into its name, e.g. 44 -> C13.
+    """
+    if index < 0 or index >= 16 * len(SENSOR_LETTERS):
+        return "--"
+    return f"{SENSOR_LETTERS[index // 16]}{index % 16 + 1}"
+
+
+def triggered_sensors(raw: bytes) -> List[int]:
+    """
+    Sensor bytes are msb first, so bit 7 of byte 0 is A1.
+    """
+    out = []
+    for i, byte in enumerate(raw):
+        for j in range(8):
+            if byte & (0x80 >> j):
+                out.append(i * 8 + j)
+    return out
+
+
+class Decoder:
+    """
+    Incremental frame decoder. Bytes that don't belong to a valid frame are handed back as text,
+    since debug_print and the prompt echo share the line with the frames.
+    """
+
+    def __init__(self) -> None:
+        self.buf = bytearray()
+        self.crc_errors = 0
+
+    def feed(self, data: bytes) -> Iterator[Tuple[str, object]]:
+        self.buf.extend(data)
+        while self.buf:
+            start = self.buf.find(FRAME_SYNC)
+            if start != 0:
+                text = self.buf if start < 0 else self.buf[:start]
+                yield "text", bytes(text)
+                del self.buf[: len(text)]
+                continue
+            if len(self.buf) < FRAME_HEADER_LEN:
+                return
+            length = self.buf[1] | (self.buf[2] << 8)
+            if length > FRAME_PAYLOAD_LIMIT:
+                yield "text", bytes(self.buf[:1])
+                del self.buf[:1]
+                continue
+            total = FRAME_HEADER_LEN + length + FRAME_CRC_LEN
+            if len(self.buf) < total:
+                return
+            body = bytes(self.buf[1 : FRAME_HEADER_LEN + length])
+            crc = self.buf[total - 2] | (self.buf[total - 1] << 8)
+            if crc16_ccitt(body) != crc:
+                # not a frame after all, resync on the next sync byte
+                self.crc_errors += 1
+                yield "text", bytes(self.buf[:1])
+                del self.buf[:1]
+                continue
+            yield "frame", (self.buf[3], bytes(self.buf[FRAME_HEADER_LEN : FRAME_HEADER_LEN + length]))
+            del self.buf[:total]
+
+
+class Dashboard:
+    """
+    Latest known state of everything the kernel reports.
+    """
+
+    def __init__(self) -> None:
+        self.tick = 0
+        self.idle = 0.0
+        self.frames = 0
+        self.sensor_updates = 0
+        self.sensors: List[int] = []
+        self.recent: List[int] = []
+        self.switches = ""
+        self.reservations: Dict[int, int] = {}
+        self.trains: List[tuple] = []
+        self.log: List[str] = []
+
+    def apply(self, ftype: int, payload: bytes) -> None:
+        if ftype == FRAME_COUNTERS:
+            self.tick, idle, self.frames, self.sensor_updates = struct.unpack_from("<IHII", payload)
+            self.idle = idle / 100
+        elif ftype == FRAME_SENSORS:
+            (self.tick,) = struct.unpack_from("<I", payload)
+            now = triggered_sensors(payload[4:14])
+            for s in now:
+                if s not in self.sensors:
+                    self.recent = ([s] + self.recent)[:10]
+            self.sensors = now
+        elif ftype == FRAME_SWITCHES:
+            self.switches = payload.decode("ascii", "replace")
+        elif ftype == FRAME_RESERVATIONS:
+            self.reservations = {node: owner for node, owner in enumerate(payload) if owner != 0}
+        elif ftype == FRAME_TRAINS:
+            count = payload[0]
+            self.trains = [TRAIN_RECORD.unpack_from(payload, 1 + i * TRAIN_RECORD.size) for i in range(count)]
+
+    def add_text(self, text: bytes) -> None:
+        for line in text.decode("ascii", "replace").replace("\r", "").split("\n"):
+            if line.strip():
+                self.log = (self.log + [line])[-8:]
+
+    def render(self) -> str:
+        t = self.tick
+        out = [f"time {t // 600:03d}:{(t // 10) % 60:02d}.{t % 10}   idle {self.idle:6.2f}%   "
+               f"frames {self.frames}   sensor updates {self.sensor_updates}"]
+        out.append("sensors  " + " ".join(sensor_name(s) for s in self.recent))
+        out.append("switches " + " ".join(f"{i + 1}:{c}" for i, c in enumerate(self.switches)))
+        owners: Dict[int, List[int]] = {}
+        for node, owner in self.reservations.items():
+            owners.setdefault(owner, []).append(node)
+        for owner, nodes in sorted(owners.items()):
+            out.append(f"reserved by {owner:2d}: " + " ".join(sensor_name(n) if n < 80 else str(n) for n in sorted(nodes)))
+        out.append("train  spd dir  vel(mm/s)  next  prev  t_next  d_next  src  dst")
+        for num, speed, direction, vel, nxt, prev, tnext, dnext, src, dst in self.trains:
+            out.append(f"{num:5d}  {speed:3d}  {'S' if direction else 'R'}  {vel / 100:9.2f}  "
+                       f"{sensor_name(nxt):>4}  {sensor_name(prev):>4}  {tnext:6d}  {dnext:6d}  {src:3d}  {dst:3d}")
+        out.append("-" * 64)
+        out.extend(self.log)
+        return "\n".join(out)
+
+
+def describe_record(payload: bytes) -> str:
+    """
+    One line per recorded event, u8 ring, u8 kind, u32 us since the first record, then the data.
+    """
+    ring, kind, at = struct.unpack_from("<BBI", payload)
+    data = payload[6:]
+    if kind == 1:
+        (latency,) = struct.unpack_from("<I", data, 10)
+        detail = " ".join(sensor_name(s) for s in triggered_sensors(data[:10])) + f"  (poll {latency} us)"
+    elif kind == 2:
+        detail = data.decode("ascii", "replace")
+    else:
+        detail = data.hex(" ")
+    return f"{RECORD_RINGS.get(ring, ring)} {at / 1e6:10.6f}s {RECORD_KINDS.get(kind, kind)} {detail}"
+
+
+def open_source(path: str, baud: int) -> Tuple[BinaryIO, bool]:
+    """
+    Returns the stream and whether it is a live serial line.
+    """
+    if path.startswith("/dev/"):
+        import serial  # pyserial, only needed for live runs
+
+        return serial.Serial(path, baud, timeout=0.05), True
+    return open(path, "rb"), False
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", help="serial device (/dev/...) or a recorded file")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--record", help="append every raw byte read to this file")
+    parser.add_argument("--dump", action="store_true", help="print every frame instead of the dashboard")
+    args = parser.parse_args()
+
+    src, live = open_source(args.source, args.baud)
+    record: Optional[BinaryIO] = open(args.record, "ab") if args.record else None
+    decoder = Decoder()
+    dash = Dashboard()
+    last_render = 0.0
+
+    while True:
+        data = src.read(4096)
+        if not data:
+            if live:
+                continue
+            break
+        if record:
+            record.write(data)
+        for kind, item in decoder.feed(data):
+            if kind == "text":
+                dash.add_text(item)
+                continue
+            ftype, payload = item
+            dash.apply(ftype, payload)
+            if args.dump and ftype == FRAME_RECORD:
+                print(describe_record(payload))
+            elif args.dump:
+                print(f"type {ftype} len {len(payload)} {payload.hex()}")
+        if not args.dump and time.time() - last_render > 0.1:
+            last_render = time.time()
+            sys.stdout.write("\033[H\033[2J" + dash.render() + "\n")
+            sys.stdout.flush()
+
+    if not args.dump:
+        print(dash.render())
+    print(f"crc errors: {decoder.crc_errors}", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,143 @@
+#include "../src/routing/dijkstra.h"
+#include <cassert>
+#include <chrono>
+#include <iostream>
+using namespace Routing;
+using namespace std;
+
+const int HOPS_AHEAD = 3;
+
+struct Query {
+	int source;
+	int dest;
+};
+
+// The sensor a few sensors down the track from source, the kind of hop a reroute or a short random run asks for
+int sensors_ahead(Dijkstra& d, track_node* track, int source, int hops) {
+	int node = source;
+	for (int i = 0; i < hops; i++) {
+		if (track[node].type == NODE_EXIT) {
+			return -1;
+		}
+		int next = track[node].edge[DIR_AHEAD].dest - track;
+		etl::list<int, SHORT_PATH_LIMIT> ahead = d.path_to_next_sensor(next);
+		if (ahead.empty()) {
+			return -1;
+		}
+		node = ahead.back();
+	}
+	return (node == source || track[node].type != NODE_SENSOR) ? -1 : node;
+}
+
+void check_same_costs(track_node* track, Dijkstra& full, Dijkstra& alt, etl::unordered_set<int, TRACK_MAX>& banned) {
+	for (int source = 0; source < TRACK_MAX; source++) {
+		for (int dest = 0; dest < TRACK_MAX; dest++) {
+			if (track[source].type == NODE_NONE || track[dest].type == NODE_NONE) {
+				continue;
+			}
+			WeightedPath a, b;
+			bool ra = full.weighted_path_with_ban(&a, banned, source, dest);
+			bool rb = alt.weighted_path_with_ban(&b, banned, source, dest);
+			assert(ra == rb);
+			if (ra) {
+				assert(full.get_cost(dest) == alt.get_cost(dest));
+			}
+
+			etl::list<int, PATH_LIMIT> pa, pb;
+			ra = full.path_with_ban(&pa, banned, source, dest, false, true);
+			rb = alt.path_with_ban(&pb, banned, source, dest, false, true);
+			assert(ra == rb);
+			if (ra) {
+				assert(full.get_cost(dest) == alt.get_cost(dest));
+				assert(pa.back() == dest && pb.back() == dest);
+			}
+		}
+	}
+}
+
+template <typename F>
+void measure(const char* name, Dijkstra& full, Dijkstra& alt, Query* queries, int n, F query) {
+	const int rounds = 50;
+	full.reset_expanded();
+	alt.reset_expanded();
+	auto start = chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < n; i++) {
+			query(full, queries[i]);
+		}
+	}
+	auto mid = chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < n; i++) {
+			query(alt, queries[i]);
+		}
+	}
+	auto end = chrono::steady_clock::now();
+	double full_us = chrono::duration<double, micro>(mid - start).count() / (rounds * n);
+	double alt_us = chrono::duration<double, micro>(end - mid).count() / (rounds * n);
+	cout << "  " << name << ": " << (double)full.get_expanded() / (rounds * n) << " expanded / " << full_us << "us full, "
+		 << (double)alt.get_expanded() / (rounds * n) << " expanded / " << alt_us << "us alt" << endl;
+}
+
+void run_track(const char* name, void (*init)(track_node*)) {
+	static track_node track[TRACK_MAX];
+	init(track);
+	Dijkstra full = Dijkstra(track, false, SearchQueue::BINARY_HEAP, false);
+	Dijkstra alt = Dijkstra(track, false, SearchQueue::BINARY_HEAP, true);
+
+	etl::unordered_set<int, TRACK_MAX> banned;
+	check_same_costs(track, full, alt, banned);
+	banned.insert(16);
+	banned.insert(45);
+	banned.insert(track[101].reverse - track);
+	check_same_costs(track, full, alt, banned);
+	banned.clear();
+	track[36].reserved_by = 24;
+	track[37].reserved_by = 24;
+	track[70].reserved_by = 58;
+	track[71].reserved_by = 58;
+	check_same_costs(track, full, alt, banned);
+	for (int i = 0; i < TRACK_MAX; i++) {
+		track[i].reserved_by = RESERVED_BY_NO_ONE;
+	}
+
+	Query nearby[TRACK_NUM_SENSORS];
+	int num_nearby = 0;
+	for (int source = 0; source < TRACK_NUM_SENSORS; source++) {
+		int dest = sensors_ahead(full, track, source, HOPS_AHEAD);
+		if (dest != -1) {
+			nearby[num_nearby++] = Query { source, dest };
+		}
+	}
+
+	Query anywhere[TRACK_MAX];
+	int num_anywhere = 0;
+	for (int source = 0; source < TRACK_NUM_SENSORS; source++) {
+		anywhere[num_anywhere++] = Query { source, (source * 37 + 11) % TRACK_NUM_SENSORS };
+	}
+
+	cout << name << ":" << endl;
+	auto weighted = [&](Dijkstra& d, Query q) {
+		WeightedPath wp;
+		d.weighted_path_with_ban(&wp, banned, q.source, q.dest);
+	};
+	auto forward_only = [&](Dijkstra& d, Query q) {
+		etl::list<int, PATH_LIMIT> path;
+		d.path_with_ban(&path, banned, q.source, q.dest, false, true);
+	};
+	measure("sensors ahead, weighted_path", full, alt, nearby, num_nearby, weighted);
+	measure("sensors ahead, no reversing", full, alt, nearby, num_nearby, forward_only);
+	measure("any sensor, weighted_path", full, alt, anywhere, num_anywhere, weighted);
+
+	// a reroute bans whatever the other trains hold
+	banned.insert(track[nearby[0].dest].reverse - track);
+	banned.insert(nearby[num_nearby / 2].dest);
+	measure("sensors ahead with bans, weighted_path", full, alt, nearby, num_nearby, weighted);
+}
+
+int main() {
+	run_track("track a", init_tracka);
+	run_track("track b", init_trackb);
+	cout << "alt tests passed" << endl;
+	return 0;
+}
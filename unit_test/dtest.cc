@@ -76,7 +76,7 @@ int main() {
 
 	qb.clear();
 	assert(dijkstrab.path(&qb, 0, 49, true));
-	cout << "Path from 0 to 49 (dist = " << dijkstrab.get_dist(48) << ", cost = " << dijkstrab.get_cost(48) << "):" << endl;
+	cout << "Path from 0 to 49 (dist = " << dijkstrab.get_dist(49) << ", cost = " << dijkstrab.get_cost(49) << "):" << endl;
 	int wpath[] = { 0, 103, 101, 100, 107, 3, 31, 108, 41, 110, 18, 33, 117, 119, 122, 120, 49 };
 	index = 0;
 	while (!qb.empty()) {
@@ -0,0 +1,117 @@
+#include <assert.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+// after the system headers, printf.h renames sprintf to its own
+#include "../src/utils/format.h"
+#include "../src/utils/printf.h"
+
+// printf.cc prints through the uart, nothing here does
+void uart_putc(size_t, size_t, char) { }
+
+// same strings as terminal_admin.h, which can't be included off the pi
+constexpr char MOVE_CURSOR_F[] = "\033[%d;%dH";
+constexpr char TRAIN_PRINTOUT_L0[] = ": %02d%c %06.2f";
+constexpr char TRAIN_PRINTOUT_L1[] = "NxS: %c%02d PrS: %c%02d";
+constexpr char TRAIN_PRINTOUT_L2[] = "T: %04dt P: %04dmm";
+constexpr char TRAIN_PRINTOUT_L3[] = "S: %5s D: %5s";
+constexpr char TRAIN_PRINTOUT_L4[] = "BgC: %03d BgW: %03d";
+constexpr char IDLE_PRINTOUT[] = "Percent: %llu.%03llu";
+
+constexpr char NEGATIVE[] = "%d|%5d|%-5d|%05d|%x|%X|%u";
+constexpr char ESCAPED[] = "100%% %s%%";
+constexpr char FIXED[] = "%.2f %06.2f %-8.2f|";
+
+const int ROUNDS = 1000000;
+
+void check(const char* got, const char* expected) {
+	if (strcmp(got, expected) != 0) {
+		fprintf(stderr, "got \"%s\", expected \"%s\"\n", got, expected);
+		assert(false);
+	}
+}
+
+template <typename F>
+double time_it(F f) {
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < ROUNDS; i++) {
+		f(i);
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / ROUNDS;
+}
+
+int main() {
+	char a[128];
+	char b[128];
+
+	// same output as printf.cc for everything the terminal prints
+	for (int i = -3; i < 20000; i += 7) {
+		int n = i * 37;
+		Format::format<MOVE_CURSOR_F>(a, i, n);
+		sprintf(b, MOVE_CURSOR_F, i, n);
+		check(a, b);
+
+		long vel = n > 0 ? n : 0;
+		Format::format<TRAIN_PRINTOUT_L0>(a, i % 31, (i & 1) ? 'S' : 'R', Format::Fixed2 { vel });
+		sprintf(b, ": %02d%c %03ld.%02ld", i % 31, (i & 1) ? 'S' : 'R', vel / 100, vel % 100);
+		check(a, b);
+
+		Format::format<TRAIN_PRINTOUT_L1>(a, 'A' + i % 5, i % 17, 'X', 0);
+		sprintf(b, TRAIN_PRINTOUT_L1, 'A' + i % 5, i % 17, 'X', 0);
+		check(a, b);
+
+		Format::format<TRAIN_PRINTOUT_L2>(a, n % 10000, i % 10000);
+		sprintf(b, TRAIN_PRINTOUT_L2, n % 10000, i % 10000);
+		check(a, b);
+
+		Format::format<TRAIN_PRINTOUT_L4>(a, i, n % 1000);
+		sprintf(b, TRAIN_PRINTOUT_L4, i, n % 1000);
+		check(a, b);
+
+		unsigned long long total = 1000 + i;
+		Format::format<IDLE_PRINTOUT>(a, n * 100ULL / total, n * 100000ULL / total % 1000);
+		sprintf(b, IDLE_PRINTOUT, n * 100ULL / total, n * 100000ULL / total % 1000);
+		check(a, b);
+
+		Format::format<NEGATIVE>(a, -n, -i, -i, -i, n, n, n);
+		sprintf(b, NEGATIVE, -n, -i, -i, -i, n, n, n);
+		check(a, b);
+	}
+
+	Format::format<TRAIN_PRINTOUT_L3>(a, "BR153", "E7");
+	check(a, "S: BR153 D:    E7");
+	Format::format<ESCAPED>(a, "sure");
+	check(a, "100% sure%");
+	Format::format<FIXED>(a, Format::Fixed2 { 5 }, Format::Fixed2 { -150 }, Format::Fixed2 { 123456 });
+	check(a, "0.05 -01.50 1234.56 |");
+	assert(Format::format<MOVE_CURSOR_F>(a, 72, 1) == 7);
+
+	// and how long each takes, per call
+	double fast, slow;
+	fast = time_it([&](int i) { Format::format<MOVE_CURSOR_F>(a, i & 63, i & 255); });
+	slow = time_it([&](int i) { sprintf(b, MOVE_CURSOR_F, i & 63, i & 255); });
+	fprintf(stdout, "%-24s format %6.1f ns  printf %6.1f ns  x%.1f\n", "MOVE_CURSOR_F", fast, slow, slow / fast);
+
+	fast = time_it([&](int i) { Format::format<TRAIN_PRINTOUT_L0>(a, i & 31, 'S', Format::Fixed2 { i & 0xffff }); });
+	slow = time_it([&](int i) { sprintf(b, ": %02d%c %03ld.%02ld", i & 31, 'S', (long)(i & 0xffff) / 100, (long)(i & 0xffff) % 100); });
+	fprintf(stdout, "%-24s format %6.1f ns  printf %6.1f ns  x%.1f\n", "TRAIN_PRINTOUT_L0", fast, slow, slow / fast);
+
+	fast = time_it([&](int i) { Format::format<TRAIN_PRINTOUT_L1>(a, 'C', i & 15, 'D', i & 7); });
+	slow = time_it([&](int i) { sprintf(b, TRAIN_PRINTOUT_L1, 'C', i & 15, 'D', i & 7); });
+	fprintf(stdout, "%-24s format %6.1f ns  printf %6.1f ns  x%.1f\n", "TRAIN_PRINTOUT_L1", fast, slow, slow / fast);
+
+	fast = time_it([&](int i) { Format::format<TRAIN_PRINTOUT_L2>(a, i % 10000, (i * 7) % 10000); });
+	slow = time_it([&](int i) { sprintf(b, TRAIN_PRINTOUT_L2, i % 10000, (i * 7) % 10000); });
+	fprintf(stdout, "%-24s format %6.1f ns  printf %6.1f ns  x%.1f\n", "TRAIN_PRINTOUT_L2", fast, slow, slow / fast);
+
+	fast = time_it([&](int i) { Format::format<TRAIN_PRINTOUT_L3>(a, (i & 1) ? "C13" : "MR153", "E7"); });
+	slow = time_it([&](int i) { sprintf(b, TRAIN_PRINTOUT_L3, (i & 1) ? "C13" : "MR153", "E7"); });
+	fprintf(stdout, "%-24s format %6.1f ns  printf %6.1f ns  x%.1f\n", "TRAIN_PRINTOUT_L3", fast, slow, slow / fast);
+
+	fast = time_it([&](int i) { Format::format<IDLE_PRINTOUT>(a, (unsigned long long)i % 100, (unsigned long long)i % 1000); });
+	slow = time_it([&](int i) { sprintf(b, IDLE_PRINTOUT, (unsigned long long)i % 100, (unsigned long long)i % 1000); });
+	fprintf(stdout, "%-24s format %6.1f ns  printf %6.1f ns  x%.1f\n", "IDLE_PRINTOUT", fast, slow, slow / fast);
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include "../src/routing/dijkstra.h"
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <iostream>
+using namespace Routing;
+using namespace std;
+
+static PathTable table;
+
+void clear_reservations(track_node* track) {
+	for (int i = 0; i < TRACK_MAX; i++) {
+		track[i].reserved_by = RESERVED_BY_NO_ONE;
+	}
+}
+
+bool same_path(WeightedPath& a, WeightedPath& b) {
+	if (a.has_reverse != b.has_reverse || a.rev_offset != b.rev_offset || a.wpath.size() != b.wpath.size()) {
+		return false;
+	}
+	while (!a.wpath.empty()) {
+		if (a.wpath.front() != b.wpath.front()) {
+			return false;
+		}
+		a.wpath.pop_front();
+		b.wpath.pop_front();
+	}
+	return true;
+}
+
+// Every answer out of the table has to cost what a fresh search costs
+void check_against_search(track_node* track, Dijkstra& tabled, Dijkstra& plain, etl::unordered_set<int, TRACK_MAX>& banned, bool exact) {
+	for (int source = 0; source < TRACK_MAX; source++) {
+		for (int dest = 0; dest < TRACK_MAX; dest++) {
+			if (track[source].type == NODE_NONE || track[dest].type == NODE_NONE) {
+				continue;
+			}
+			WeightedPath a, b;
+			bool ra = tabled.weighted_path_with_ban(&a, banned, source, dest);
+			bool rb = plain.weighted_path_with_ban(&b, banned, source, dest);
+			assert(ra == rb);
+			if (!ra) {
+				continue;
+			}
+			assert(tabled.get_cost(dest) == plain.get_cost(dest));
+			if (exact) {
+				assert(same_path(a, b));
+			}
+		}
+	}
+}
+
+template <typename F>
+double time_queries(track_node* track, F query) {
+	const int rounds = 20;
+	int queries = 0;
+	auto start = chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++) {
+		for (int source = 0; source < TRACK_MAX; source++) {
+			int dest = (source * 37 + r) % TRACK_MAX;
+			if (track[source].type != NODE_NONE && track[dest].type != NODE_NONE) {
+				query(source, dest);
+				queries++;
+			}
+		}
+	}
+	auto end = chrono::steady_clock::now();
+	return chrono::duration<double, micro>(end - start).count() / queries;
+}
+
+void run_track(const char* name, void (*init)(track_node*)) {
+	static track_node track[TRACK_MAX];
+	init(track);
+	Dijkstra tabled = Dijkstra(track);
+	Dijkstra plain = Dijkstra(track);
+	auto build_start = chrono::steady_clock::now();
+	tabled.build_table(&table);
+	auto build_end = chrono::steady_clock::now();
+
+	etl::unordered_set<int, TRACK_MAX> banned;
+	check_against_search(track, tabled, plain, banned, true);
+
+	// a ban or a reservation on the way forces a search, one off the way does not change the answer
+	banned.insert(16);
+	banned.insert(45);
+	banned.insert(track[101].reverse - track);
+	check_against_search(track, tabled, plain, banned, false);
+	banned.clear();
+	track[36].reserved_by = 24;
+	track[37].reserved_by = 24;
+	track[70].reserved_by = 58;
+	track[71].reserved_by = 58;
+	check_against_search(track, tabled, plain, banned, false);
+	clear_reservations(track);
+
+	for (int source = 0; source < TRACK_MAX; source += 7) {
+		if (track[source].type == NODE_NONE) {
+			continue;
+		}
+		assert(tabled.num_sensors_within_dist_range(source) == plain.num_sensors_within_dist_range(source));
+	}
+
+	cout << name << ": table built in " << chrono::duration<double, milli>(build_end - build_start).count() << "ms ("
+		 << sizeof(PathTable) << " bytes)" << endl;
+
+	WeightedPath wp;
+	double search_us = time_queries(track, [&](int source, int dest) {
+		wp.wpath.clear();
+		plain.weighted_path_with_ban(&wp, banned, source, dest);
+	});
+	double table_us = time_queries(track, [&](int source, int dest) {
+		wp.wpath.clear();
+		tabled.weighted_path_with_ban(&wp, banned, source, dest);
+	});
+	cout << name << ": weighted_path " << search_us << "us searched, " << table_us << "us from table" << endl;
+
+	search_us = time_queries(track, [&](int source, int) { plain.num_sensors_within_dist_range(source); });
+	table_us = time_queries(track, [&](int source, int) { tabled.num_sensors_within_dist_range(source); });
+	cout << name << ": sensors in range " << search_us << "us searched, " << table_us << "us from table" << endl;
+
+	banned.insert(track[120].reverse - track);
+	banned.insert(120);
+	search_us = time_queries(track, [&](int source, int dest) {
+		wp.wpath.clear();
+		plain.weighted_path_with_ban(&wp, banned, source, dest);
+	});
+	table_us = time_queries(track, [&](int source, int dest) {
+		wp.wpath.clear();
+		tabled.weighted_path_with_ban(&wp, banned, source, dest);
+	});
+	cout << name << ": weighted_path with a ban " << search_us << "us searched, " << table_us << "us with table" << endl;
+}
+
+int main() {
+	run_track("track a", init_tracka);
+	run_track("track b", init_trackb);
+	cout << "path table tests passed" << endl;
+	return 0;
+}
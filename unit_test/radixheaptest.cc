@@ -0,0 +1,139 @@
+#include "../src/etl/random.h"
+#include "../src/routing/dijkstra.h"
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace Routing;
+using namespace std;
+
+void heap_tests() {
+	RadixHeap<8> heap;
+	assert(heap.empty());
+	heap.emplace(5, 50);
+	heap.emplace(3, 30);
+	heap.emplace(9, 90);
+	heap.emplace(3, 31);
+	assert(heap.size() == 4);
+	assert(heap.top().first == 3);
+	heap.pop();
+	assert(heap.top().first == 3);
+	heap.pop();
+
+	// keys at or above the last one taken out are fine
+	heap.emplace(4, 40);
+	assert(heap.top().first == 4 && heap.top().second == 40);
+	heap.pop();
+	assert(heap.top().first == 5);
+	heap.pop();
+	assert(heap.top().first == 9);
+	heap.pop();
+	assert(heap.empty());
+
+	// an empty heap starts over, like a new search does
+	heap.emplace(0, 1);
+	heap.pop();
+
+	for (int i = 0; i < 8; i++) {
+		heap.emplace(100 - i, i);
+	}
+	assert(heap.size() == 8);
+	// one more than it has slots for doesn't get dropped quietly
+	pid_t child = fork();
+	if (child == 0) {
+		heap.emplace(1000, 8);
+		_exit(0);
+	}
+	int status;
+	waitpid(child, &status, 0);
+	assert(WIFSIGNALED(status));
+	heap.clear();
+	assert(heap.empty());
+
+	// against a sort, with pushes interleaved the way a search does them
+	etl::random_xorshift rng(2718);
+	RadixHeap<512> big;
+	int taken = 0;
+	int last = 0;
+	for (int round = 0; round < 2000; round++) {
+		int pushes = rng.range(0, 3);
+		for (int i = 0; i < pushes && big.size() < 500; i++) {
+			big.emplace(last + rng.range(0, 5000), round);
+		}
+		if (!big.empty()) {
+			etl::pair<int, int> p = big.top();
+			big.pop();
+			assert(p.first >= last);
+			last = p.first;
+			taken++;
+		}
+	}
+	assert(taken > 0);
+}
+
+template <typename F>
+double time_queries(track_node* track, F query) {
+	const int rounds = 20;
+	int queries = 0;
+	auto start = chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++) {
+		for (int source = 0; source < TRACK_MAX; source++) {
+			int dest = (source * 37 + r) % TRACK_MAX;
+			if (track[source].type != NODE_NONE && track[dest].type != NODE_NONE) {
+				query(source, dest);
+				queries++;
+			}
+		}
+	}
+	auto end = chrono::steady_clock::now();
+	return chrono::duration<double, micro>(end - start).count() / queries;
+}
+
+void run_track(const char* name, void (*init)(track_node*)) {
+	static track_node track[TRACK_MAX];
+	init(track);
+	Dijkstra binary = Dijkstra(track, false, SearchQueue::BINARY_HEAP);
+	Dijkstra radix = Dijkstra(track, false, SearchQueue::RADIX_HEAP);
+	etl::unordered_set<int, TRACK_MAX> banned;
+
+	// both queues settle ties in some order, what has to match is what every answer costs
+	for (int source = 0; source < TRACK_MAX; source++) {
+		for (int dest = 0; dest < TRACK_MAX; dest++) {
+			if (track[source].type == NODE_NONE || track[dest].type == NODE_NONE) {
+				continue;
+			}
+			WeightedPath a, b;
+			bool ra = binary.weighted_path_with_ban(&a, banned, source, dest);
+			bool rb = radix.weighted_path_with_ban(&b, banned, source, dest);
+			assert(ra == rb);
+			if (ra) {
+				assert(binary.get_cost(dest) == radix.get_cost(dest));
+				assert(binary.get_dist(a.wpath.back()) == radix.get_dist(b.wpath.back()));
+			}
+		}
+	}
+
+	WeightedPath wp;
+	double binary_us = time_queries(track, [&](int source, int dest) {
+		wp.wpath.clear();
+		binary.weighted_path_with_ban(&wp, banned, source, dest);
+	});
+	double radix_us = time_queries(track, [&](int source, int dest) {
+		wp.wpath.clear();
+		radix.weighted_path_with_ban(&wp, banned, source, dest);
+	});
+	cout << name << ": weighted_path " << binary_us << "us binary heap, " << radix_us << "us radix heap" << endl;
+
+	binary_us = time_queries(track, [&](int source, int) { binary.num_sensors_within_dist_range(source); });
+	radix_us = time_queries(track, [&](int source, int) { radix.num_sensors_within_dist_range(source); });
+	cout << name << ": sensors in range " << binary_us << "us binary heap, " << radix_us << "us radix heap" << endl;
+}
+
+int main() {
+	heap_tests();
+	run_track("track a", init_tracka);
+	run_track("track b", init_trackb);
+	cout << "radix heap tests passed" << endl;
+	return 0;
+}
@@ -0,0 +1,130 @@
+#include "../src/etl/random.h"
+#include "../src/routing/replanner.h"
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <iostream>
+using namespace Routing;
+using namespace std;
+
+const int STEPS = 2000;
+
+// Cost the track server's search finds for the same question
+int searched_cost(Dijkstra& d, etl::unordered_set<int, TRACK_MAX>& banned, int source, int goal) {
+	etl::list<int, PATH_LIMIT> path;
+	if (!d.path_with_ban(&path, banned, source, goal, true, true)) {
+		return INT_MAX;
+	}
+	return d.get_cost(goal);
+}
+
+int random_node(etl::random_xorshift& rng, track_node* track) {
+	int v;
+	do {
+		v = rng.range(0, TRACK_MAX - 1);
+	} while (track[v].type == NODE_NONE);
+	return v;
+}
+
+/**
+ * Each step a train somewhere on the track asks for a way to goal while other trains take and release nodes: flips
+ * bans on and off and moves reservations around, then asks from a fresh start.
+ */
+void churn(const char* name, void (*init)(track_node*), int goal, int flips) {
+	static track_node track[TRACK_MAX];
+	init(track);
+	Dijkstra full = Dijkstra(track, false, SearchQueue::BINARY_HEAP, false);
+	etl::random_xorshift rng(1234 + flips);
+	etl::unordered_set<int, TRACK_MAX> banned;
+	Replanner planner;
+	planner.reset(track, goal, banned);
+	// what the track server does: repair while little changed, search again and start over past the limit
+	Replanner limited;
+	limited.reset(track, goal, banned);
+
+	int64_t replan_ns = 0;
+	int64_t search_ns = 0;
+	int64_t limited_ns = 0;
+	int fell_back = 0;
+	int searched = 0;
+	int path[PATH_LIMIT];
+	for (int step = 0; step < STEPS; step++) {
+		for (int i = 0; i < flips; i++) {
+			int v = random_node(rng, track);
+			if (v == goal) {
+				continue;
+			}
+			if (rng.range(0, 1) == 0) {
+				if (banned.count(v)) {
+					banned.erase(v);
+				} else if (banned.size() < 12) {
+					banned.insert(v);
+				}
+			} else {
+				int reserver = track[v].reserved_by == RESERVED_BY_NO_ONE ? 24 : RESERVED_BY_NO_ONE;
+				track[v].reserved_by = reserver;
+				track[v].reverse->reserved_by = reserver;
+			}
+		}
+		int source = random_node(rng, track);
+
+		auto a = chrono::steady_clock::now();
+		planner.update(banned);
+		int incremental = planner.cost_from(source);
+		auto b = chrono::steady_clock::now();
+		int expected = searched_cost(full, banned, source, goal);
+		auto c = chrono::steady_clock::now();
+		replan_ns += chrono::duration_cast<chrono::nanoseconds>(b - a).count();
+		search_ns += chrono::duration_cast<chrono::nanoseconds>(c - b).count();
+
+		int limited_cost = -1;
+		auto d = chrono::steady_clock::now();
+		if (limited.changes(banned) > REPLAN_CHURN_LIMIT) {
+			limited.reset(track, goal, banned);
+			searched_cost(full, banned, source, goal);
+			fell_back++;
+		} else {
+			limited.update(banned);
+			limited_cost = limited.cost_from(source);
+		}
+		auto e = chrono::steady_clock::now();
+		limited_ns += chrono::duration_cast<chrono::nanoseconds>(e - d).count();
+		assert(limited_cost == -1 || source == goal || limited_cost == expected);
+
+		if (source == goal) {
+			continue;
+		}
+		assert(incremental == expected);
+		searched++;
+
+		// the walk follows the costs it reports
+		int len, dist;
+		if (planner.walk(source, path, &len, &dist)) {
+			assert(path[0] == source && path[len - 1] == goal);
+			for (int i = 0; i < len; i++) {
+				assert(banned.count(path[i]) == 0);
+			}
+		}
+	}
+
+	cout << name << ", " << flips << " flips per reroute: " << (double)planner.get_expanded() / STEPS << " expanded / "
+		 << replan_ns / 1000.0 / STEPS << "us replanning, " << (double)full.get_expanded() / STEPS << " expanded / "
+		 << search_ns / 1000.0 / STEPS << "us searching, " << limited_ns / 1000.0 / STEPS << "us with the churn limit ("
+		 << fell_back << " searched)" << endl;
+
+	for (int i = 0; i < TRACK_MAX; i++) {
+		track[i].reserved_by = RESERVED_BY_NO_ONE;
+	}
+}
+
+int main() {
+	int flips[] = { 1, 4, 16 };
+	for (int f : flips) {
+		churn("track a", init_tracka, 45, f);
+	}
+	for (int f : flips) {
+		churn("track b", init_trackb, 70, f);
+	}
+	cout << "replanner tests passed" << endl;
+	return 0;
+}
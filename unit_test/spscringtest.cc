@@ -0,0 +1,52 @@
+#include "../src/utils/spsc_ring.h"
+#include <assert.h>
+#include <stdio.h>
+
+int main() {
+	SpscRing<int, 4> ring;
+
+	assert(ring.empty());
+	assert(ring.size() == 0);
+	int out = -1;
+	assert(!ring.pop(&out));
+	assert(out == -1);
+
+	// fill it, the fifth push is dropped and counted
+	for (int i = 0; i < 4; i++) {
+		assert(ring.push(i));
+	}
+	assert(ring.size() == 4);
+	assert(!ring.push(4));
+	assert(ring.lost() == 1);
+
+	for (int i = 0; i < 4; i++) {
+		assert(ring.pop(&out));
+		assert(out == i);
+	}
+	assert(ring.empty());
+
+	// the indices keep going past the size, the slots wrap
+	for (int round = 0; round < 10; round++) {
+		assert(ring.push(round * 2));
+		assert(ring.push(round * 2 + 1));
+		assert(ring.pop(&out));
+		assert(out == round * 2);
+		assert(ring.pop(&out));
+		assert(out == round * 2 + 1);
+	}
+	assert(ring.empty());
+	assert(ring.lost() == 1);
+
+	struct Byte {
+		char c;
+		unsigned long long at;
+	};
+	SpscRing<Byte, 2> bytes;
+	assert(bytes.push(Byte { 'a', 10 }));
+	Byte b;
+	assert(bytes.pop(&b));
+	assert(b.c == 'a' && b.at == 10);
+
+	printf("spsc ring tests passed\n");
+	return 0;
+}